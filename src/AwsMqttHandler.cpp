@@ -4,54 +4,129 @@
  */
 
  #include "AwsMqttHandler.h"
+ #include "CommandTrace.h"
+ #include "LEDControl.h"
+ #include "Logger.h"
 
-// Callback function for receiving MQTT messages (defined in main.cpp)
-void mqttCallback(char* topic, byte* payload, unsigned int length) {
-  Serial.print("Message arrived [");
-  Serial.print(topic);
-  Serial.print("] ");
+// Desired state from shadow deltas is queued here for the control loop
+CommandQueue* deltaCommandQueue = nullptr;
+
+// Highest shadow version applied this session; older deltas are dropped
+uint32_t lastDeltaVersion = 0;
+
+// Receives acknowledgements for updates published with a clientToken
+void (*shadowAckCallback)(uint32_t token, bool accepted) = nullptr;
+
+// Fills in a command from the cloud
+void initDeltaCommand(PodCommand& command, uint8_t type) {
+  command = {};
+  command.type = type;
+  command.source = TRACE_SOURCE_MQTT;
+}
+
+// Matches an accepted or rejected document to the update that caused it
+void handleShadowAck(JsonDocument& doc, bool accepted) {
+  // Tokens are 8 hex digits; updates from other clients carry their own or none
+  const char* token = doc["clientToken"] | "";
+  char* end;
+  uint32_t value = strtoul(token, &end, 16);
+  if (!shadowAckCallback || strlen(token) != 8 || *end != '\0') {
+    return;
+  }
+  shadowAckCallback(value, accepted);
+}
+
+// Applies desired state from a delta document
+void handleShadowDelta(JsonDocument& doc) {
+  // Deltas can arrive out of order; only apply newer versions
+  uint32_t version = doc["version"] | 0;
+  if (version <= lastDeltaVersion) {
+    LOG_D("Stale shadow delta v%u dropped (applied v%u)", version, lastDeltaVersion);
+    return;
+  }
+  
+  JsonObject desired = doc["state"];
+  if (desired.isNull() || !deltaCommandQueue) {
+    return;
+  }
+  
+  // Brightness and color before on/off so an explicit nightlight value wins
+  PodCommand commands[5];
+  uint8_t count = 0;
+  
+  if (desired.containsKey("is_open")) {
+    initDeltaCommand(commands[count], CMD_SET_POD_OPEN);
+    commands[count++].value = desired["is_open"].as<bool>() ? 1 : 0;
+  }
+  
+  if (desired.containsKey("nightlight_brightness")) {
+    int brightness = desired["nightlight_brightness"].as<int>();
+    if (brightness >= 0 && brightness <= 100) {
+      initDeltaCommand(commands[count], CMD_SET_LED_BRIGHTNESS);
+      commands[count++].value = brightness;
+    } else {
+      LOG_W("Invalid shadow brightness: %d", brightness);
+    }
+  }
+  
+  if (desired.containsKey("color")) {
+    char color[7];
+    if (parseLEDColor(desired["color"] | "", color)) {
+      initDeltaCommand(commands[count], CMD_SET_LED_COLOR);
+      memcpy(commands[count++].color, color, sizeof(color));
+    }
+  }
+  
+  if (desired.containsKey("nightlight")) {
+    initDeltaCommand(commands[count], CMD_SET_LED_STATE);
+    commands[count++].value = desired["nightlight"].as<bool>() ? LED_STATE_ON : LED_STATE_OFF;
+  }
   
-  // Create a buffer for the payload
-  char message[length + 1];
-  for (unsigned int i = 0; i < length; i++) {
-    message[i] = (char)payload[i];
+  // One trace per target: the LED trace follows the last LED command
+  if (count > 0 && commands[0].type == CMD_SET_POD_OPEN) {
+    commands[0].traceId = traceCommandReceived(TRACE_SOURCE_MQTT, TRACE_TARGET_DOOR);
+  }
+  if (count > 0 && commands[count - 1].type != CMD_SET_POD_OPEN) {
+    commands[count - 1].traceId = traceCommandReceived(TRACE_SOURCE_MQTT, TRACE_TARGET_LED);
   }
-  message[length] = '\0';
   
-  Serial.println(message);
+  // Report back once applied, which clears the delta in the shadow
+  commands[count] = {};
+  commands[count].type = CMD_SHADOW_ACK;
+  commands[count++].source = TRACE_SOURCE_MQTT;
   
-  // Parse the JSON payload
+  if (!deltaCommandQueue->pushBatch(commands, count)) {
+    LOG_W("MQTT command queue full, shadow delta v%u dropped", version);
+    for (uint8_t i = 0; i < count; i++) {
+      traceCommandDiscarded(commands[i].traceId);
+    }
+    return;
+  }
+  
+  lastDeltaVersion = version;
+  LOG_I("Shadow delta v%u queued (%u commands)", version, count - 1);
+}
+
+// Callback for MQTT messages, called from loop() in the cloud task
+void mqttCallback(char* topic, byte* payload, unsigned int length) {
+  LOG_D("Message arrived [%s] %u bytes", topic, length);
+  
+  // Parse in place; strings point into the client's receive buffer
   StaticJsonDocument<512> doc;
-  DeserializationError error = deserializeJson(doc, message);
+  DeserializationError error = deserializeJson(doc, (char*)payload, length);
   
   // Check for parsing errors
   if (error) {
-    Serial.print("deserializeJson() failed: ");
-    Serial.println(error.c_str());
+    LOG_W("deserializeJson() failed: %s", error.c_str());
     return;
   }
   
-  // Check if this is a shadow update
-  if (doc.containsKey("state") && doc["state"].containsKey("desired")) {
-    // Extract the desired state
-    JsonObject desired = doc["state"]["desired"];
-    
-    // Update device status based on received shadow with the new token names
-    if (desired.containsKey("is_open")) {
-      Serial.println("is_open:" + String(desired["is_open"].as<bool>()));      
-    }
-    
-    if (desired.containsKey("nightlight")) {
-      Serial.println("nightlight:" + String(desired["nightlight"].as<bool>()));     
-    }
-    
-    if (desired.containsKey("color")) {
-      Serial.println("color:" + String(desired["color"].as<String>()));      
-    }
-    
-    if (desired.containsKey("nightlight_brightness")) {
-      Serial.println("nightlight_brightness:" + String(desired["nightlight_brightness"].as<int>())); 
-    }
+  if (strcmp(topic, AWS_IOT_DELTA_TOPIC) == 0) {
+    handleShadowDelta(doc);
+  } else if (strcmp(topic, AWS_IOT_ACCEPTED_TOPIC) == 0) {
+    handleShadowAck(doc, true);
+  } else if (strcmp(topic, AWS_IOT_REJECTED_TOPIC) == 0) {
+    handleShadowAck(doc, false);
   }
 }
  
@@ -68,16 +143,17 @@ void mqttCallback(char* topic, byte* payload, unsigned int length) {
    
    // Configure MQTT client
    mqttClient.setServer(AWS_IOT_ENDPOINT, 8883);
+   mqttClient.setBufferSize(AWS_MQTT_BUFFER_SIZE);
    
    // Set default callback
    mqttClient.setCallback(mqttCallback);
    
-   Serial.println("AWS MQTT Handler initialized");
+   LOG_I("AWS MQTT Handler initialized");
  }
  
  // Connect to AWS IoT
  bool AwsMqttHandler::connect() {
-   Serial.print("Connecting to AWS IoT Core...");
+   LOG_I("Connecting to AWS IoT Core...");
    
    // Create a random client ID
    String clientId = "ESP32-";
@@ -85,21 +161,25 @@ void mqttCallback(char* topic, byte* payload, unsigned int length) {
    
    // Connect to the MQTT broker on AWS
    if (mqttClient.connect(clientId.c_str())) {
-     Serial.println("Connected to AWS IoT!");
+     LOG_I("Connected to AWS IoT!");
+     
+     // A deleted shadow starts again at version 1
+     lastDeltaVersion = 0;
      
-     // Subscribe to the desired topic
-     if (mqttClient.subscribe(AWS_IOT_SUBSCRIBE_TOPIC)) {
-       Serial.print("Subscribed to: ");
-       Serial.println(AWS_IOT_SUBSCRIBE_TOPIC);
+     // Subscribe to desired state changes and to update acknowledgements.
+     // QoS 1 so the broker redelivers acknowledgements lost in transit.
+     if (mqttClient.subscribe(AWS_IOT_DELTA_TOPIC) &&
+         mqttClient.subscribe(AWS_IOT_ACCEPTED_TOPIC, 1) &&
+         mqttClient.subscribe(AWS_IOT_REJECTED_TOPIC, 1)) {
+       LOG_I("Subscribed to: %s", AWS_IOT_DELTA_TOPIC);
      } else {
-       Serial.println("Failed to subscribe to topic");
+       LOG_W("Failed to subscribe to topic");
        return false;
      }
      
      return true;
    } else {
-     Serial.print("Failed to connect to AWS IoT, rc=");
-     Serial.println(mqttClient.state());
+     LOG_W("Failed to connect to AWS IoT, rc=%d", mqttClient.state());
      return false;
    }
  }
@@ -117,7 +197,7 @@ void mqttCallback(char* topic, byte* payload, unsigned int length) {
        lastReconnectAttempt = 0;
        return true;
      } else {
-       Serial.println("Reconnect failed, will try again...");
+       LOG_W("Reconnect failed, will try again...");
        return false;
      }
    }
@@ -148,12 +228,9 @@ void mqttCallback(char* topic, byte* payload, unsigned int length) {
    bool success = mqttClient.publish(topic, payload);
    
    if (success) {
-     Serial.print("Published to ");
-     Serial.print(topic);
-     Serial.print(": ");
-     Serial.println(payload);
+     LOG_D("Published to %s: %s", topic, payload);
    } else {
-     Serial.println("Failed to publish message");
+     LOG_W("Failed to publish message");
    }
    
    return success;
@@ -161,91 +238,56 @@ void mqttCallback(char* topic, byte* payload, unsigned int length) {
  
  // Publish device status to AWS IoT (all parameters)
  bool AwsMqttHandler::publishDeviceStatus(bool podStatus, bool ledStatus, String ledColor, int ledBrightness) {
-   // Create a JSON document for the device shadow
-   StaticJsonDocument<256> jsonDoc;
-   JsonObject state = jsonDoc.createNestedObject("state");
-   JsonObject reported = state.createNestedObject("reported");
-   
-   // Add device status to the JSON document with the specified token names
-   reported["is_open"] = podStatus;
-   reported["nightlight"] = ledStatus;
-   reported["color"] = ledColor;
-   reported["nightlight_brightness"] = ledBrightness;
-   
-   // Serialize the JSON document to a string
-   char jsonBuffer[256];
-   serializeJson(jsonDoc, jsonBuffer);
-   
-   // Publish the message
-   return publish(AWS_IOT_PUBLISH_TOPIC, jsonBuffer);
+   return publishReported(REPORTED_ALL, podStatus, ledStatus, ledColor.c_str(), ledBrightness);
  }
  
  // Publish pod status to AWS IoT
  bool AwsMqttHandler::publishPodStatus(bool podStatus) {
-   // Create a JSON document for the device shadow
-   StaticJsonDocument<128> jsonDoc;
-   JsonObject state = jsonDoc.createNestedObject("state");
-   JsonObject reported = state.createNestedObject("reported");
-   
-   // Add only pod status to the JSON document
-   reported["is_open"] = podStatus;
-   
-   // Serialize the JSON document to a string
-   char jsonBuffer[128];
-   serializeJson(jsonDoc, jsonBuffer);
-   
-   // Publish the message
-   return publish(AWS_IOT_PUBLISH_TOPIC, jsonBuffer);
+   return publishReported(REPORTED_IS_OPEN, podStatus, false, "", 0);
  }
  
  // Publish LED status to AWS IoT
  bool AwsMqttHandler::publishLedStatus(bool ledStatus) {
-   // Create a JSON document for the device shadow
-   StaticJsonDocument<128> jsonDoc;
-   JsonObject state = jsonDoc.createNestedObject("state");
-   JsonObject reported = state.createNestedObject("reported");
-   
-   // Add only LED status to the JSON document
-   reported["nightlight"] = ledStatus;
-   
-   // Serialize the JSON document to a string
-   char jsonBuffer[128];
-   serializeJson(jsonDoc, jsonBuffer);
-   
-   // Publish the message
-   return publish(AWS_IOT_PUBLISH_TOPIC, jsonBuffer);
+   return publishReported(REPORTED_NIGHTLIGHT, false, ledStatus, "", 0);
  }
  
  // Publish LED color to AWS IoT
  bool AwsMqttHandler::publishLedColor(String ledColor) {
-   // Create a JSON document for the device shadow
-   StaticJsonDocument<128> jsonDoc;
-   JsonObject state = jsonDoc.createNestedObject("state");
-   JsonObject reported = state.createNestedObject("reported");
-   
-   // Add only LED color to the JSON document
-   reported["color"] = ledColor;
-   
-   // Serialize the JSON document to a string
-   char jsonBuffer[128];
-   serializeJson(jsonDoc, jsonBuffer);
-   
-   // Publish the message
-   return publish(AWS_IOT_PUBLISH_TOPIC, jsonBuffer);
+   return publishReported(REPORTED_COLOR, false, false, ledColor.c_str(), 0);
  }
  
  // Publish LED brightness to AWS IoT
  bool AwsMqttHandler::publishLedBrightness(int ledBrightness) {
+   return publishReported(REPORTED_BRIGHTNESS, false, false, "", ledBrightness);
+ }
+ 
+ // Publish the selected fields as one shadow update
+ bool AwsMqttHandler::publishReported(uint8_t fields, bool podStatus, bool ledStatus, const char* ledColor, int ledBrightness,
+                                      const char* clientToken) {
    // Create a JSON document for the device shadow
-   StaticJsonDocument<128> jsonDoc;
+   StaticJsonDocument<256> jsonDoc;
    JsonObject state = jsonDoc.createNestedObject("state");
    JsonObject reported = state.createNestedObject("reported");
    
-   // Add only LED brightness to the JSON document
-   reported["nightlight_brightness"] = ledBrightness;
+   // Add only the requested fields with the shadow token names
+   if (fields & REPORTED_IS_OPEN) {
+     reported["is_open"] = podStatus;
+   }
+   if (fields & REPORTED_NIGHTLIGHT) {
+     reported["nightlight"] = ledStatus;
+   }
+   if (fields & REPORTED_COLOR) {
+     reported["color"] = ledColor;
+   }
+   if (fields & REPORTED_BRIGHTNESS) {
+     reported["nightlight_brightness"] = ledBrightness;
+   }
+   if (clientToken) {
+     jsonDoc["clientToken"] = clientToken;
+   }
    
    // Serialize the JSON document to a string
-   char jsonBuffer[128];
+   char jsonBuffer[256];
    serializeJson(jsonDoc, jsonBuffer);
    
    // Publish the message
@@ -255,4 +297,25 @@ void mqttCallback(char* topic, byte* payload, unsigned int length) {
  // Set callback for incoming messages
  void AwsMqttHandler::setCallback(void (*callback)(char*, byte*, unsigned int)) {
    mqttClient.setCallback(callback);
+ }
+ 
+ // Set the queue for desired state from shadow deltas
+ void AwsMqttHandler::setCommandQueue(CommandQueue* commandQueue) {
+   deltaCommandQueue = commandQueue;
+ }
+ 
+ #if AWS_TLS_SESSION_RESUMPTION
+ // Handshake statistics from the TLS client
+ const TlsStats& AwsMqttHandler::getTlsStats() {
+   return wifiClient.getStats();
+ }
+ 
+ const char* AwsMqttHandler::getKeyType() {
+   return wifiClient.getKeyType();
+ }
+ #endif
+ 
+ // Set the receiver for shadow update acknowledgements
+ void AwsMqttHandler::setAckCallback(void (*callback)(uint32_t token, bool accepted)) {
+   shadowAckCallback = callback;
  }
\ No newline at end of file
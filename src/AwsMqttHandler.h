@@ -11,6 +11,27 @@
  #include <PubSubClient.h>
  #include <ArduinoJson.h>
  #include "aws_config.h"
+ #include "CommandQueue.h"
+ 
+ // Resume the previous TLS session on reconnect (build with
+ // -DAWS_TLS_SESSION_RESUMPTION=0 to use WiFiClientSecure instead)
+ #ifndef AWS_TLS_SESSION_RESUMPTION
+ #define AWS_TLS_SESSION_RESUMPTION 1
+ #endif
+ 
+ #if AWS_TLS_SESSION_RESUMPTION
+ #include "TlsClient.h"
+ #endif
+ 
+ // Reported state fields for publishReported()
+ #define REPORTED_IS_OPEN 0x01
+ #define REPORTED_NIGHTLIGHT 0x02
+ #define REPORTED_BRIGHTNESS 0x04
+ #define REPORTED_COLOR 0x08
+ #define REPORTED_ALL 0x0F
+ 
+ // Shadow documents with metadata exceed PubSubClient's 256 byte default
+ #define AWS_MQTT_BUFFER_SIZE 1024
  
  class AwsMqttHandler {
    public:
@@ -43,11 +64,32 @@
      bool publishLedColor(String ledColor);
      bool publishLedBrightness(int ledBrightness);
      
+     // Publish one shadow update containing only the REPORTED_* fields given.
+     // A clientToken is echoed back on the accepted or rejected topic.
+     bool publishReported(uint8_t fields, bool podStatus, bool ledStatus, const char* ledColor, int ledBrightness,
+                          const char* clientToken = nullptr);
+     
      // Set callback for incoming messages
      void setCallback(void (*callback)(char*, byte*, unsigned int));
      
+     // Queue that desired state from shadow deltas is pushed to
+     void setCommandQueue(CommandQueue* commandQueue);
+     
+     // Called with the clientToken of each accepted or rejected shadow update
+     void setAckCallback(void (*callback)(uint32_t token, bool accepted));
+     
+ #if AWS_TLS_SESSION_RESUMPTION
+     // Full and resumed handshake counts and times
+     const TlsStats& getTlsStats();
+     const char* getKeyType();
+ #endif
+     
    private:
+ #if AWS_TLS_SESSION_RESUMPTION
+     TlsClient wifiClient;
+ #else
      WiFiClientSecure wifiClient;
+ #endif
      PubSubClient mqttClient;
      unsigned long lastReconnectAttempt = 0;
      const long reconnectInterval = 5000; // 5 seconds
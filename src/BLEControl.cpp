@@ -1,192 +1,197 @@
 #include "BLEControl.h"
 #include "MotorControl.h"
 #include "LEDControl.h"
+#include "MemoryMonitor.h"
+#include "Logger.h"
+#include "CommandTrace.h"
+#include "Sensors.h"
+#include "SafetyController.h"
+#include <esp_heap_caps.h>
 
-// BLE Server Callbacks Implementation
-void BLEServerCallback::onConnect(BLEServer* pServer) {
-    if (bleControl) {
-        uint16_t clientId = pServer->getConnId();
-        bleControl->handleClientConnect(clientId);
-    }
-}
+// Names of characteristics for logging, indexed by CHAR_ID_*
+static const char* CharacteristicNames[CHAR_ID_COUNT] = {
+    "door status",
+    "door position",
+    "LED status",
+    "LED brightness",
+    "LED color",
+    "WiFi credentials",
+    "WiFi status",
+    "child lock status",
+    "JSON status",
+    "binary status",
+    "command frame",
+    "WiFi scan"
+};
 
-void BLEServerCallback::onDisconnect(BLEServer* pServer) {
-    if (bleControl) {
-        bleControl->handleClientDisconnect();
+void BLEControl::onTransportRead(uint8_t characteristicId) {
+    // The value is only fetched when debug logging is enabled
+    if (characteristicId < CHAR_ID_COUNT) {
+        LOG_D("BLE Client read %s: %s", CharacteristicNames[characteristicId], transport->getValue(characteristicId));
     }
 }
 
-// BLE Characteristic Callbacks Implementation
-void BLECharacteristicCallback::onWrite(BLECharacteristic* characteristic) {
-    if (!bleControl) return;
-    
-    std::string uuid = characteristic->getUUID().toString();
-    
-    if (uuid == UUID_DOOR_STATUS) {
-        bleControl->handleDoorStatusWrite(characteristic);
-    }
-    else if (uuid == UUID_DOOR_POSITION) {
-        bleControl->handleDoorPositionWrite(characteristic);
-    }
-    else if (uuid == UUID_LIGHTS) {
-        bleControl->handleLEDStatusWrite(characteristic);
-    }
-    else if (uuid == UUID_LIGHTS_BRIGHTNESS) {
-        bleControl->handleLEDBrightnessWrite(characteristic);
-    }
-    else if (uuid == UUID_LIGHTS_COLOR) {
-        bleControl->handleLEDColorWrite(characteristic);
-    }
-    else if (uuid == UUID_WIFI_CREDENTIALS) {
-        bleControl->handleWiFiCredentialsWrite(characteristic);
-    }
-    else if (uuid == UUID_CHILD_LOCK) {
-        bleControl->handleChildLockWrite(characteristic);
-    }
-}
+// Write handlers indexed by CHAR_ID_*
+const BLEControl::WriteHandler BLEControl::writeHandlers[CHAR_ID_COUNT] = {
+    &BLEControl::handleDoorStatusWrite,       // CHAR_ID_DOOR_STATUS
+    &BLEControl::handleDoorPositionWrite,     // CHAR_ID_DOOR_POSITION
+    &BLEControl::handleLEDStatusWrite,        // CHAR_ID_LIGHTS
+    &BLEControl::handleLEDBrightnessWrite,    // CHAR_ID_LIGHTS_BRIGHTNESS
+    &BLEControl::handleLEDColorWrite,         // CHAR_ID_LIGHTS_COLOR
+    &BLEControl::handleWiFiCredentialsWrite,  // CHAR_ID_WIFI_CREDENTIALS
+    nullptr,                                  // CHAR_ID_WIFI_STATUS
+    &BLEControl::handleChildLockWrite,        // CHAR_ID_CHILD_LOCK
+    nullptr,                                  // CHAR_ID_JSON_STATUS
+    nullptr,                                  // CHAR_ID_BINARY_STATUS
+    &BLEControl::handleCommandFrameWrite,     // CHAR_ID_COMMAND_FRAME
+    &BLEControl::handleWiFiScanWrite          // CHAR_ID_WIFI_SCAN
+};
 
-void BLECharacteristicCallback::onRead(BLECharacteristic* characteristic) {
-    std::string uuid = characteristic->getUUID().toString();
-    std::string value = characteristic->getValue();
-    
-    // Print the value read from the characteristic
-    if (uuid == UUID_DOOR_STATUS) {
-        Serial.print("BLE Client read door status: ");
-        Serial.println(value.c_str());
-    }
-    else if (uuid == UUID_DOOR_POSITION) {
-        Serial.print("BLE Client read door position: ");
-        Serial.println(value.c_str());
-    }
-    else if (uuid == UUID_LIGHTS) {
-        Serial.print("BLE Client read LED status: ");
-        Serial.println(value.c_str());
-    }
-    else if (uuid == UUID_LIGHTS_BRIGHTNESS) {
-        Serial.print("BLE Client read LED brightness: ");
-        Serial.println(value.c_str());
-    }
-    else if (uuid == UUID_LIGHTS_COLOR) {
-        Serial.print("BLE Client read LED color: ");
-        Serial.println(value.c_str());
-    }
-    else if (uuid == UUID_CHILD_LOCK) {
-        Serial.print("BLE Client read child lock status: ");
-        Serial.println(value.c_str());
-    }
-    else if (uuid == UUID_JSON_STATUS) {
-        Serial.print("BLE Client read JSON status: ");
-        Serial.println(value.c_str());
+void BLEControl::onTransportWrite(uint8_t characteristicId, const std::string& value) {
+    if (characteristicId < CHAR_ID_COUNT && writeHandlers[characteristicId]) {
+        (this->*writeHandlers[characteristicId])(value);
     }
 }
 
+// Status field to characteristic mapping, indexed by STATUS_FIELD_*
+static const uint8_t StatusFieldCharacteristics[STATUS_FIELD_COUNT] = {
+    CHAR_ID_DOOR_STATUS,        // STATUS_FIELD_DOOR_STATUS
+    CHAR_ID_DOOR_POSITION,      // STATUS_FIELD_DOOR_POSITION
+    CHAR_ID_LIGHTS,             // STATUS_FIELD_LED_STATUS
+    CHAR_ID_LIGHTS_BRIGHTNESS,  // STATUS_FIELD_LED_BRIGHTNESS
+    CHAR_ID_LIGHTS_COLOR,       // STATUS_FIELD_LED_COLOR
+    CHAR_ID_WIFI_STATUS,        // STATUS_FIELD_WIFI_STATUS
+    CHAR_ID_CHILD_LOCK,         // STATUS_FIELD_CHILD_LOCK
+    CHAR_ID_NONE,               // STATUS_FIELD_POD_STATE
+    CHAR_ID_NONE,               // STATUS_FIELD_SAFETY
+    CHAR_ID_NONE                // STATUS_FIELD_FRAME_ACK
+};
+
 // BLEControl Constructor
-BLEControl::BLEControl(bool* podOpenFlag, WiFiControl* wifiControl, bool* childLock) 
-    : pServer(nullptr), pAdvertising(nullptr), pDoorStatus(nullptr), pDoorPosition(nullptr), 
-      pLEDStatus(nullptr), pLEDBrightness(nullptr), pLEDColor(nullptr), pWiFiCredentials(nullptr), 
-      pWiFiStatus(nullptr), pChildLock(nullptr), pJSONStatus(nullptr), isClientConnected(false), connectedClientId(0),
-      podOpenFlagRef(podOpenFlag), wifiControlRef(wifiControl), childLockRef(childLock), 
-      networkBuffer(""), passwordBuffer(""), lastJSONUpdate(0) {
+BLEControl::BLEControl(bool* podOpenFlag, WiFiControl* wifiControl, bool* childLock, CommandQueue* commandQueue) 
+    : transport(nullptr), connectionCount(0), notifyRotation(0), lastActivity(0),
+      podOpenFlagRef(podOpenFlag), wifiControlRef(wifiControl), childLockRef(childLock), commandQueueRef(commandQueue), 
+      networkBuffer(""), passwordBuffer(""), dirtyFields(0), lastJSONUpdate(0), jsonUpdatePending(false),
+      lastBinaryUpdate(0), binaryUpdatePending(false), binaryStatusSequence(0),
+      scanPageRequest(WIFI_SCAN_NO_REQUEST), scanResultsVersion(0), lastAdvertisingUpdate(0),
+      advertisingUpdatePending(false) {
+    // Start from values no real state matches so the first update always publishes
+    statusCache.doorStatus = 0xFF;
+    statusCache.doorPosition = 0xFF;
+    statusCache.ledStatus = 0xFF;
+    statusCache.ledBrightness = 0xFF;
+    statusCache.ledColor[0] = '\0';
+    statusCache.wifiStatus = "";
+    statusCache.wifiState = 0xFF;
+    statusCache.childLock = 0xFF;
+    statusCache.podState = 0xFF;
+    statusCache.podTarget = 0xFF;
+    statusCache.safetyStatus = 0xFF;
+    statusCache.frameAck = 0;
+    
+    for (uint8_t i = 0; i < STATUS_FIELD_COUNT; i++) {
+        lastFieldNotify[i] = 0;
+    }
+    memset(&footprint, 0, sizeof(footprint));
+    memset(readyStats, 0, sizeof(readyStats));
+    gattLayoutHash = 0;
+    memset(connections, 0, sizeof(connections));
+    memset(&advertisedStatus, 0, sizeof(advertisedStatus));
+    connectionLock = portMUX_INITIALIZER_UNLOCKED;
 }
 
 void BLEControl::begin() {
-    Serial.println("Initializing BLE...");
+    LOG_I("Initializing BLE...");
     
-    // Initialize BLE
-    BLEDevice::init("Sole Pod");
-    pServer = BLEDevice::createServer();
+    uint32_t heapBefore = ESP.getFreeHeap();
+    uint32_t internalBefore = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+    unsigned long setupStart = millis();
     
-    // Set server callbacks for connection management
-    pServer->setCallbacks(new BLEServerCallback(this));
-
-    // Create service with more characteristics support
-    static BLEUUID serviceUUID("7d840001-11eb-4c13-89f2-246b6e0b0000");
-    BLEService* pService = pServer->createService(serviceUUID, 35, 0); // Increased for JSON characteristic
+    // Initialize the selected BLE stack and the service
+    initBondStore();
+    transport = createBleTransport();
+    transport->begin(BLE_DEVICE_NAME, UUID_SERVICE, BLE_PREFERRED_MTU, this);
+#if BLE_BONDING_ENABLED
+    transport->enableBonding();
+#endif
 
     // Create all characteristics
-    createCharacteristics(pService);
+    createCharacteristics();
     
     // Set initial values based on current states
     setInitialValues();
 
     // Start the service
-    pService->start();
+    transport->start();
 
-    // Get advertising instance and configure it
-    pAdvertising = BLEDevice::getAdvertising();
-    pAdvertising->addServiceUUID(UUID_SERVICE);
-    pAdvertising->setScanResponse(true);
-    pAdvertising->setMinPreferred(0x06);  // Functions that help with iPhone connections issue
-    pAdvertising->setMinPreferred(0x12);
+    // Advertise the service UUID and the status
+    updateAdvertisingData();
     
     // Start advertising
     startAdvertising();
+    
+    // Footprint of this backend. Flash is compared between builds of each
+    // backend (pio run -e ...), the image size is logged for reference.
+    footprint.heapUsed = heapBefore - ESP.getFreeHeap();
+    footprint.internalUsed = internalBefore - heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+    footprint.setupTime = millis() - setupStart;
+    footprint.imageSize = ESP.getSketchSize();
 
-    Serial.println("BLE Control initialized and advertising started");
+    LOG_I("BLE Control initialized and advertising started (%s: heap %u bytes, internal %u bytes, %u ms)", 
+          transport->getName(), footprint.heapUsed, footprint.internalUsed, footprint.setupTime);
+}
+
+// Characteristics are always created in the same order, so their handles stay
+// the same across restarts and a bonded central's cached discovery stays valid
+void BLEControl::addCharacteristic(uint8_t characteristicId, const char* uuid, uint8_t properties) {
+    transport->addCharacteristic(characteristicId, uuid, properties);
+    
+    gattLayoutHash = (gattLayoutHash ^ characteristicId) * 16777619;
+    for (const char* c = uuid; *c; c++) {
+        gattLayoutHash = (gattLayoutHash ^ (uint8_t)*c) * 16777619;
+    }
+    gattLayoutHash = (gattLayoutHash ^ properties) * 16777619;
 }
 
-void BLEControl::createCharacteristics(BLEService* pService) {
+void BLEControl::createCharacteristics() {
+    gattLayoutHash = 2166136261;
+    const uint8_t statusProperties = BLE_PROP_WRITE | BLE_PROP_READ | BLE_PROP_NOTIFY;
+    
     // Create Door Status Characteristic
-    pDoorStatus = pService->createCharacteristic(
-        UUID_DOOR_STATUS, 
-        BLECharacteristic::PROPERTY_WRITE | BLECharacteristic::PROPERTY_READ
-    );
-    pDoorStatus->setCallbacks(new BLECharacteristicCallback(this, UUID_DOOR_STATUS));
+    addCharacteristic(CHAR_ID_DOOR_STATUS, UUID_DOOR_STATUS, statusProperties);
 
     // Create Door Position Characteristic
-    pDoorPosition = pService->createCharacteristic(
-        UUID_DOOR_POSITION, 
-        BLECharacteristic::PROPERTY_WRITE | BLECharacteristic::PROPERTY_READ
-    );
-    pDoorPosition->setCallbacks(new BLECharacteristicCallback(this, UUID_DOOR_POSITION));
+    addCharacteristic(CHAR_ID_DOOR_POSITION, UUID_DOOR_POSITION, statusProperties);
     
     // Create LED Status Characteristic
-    pLEDStatus = pService->createCharacteristic(
-        UUID_LIGHTS,
-        BLECharacteristic::PROPERTY_WRITE | BLECharacteristic::PROPERTY_READ
-    );
-    pLEDStatus->setCallbacks(new BLECharacteristicCallback(this, UUID_LIGHTS));
+    addCharacteristic(CHAR_ID_LIGHTS, UUID_LIGHTS, statusProperties);
     
     // Create LED Brightness Characteristic
-    pLEDBrightness = pService->createCharacteristic(
-        UUID_LIGHTS_BRIGHTNESS,
-        BLECharacteristic::PROPERTY_WRITE | BLECharacteristic::PROPERTY_READ
-    );
-    pLEDBrightness->setCallbacks(new BLECharacteristicCallback(this, UUID_LIGHTS_BRIGHTNESS));
+    addCharacteristic(CHAR_ID_LIGHTS_BRIGHTNESS, UUID_LIGHTS_BRIGHTNESS, statusProperties);
     
     // Create LED Color Characteristic
-    pLEDColor = pService->createCharacteristic(
-        UUID_LIGHTS_COLOR,
-        BLECharacteristic::PROPERTY_WRITE | BLECharacteristic::PROPERTY_READ
-    );
-    pLEDColor->setCallbacks(new BLECharacteristicCallback(this, UUID_LIGHTS_COLOR));
+    addCharacteristic(CHAR_ID_LIGHTS_COLOR, UUID_LIGHTS_COLOR, statusProperties);
     
     // Create WiFi Credentials Characteristic (write-only)
-    pWiFiCredentials = pService->createCharacteristic(
-        UUID_WIFI_CREDENTIALS, 
-        BLECharacteristic::PROPERTY_WRITE
-    );
-    pWiFiCredentials->setCallbacks(new BLECharacteristicCallback(this, UUID_WIFI_CREDENTIALS));
-    
-    // Create WiFi Status Characteristic (read-only)
-    pWiFiStatus = pService->createCharacteristic(
-        UUID_WIFI_STATUS, 
-        BLECharacteristic::PROPERTY_READ | BLECharacteristic::PROPERTY_NOTIFY
-    );
+    addCharacteristic(CHAR_ID_WIFI_CREDENTIALS, UUID_WIFI_CREDENTIALS, BLE_PROP_WRITE);
+    
+    // Create WiFi Status Characteristic (read-only with notify)
+    addCharacteristic(CHAR_ID_WIFI_STATUS, UUID_WIFI_STATUS, BLE_PROP_READ | BLE_PROP_NOTIFY);
     
     // Create Child Lock Characteristic
-    pChildLock = pService->createCharacteristic(
-        UUID_CHILD_LOCK,
-        BLECharacteristic::PROPERTY_WRITE | BLECharacteristic::PROPERTY_READ
-    );
-    pChildLock->setCallbacks(new BLECharacteristicCallback(this, UUID_CHILD_LOCK));
+    addCharacteristic(CHAR_ID_CHILD_LOCK, UUID_CHILD_LOCK, statusProperties);
     
     // Create JSON Status Characteristic (read-only with notify)
-    pJSONStatus = pService->createCharacteristic(
-        UUID_JSON_STATUS,
-        BLECharacteristic::PROPERTY_READ | BLECharacteristic::PROPERTY_NOTIFY
-    );
-    pJSONStatus->setCallbacks(new BLECharacteristicCallback(this, UUID_JSON_STATUS));
+    addCharacteristic(CHAR_ID_JSON_STATUS, UUID_JSON_STATUS, BLE_PROP_READ | BLE_PROP_NOTIFY);
+    
+    // Create Binary Status Characteristic (read-only with notify)
+    addCharacteristic(CHAR_ID_BINARY_STATUS, UUID_BINARY_STATUS, BLE_PROP_READ | BLE_PROP_NOTIFY);
+    
+    // Create Command Frame Characteristic (write without response)
+    addCharacteristic(CHAR_ID_COMMAND_FRAME, UUID_COMMAND_FRAME, BLE_PROP_WRITE_NR);
+    
+    // Create WiFi Scan Characteristic (page select / rescan, read with notify)
+    addCharacteristic(CHAR_ID_WIFI_SCAN, UUID_WIFI_SCAN, BLE_PROP_WRITE | BLE_PROP_READ | BLE_PROP_NOTIFY);
 }
 
 void BLEControl::setInitialValues() {
@@ -203,247 +208,967 @@ void BLEControl::setInitialValues() {
     updateLEDColor(getLEDColor());
     
     // Set initial WiFi status
-    updateWiFiStatus(wifiControlRef->getWiFiStatusString());
+    updateWiFiStatus(wifiControlRef->getStatusString());
 
     // Set initial child lock status
     updateChildLock(*childLockRef);
     
-    // Set initial JSON status
+    // Set initial JSON and binary status
     updateJSONStatus();
+    updateBinaryStatus();
 }
 
 // JSON Status Management
 void BLEControl::updateJSONStatus() {
-    if (!pJSONStatus) return;
+    if (!transport) return;
     
     // Create JSON document
     StaticJsonDocument<512> jsonDoc;
     
-    // Get current values from individual characteristics
-    String doorStatusValue = String(pDoorStatus->getValue().c_str());
-    String doorPositionValue = String(pDoorPosition->getValue().c_str());
-    String ledStatusValue = String(pLEDStatus->getValue().c_str());
-    String ledBrightnessValue = String(pLEDBrightness->getValue().c_str());
-    String ledColorValue = String(pLEDColor->getValue().c_str());
-    String wifiStatusValue = String(pWiFiStatus->getValue().c_str());
-    String childLockValue = String(pChildLock->getValue().c_str());
-    
-    // Populate JSON document
-    jsonDoc["door_status"] = doorStatusValue.toInt();
-    jsonDoc["door_position"] = doorPositionValue.toInt();
-    jsonDoc["led_status"] = ledStatusValue.toInt();
-    jsonDoc["led_brightness"] = ledBrightnessValue.toInt();
-    jsonDoc["led_color"] = ledColorValue;
-    jsonDoc["wifi_status"] = wifiStatusValue;
-    jsonDoc["child_lock"] = childLockValue.toInt();
+    // Populate JSON document from the cached values
+    jsonDoc["door_status"] = statusCache.doorStatus;
+    jsonDoc["door_position"] = statusCache.doorPosition;
+    jsonDoc["led_status"] = statusCache.ledStatus;
+    jsonDoc["led_brightness"] = statusCache.ledBrightness;
+    jsonDoc["led_color"] = (const char*)statusCache.ledColor;
+    jsonDoc["wifi_status"] = statusCache.wifiStatus;
+    jsonDoc["wifi_boot_ms"] = wifiControlRef->getBootToIpTime();
+    jsonDoc["child_lock"] = statusCache.childLock;
+    jsonDoc["pod_state"] = statusCache.podState;
+    jsonDoc["safety"] = statusCache.safetyStatus;
     jsonDoc["timestamp"] = millis();  // Add timestamp for freshness
     
+    // Memory telemetry
+    const MemoryStats& mem = getMemoryStats();
+    jsonDoc["heap_free"] = mem.freeHeap;
+    jsonDoc["heap_min"] = mem.minFreeHeap;
+    jsonDoc["heap_block"] = mem.largestFreeBlock;
+    jsonDoc["stack_min"] = mem.minStackHeadroom;
+    jsonDoc["allocs_loop"] = mem.allocsPerLoop;
+    jsonDoc["allocs_max"] = mem.maxAllocsPerLoop;
+    jsonDoc["mem_warn"] = mem.warnings;
+    
     // Serialize JSON to string
     char jsonBuffer[512];
     size_t jsonLength = serializeJson(jsonDoc, jsonBuffer);
     
-    // Update the characteristic
-    pJSONStatus->setValue(jsonBuffer);
+    // Update the characteristic and notify subscribed clients
+    transport->setValue(CHAR_ID_JSON_STATUS, (const uint8_t*)jsonBuffer, jsonLength);
+    notifyCharacteristic(CHAR_ID_JSON_STATUS);
+    
+    LOG_D("JSON Status updated: %u bytes", jsonLength);
+}
+
+// Pack the cached status into the binary characteristic
+void BLEControl::updateBinaryStatus() {
+    if (!transport) return;
     
-    // Notify connected clients if any
-    if (isClientConnected) {
-        pJSONStatus->notify();
+    uint32_t rgb = strtoul(statusCache.ledColor, nullptr, 16);
+    
+    BinaryStatus status;
+    status.version = BINARY_STATUS_VERSION;
+    status.sequence = binaryStatusSequence++;
+    status.podState = statusCache.podState;
+    status.podTarget = statusCache.podTarget;
+    status.doorPosition = statusCache.doorPosition;
+    status.ledStatus = statusCache.ledStatus;
+    status.ledBrightness = statusCache.ledBrightness;
+    status.ledRed = (rgb >> 16) & 0xFF;
+    status.ledGreen = (rgb >> 8) & 0xFF;
+    status.ledBlue = rgb & 0xFF;
+    status.childLock = statusCache.childLock;
+    status.wifiState = statusCache.wifiState;
+    status.safetyStatus = statusCache.safetyStatus;
+    status.frameAck = statusCache.frameAck;
+    
+    transport->setValue(CHAR_ID_BINARY_STATUS, (const uint8_t*)&status, sizeof(status));
+    notifyCharacteristic(CHAR_ID_BINARY_STATUS);
+}
+
+// Send the characteristic's current value to every central subscribed to it.
+// The value is copied once and shared by all connections.
+void BLEControl::notifyCharacteristic(uint8_t characteristicId) {
+    if (!transport || connectionCount == 0) {
+        return;
+    }
+    
+    std::string value = transport->getValue(characteristicId);
+    
+    // Snapshot the subscribed connections. A central that enabled indications
+    // gets an indication when none is outstanding, which measures the round trip.
+    uint8_t slots[BLE_MAX_CONNECTIONS];
+    uint16_t connIds[BLE_MAX_CONNECTIONS];
+    uint16_t mtus[BLE_MAX_CONNECTIONS];
+    bool indicate[BLE_MAX_CONNECTIONS];
+    uint8_t targetCount = 0;
+    uint16_t subscriptionBit = 1 << characteristicId;
+    
+    portENTER_CRITICAL(&connectionLock);
+    for (uint8_t i = 0; i < BLE_MAX_CONNECTIONS; i++) {
+        BLEConnection& connection = connections[i];
+        if (!connection.active || !((connection.subscriptions | connection.indications) & subscriptionBit)) {
+            continue;
+        }
+        
+        slots[targetCount] = i;
+        connIds[targetCount] = connection.connId;
+        mtus[targetCount] = connection.mtu;
+        indicate[targetCount] = (connection.indications & subscriptionBit) && !connection.indicationPending;
+        if (indicate[targetCount]) {
+            connection.indicationPending = true;
+            connection.indicationCharacteristic = characteristicId;
+            connection.indicationSentAt = micros();
+        }
+        targetCount++;
+    }
+    portEXIT_CRITICAL(&connectionLock);
+    
+    if (targetCount == 0) {
+        return;
+    }
+    
+    // Rotate the first connection served, so none is always last when the
+    // controller runs short of transmit buffers
+    uint8_t first = notifyRotation++ % targetCount;
+    for (uint8_t n = 0; n < targetCount; n++) {
+        uint8_t target = (first + n) % targetCount;
+        
+        // Values longer than the connection's MTU are truncated, as the stacks do
+        uint16_t length = value.length();
+        if (length > mtus[target] - 3) {
+            length = mtus[target] - 3;
+        }
+        
+        bool sent = transport->notify(characteristicId, connIds[target], (const uint8_t*)value.data(), length, 
+                                      indicate[target]);
+        
+        // The slot may have been released or reused while the lock was not held
+        uint32_t firstNotifyTime = 0;
+        bool firstNotify = false;
+        portENTER_CRITICAL(&connectionLock);
+        BLEConnection& connection = connections[slots[target]];
+        if (connection.active && connection.connId == connIds[target]) {
+            if (sent) {
+                if (connection.notifications++ == 0) {
+                    connection.firstNotifyTime = millis() - connection.connectedAt;
+                    firstNotifyTime = connection.firstNotifyTime;
+                    firstNotify = true;
+                }
+            } else {
+                connection.notifyFailures++;
+                if (indicate[target]) {
+                    connection.indicationPending = false;
+                }
+            }
+        }
+        portEXIT_CRITICAL(&connectionLock);
+        
+        if (firstNotify) {
+            LOG_I("BLE Client %u: first notification %u ms after connecting", connIds[target], firstNotifyTime);
+        }
     }
+}
+
+// Rebuild the advertisement when the advertised status changes
+void BLEControl::updateAdvertisingData() {
+    if (!transport) return;
     
-    Serial.print("JSON Status updated: ");
-    Serial.println(jsonBuffer);
+    AdvertisedStatus status;
+    status.companyId = ADV_COMPANY_ID;
+    status.version = ADV_STATUS_VERSION;
+    status.podState = statusCache.podState;
+    status.flags = 0;
+    if (statusCache.podTarget == 1) status.flags |= ADV_FLAG_TARGET_OPEN;
+    if (statusCache.ledStatus == 1) status.flags |= ADV_FLAG_LED_ON;
+    if (statusCache.childLock == 1) status.flags |= ADV_FLAG_CHILD_LOCK;
+    status.faultCode = statusCache.safetyStatus;
+    
+    // Leave the advertisement alone if nothing advertised has changed
+    status.sequence = advertisedStatus.sequence;
+    if (advertisedStatus.companyId == ADV_COMPANY_ID && memcmp(&status, &advertisedStatus, sizeof(status)) == 0) {
+        return;
+    }
+    status.sequence++;
+    advertisedStatus = status;
+    
+    transport->setAdvertisingData((const uint8_t*)&status, sizeof(status));
+    
+    LOG_D("Advertised status updated (sequence %u)", status.sequence);
+}
+
+void BLEControl::markFieldDirty(uint8_t field) {
+    dirtyFields.fetch_or(1 << field);
 }
 
 void BLEControl::checkJSONUpdate() {
     unsigned long currentTime = millis();
+    uint16_t dirty = dirtyFields.load();
+    
+    // Notify each changed field, rate-limited per field
+    for (uint8_t field = 0; field < STATUS_FIELD_COUNT; field++) {
+        uint16_t fieldBit = 1 << field;
+        if (!(dirty & fieldBit) || currentTime - lastFieldNotify[field] < STATUS_NOTIFY_MIN_INTERVAL) {
+            continue;
+        }
+        
+        dirtyFields.fetch_and(~fieldBit);
+        lastFieldNotify[field] = currentTime;
+        if (StatusFieldCharacteristics[field] != CHAR_ID_NONE) {
+            notifyCharacteristic(StatusFieldCharacteristics[field]);
+        }
+        jsonUpdatePending = true;
+        binaryUpdatePending = true;
+        advertisingUpdatePending = true;
+    }
+    
+    // Advertised status follows changes at a lower rate
+    if (advertisingUpdatePending && currentTime - lastAdvertisingUpdate >= ADV_UPDATE_MIN_INTERVAL) {
+        updateAdvertisingData();
+        lastAdvertisingUpdate = currentTime;
+        advertisingUpdatePending = false;
+    }
+    
+    // Binary status is the fast path: sent right after a change, or as a heartbeat when idle
+    if ((binaryUpdatePending && currentTime - lastBinaryUpdate >= STATUS_NOTIFY_MIN_INTERVAL) ||
+        currentTime - lastBinaryUpdate >= STATUS_HEARTBEAT_INTERVAL) {
+        updateBinaryStatus();
+        lastBinaryUpdate = currentTime;
+        binaryUpdatePending = false;
+    }
     
-    // Update JSON status at regular intervals
-    if (currentTime - lastJSONUpdate >= JSON_UPDATE_INTERVAL) {
+    // JSON status is kept for compatibility at a lower rate
+    if ((jsonUpdatePending && currentTime - lastJSONUpdate >= STATUS_JSON_MIN_INTERVAL) ||
+        currentTime - lastJSONUpdate >= STATUS_HEARTBEAT_INTERVAL) {
         updateJSONStatus();
         lastJSONUpdate = currentTime;
+        jsonUpdatePending = false;
     }
 }
 
 void BLEControl::startAdvertising() {
-    if (pAdvertising) {
-        pAdvertising->start();
-        Serial.println("BLE advertising started");
+    if (transport) {
+        transport->startAdvertising();
+        LOG_I("BLE advertising started");
     }
 }
 
 void BLEControl::stopAdvertising() {
-    if (pAdvertising) {
-        pAdvertising->stop();
-        Serial.println("BLE advertising stopped");
+    if (transport) {
+        transport->stopAdvertising();
+        LOG_I("BLE advertising stopped");
     }
 }
 
-void BLEControl::handleClientConnect(uint16_t clientId) {
-    if (isClientConnected) {
-        // Already have a client connected - disconnect the new one
-        Serial.printf("BLE: New client attempted to connect, but client %d is already connected. Disconnecting new client.\n", connectedClientId);
-        pServer->disconnect(clientId);
+void BLEControl::onTransportConnect(uint16_t connId) {
+    int8_t slot = -1;
+    
+    portENTER_CRITICAL(&connectionLock);
+    for (uint8_t i = 0; i < BLE_MAX_CONNECTIONS; i++) {
+        if (!connections[i].active) {
+            slot = i;
+            break;
+        }
+    }
+    if (slot >= 0) {
+        memset(&connections[slot], 0, sizeof(BLEConnection));
+        connections[slot].active = true;
+        connections[slot].connId = connId;
+        connections[slot].mtu = BLE_DEFAULT_MTU;
+        connections[slot].rttMin = UINT32_MAX;
+        connections[slot].connectedAt = millis();
+        connectionCount++;
+    }
+    portEXIT_CRITICAL(&connectionLock);
+    
+    if (slot < 0) {
+        // All slots in use - disconnect the new client
+        LOG_W("BLE: Client %d rejected, %d clients already connected", connId, BLE_MAX_CONNECTIONS);
+        transport->disconnect(connId);
         return;
     }
     
-    // Accept the new connection
-    isClientConnected = true;
-    connectedClientId = clientId;
-    Serial.printf("BLE Client connected (ID: %d)\n", clientId);
+    LOG_I("BLE Client connected (ID: %d, %u/%u)", connId, connectionCount, BLE_MAX_CONNECTIONS);
     
-    // Send initial JSON status to new client
-    updateJSONStatus();
+    // Send JSON and binary status to the new client from the main loop
+    jsonUpdatePending = true;
+    binaryUpdatePending = true;
+    
+    // Have networks ready for the provisioning picker
+    wifiControlRef->requestScan();
+    scanPageRequest.store(0);
+    
+    // Start on the fast profile; checkConnectionParameters() requests it
+    noteActivity();
     
-    // Optional: Stop advertising to save resources (since we only want one connection)
-    // Uncomment the next line if you want to stop advertising when connected
-    // stopAdvertising();
+    // Advertising stops when a central connects; keep advertising while there is room
+    if (connectionCount < BLE_MAX_CONNECTIONS) {
+        startAdvertising();
+    }
 }
 
-void BLEControl::handleClientDisconnect() {
-    Serial.printf("BLE Client disconnected (ID: %d)\n", connectedClientId);
+void BLEControl::onTransportDisconnect(uint16_t connId) {
+    portENTER_CRITICAL(&connectionLock);
+    for (uint8_t i = 0; i < BLE_MAX_CONNECTIONS; i++) {
+        if (connections[i].active && connections[i].connId == connId) {
+            connections[i].active = false;
+            connectionCount--;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&connectionLock);
     
-    // Reset connection state
-    isClientConnected = false;
-    connectedClientId = 0;
+    LOG_I("BLE Client disconnected (ID: %d, %u/%u)", connId, connectionCount, BLE_MAX_CONNECTIONS);
     
     // Restart advertising to allow new connections
-    Serial.println("Restarting BLE advertising...");
     startAdvertising();
 }
 
-// All the existing characteristic handler methods remain the same
-void BLEControl::handleDoorStatusWrite(BLECharacteristic* characteristic) {
-    if (characteristic == pDoorStatus) {
-        std::string value = characteristic->getValue();
-        String doorStatus = String(value.c_str());
+void BLEControl::onTransportSubscribe(uint16_t connId, uint8_t characteristicId, uint16_t cccdValue) {
+    if (characteristicId >= CHAR_ID_COUNT) {
+        return;
+    }
+    
+    uint16_t subscriptionBit = 1 << characteristicId;
+    BLEConnection updated;
+    bool found = false;
+    bool becameReady = false;
+    
+    portENTER_CRITICAL(&connectionLock);
+    for (uint8_t i = 0; i < BLE_MAX_CONNECTIONS; i++) {
+        if (connections[i].active && connections[i].connId == connId) {
+            if (cccdValue & BLE_CCCD_NOTIFY) {
+                connections[i].subscriptions |= subscriptionBit;
+            } else {
+                connections[i].subscriptions &= ~subscriptionBit;
+            }
+            if (cccdValue & BLE_CCCD_INDICATE) {
+                connections[i].indications |= subscriptionBit;
+            } else {
+                connections[i].indications &= ~subscriptionBit;
+            }
+            becameReady = cccdValue != 0 && recordReady(connections[i]);
+            updated = connections[i];
+            found = true;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&connectionLock);
+    
+    LOG_D("BLE Client %d set CCCD 0x%04X on characteristic %u", connId, cccdValue, characteristicId);
+    if (!found) {
+        return;
+    }
+    
+    if (becameReady) {
+        LOG_I("BLE Client %u ready %u ms after connecting (%s)", connId, updated.readyTime, 
+              updated.returning ? "bonded" : "new");
+    }
+    
+    // Bonded centrals get their CCCDs back when they reconnect
+    if (updated.bonded) {
+        saveBondSubscriptions(updated.address, updated.subscriptions, updated.indications);
+    }
+}
+
+// A central is ready once it has enabled its first notification or
+// indication. Call with connectionLock held; returns true the first time.
+bool BLEControl::recordReady(BLEConnection& connection) {
+    if (connection.readyTime != 0) {
+        return false;
+    }
+    
+    connection.readyTime = millis() - connection.connectedAt;
+    if (connection.readyTime == 0) {
+        connection.readyTime = 1;
+    }
+    
+    BLEReadyStats& stats = readyStats[connection.returning ? READY_STATS_BONDED : READY_STATS_NEW];
+    stats.count++;
+    stats.last = connection.readyTime;
+    stats.total += connection.readyTime;
+    if (connection.readyTime > stats.max) {
+        stats.max = connection.readyTime;
+    }
+    return true;
+}
+
+// Pairing finished. A returning central gets its CCCDs restored, so it is
+// served straight away without rediscovering or resubscribing, and is told
+// if the GATT layout changed since it last connected.
+void BLEControl::onTransportAuthComplete(uint16_t connId, const uint8_t* address, uint8_t addressType, bool bonded) {
+    if (!bonded) {
+        LOG_W("BLE Client %u did not bond", connId);
+        return;
+    }
+    
+    BondEntry bond;
+    bool returning = getBond(address, bond);
+    
+    BondEntry evicted;
+    if (touchBond(address, addressType, gattLayoutHash, evicted)) {
+        transport->removeBond(evicted.address, evicted.addressType);
+        LOG_I("BLE bond limit (%u) reached, least recently used bond removed", BLE_MAX_BONDS);
+    }
+    
+    uint32_t readyTime = 0;
+    bool found = false;
+    uint16_t subscriptions = 0;
+    uint16_t indications = 0;
+    portENTER_CRITICAL(&connectionLock);
+    for (uint8_t i = 0; i < BLE_MAX_CONNECTIONS; i++) {
+        BLEConnection& connection = connections[i];
+        if (!connection.active || connection.connId != connId) {
+            continue;
+        }
         
-        if (doorStatus == "1") {
-            Serial.println("BLE Command: Open Pod");
-            *podOpenFlagRef = true;
-        } 
-        else if (doorStatus == "0") {
-            Serial.println("BLE Command: Close Pod");
-            *podOpenFlagRef = false;
+        found = true;
+        connection.bonded = true;
+        connection.returning = returning;
+        memcpy(connection.address, address, sizeof(connection.address));
+        if (returning) {
+            connection.subscriptions |= bond.subscriptions;
+            connection.indications |= bond.indications;
+            if ((connection.subscriptions | connection.indications) && recordReady(connection)) {
+                readyTime = connection.readyTime;
+            }
         }
-        else {
-            Serial.println("Invalid Door Status value received! Only 0 or 1 allowed.");
+        subscriptions = connection.subscriptions;
+        indications = connection.indications;
+        break;
+    }
+    portEXIT_CRITICAL(&connectionLock);
+    
+    // CCCDs written before pairing finished were not saved, since the
+    // connection was not bonded yet
+    if (found) {
+        saveBondSubscriptions(address, subscriptions, indications);
+    }
+    
+    LOG_I("BLE Client %u bonded (%s)", connId, returning ? "returning" : "new");
+    if (readyTime) {
+        LOG_I("BLE Client %u ready %u ms after connecting (bonded)", connId, readyTime);
+        binaryUpdatePending = true;
+    }
+    
+    if (returning && bond.layoutHash != gattLayoutHash) {
+        transport->indicateServiceChanged(connId);
+        LOG_I("BLE Client %u: GATT layout changed, Service Changed sent", connId);
+    }
+}
+
+void BLEControl::onTransportMtuChange(uint16_t connId, uint16_t mtu) {
+    portENTER_CRITICAL(&connectionLock);
+    for (uint8_t i = 0; i < BLE_MAX_CONNECTIONS; i++) {
+        if (connections[i].active && connections[i].connId == connId) {
+            connections[i].mtu = mtu;
+            break;
         }
     }
+    portEXIT_CRITICAL(&connectionLock);
+    
+    LOG_D("BLE Client %d MTU: %u", connId, mtu);
 }
 
-void BLEControl::handleLEDStatusWrite(BLECharacteristic* characteristic) {
-    if (characteristic == pLEDStatus) {
-        std::string value = characteristic->getValue();
-        String ledStatus = String(value.c_str());
+// The central confirmed an indication: one round trip sample
+void BLEControl::onTransportIndicationConfirm(uint16_t connId, uint8_t characteristicId) {
+    uint32_t now = micros();
+    
+    portENTER_CRITICAL(&connectionLock);
+    for (uint8_t i = 0; i < BLE_MAX_CONNECTIONS; i++) {
+        BLEConnection& connection = connections[i];
+        if (!connection.active || connection.connId != connId) {
+            continue;
+        }
         
-        if (ledStatus == "1") {
-            Serial.println("BLE Command: Turn LED ON");
-            setLEDState(LED_STATE_ON);
-        } 
-        else if (ledStatus == "0") {
-            Serial.println("BLE Command: Turn LED OFF");
-            setLEDState(LED_STATE_OFF);
+        // Notifications may also raise a confirm event; only pending indications count
+        if (connection.indicationPending && connection.indicationCharacteristic == characteristicId) {
+            uint32_t rtt = now - connection.indicationSentAt;
+            connection.indicationPending = false;
+            connection.rttLast = rtt;
+            connection.rttTotal += rtt;
+            connection.rttCount++;
+            if (rtt < connection.rttMin) connection.rttMin = rtt;
+            if (rtt > connection.rttMax) connection.rttMax = rtt;
         }
-        else {
-            Serial.println("Invalid LED Status value received! Only 0 or 1 allowed.");
+        break;
+    }
+    portEXIT_CRITICAL(&connectionLock);
+}
+
+void BLEControl::onTransportConnParams(uint16_t connId, uint16_t interval, uint16_t latency, uint16_t timeout) {
+    portENTER_CRITICAL(&connectionLock);
+    for (uint8_t i = 0; i < BLE_MAX_CONNECTIONS; i++) {
+        if (connections[i].active && connections[i].connId == connId) {
+            connections[i].interval = interval;
+            connections[i].latency = latency;
+            connections[i].timeout = timeout;
+            break;
         }
     }
+    portEXIT_CRITICAL(&connectionLock);
+    
+    // Interval is in 1.25 ms units
+    LOG_I("BLE connection parameters: interval %u.%02u ms, latency %u, timeout %u ms", 
+          interval * 5 / 4, (interval * 125) % 100, latency, timeout * 10);
 }
 
-void BLEControl::handleLEDBrightnessWrite(BLECharacteristic* characteristic) {
-    if (characteristic == pLEDBrightness) {
-        std::string value = characteristic->getValue();
+// True when the achieved parameters are within the profile's bounds
+static bool connectionHasProfile(const BLEConnection& connection, uint8_t profile) {
+    if (profile == CONN_PROFILE_FAST) {
+        return connection.interval >= CONN_FAST_MIN_INTERVAL && connection.interval <= CONN_FAST_MAX_INTERVAL &&
+               connection.latency <= CONN_FAST_LATENCY;
+    }
+    return connection.interval >= CONN_IDLE_MIN_INTERVAL && connection.interval <= CONN_IDLE_MAX_INTERVAL &&
+           connection.latency <= CONN_IDLE_LATENCY;
+}
+
+// Request the fast profile while commands or motion are recent, the idle
+// profile otherwise. A profile the stack refused, or that the central
+// rejected or overrode, is requested again every BLE_PARAM_RETRY_INTERVAL,
+// up to BLE_PARAM_MAX_RETRIES times.
+void BLEControl::checkConnectionParameters() {
+    if (connectionCount == 0) {
+        return;
+    }
+    
+    unsigned long currentTime = millis();
+    bool moving = statusCache.podState == POD_STATE_DOOR_MIDWAY || statusCache.podState == POD_STATE_TRAY_MIDWAY;
+    uint8_t profile = (moving || currentTime - lastActivity < BLE_IDLE_TIMEOUT) ? CONN_PROFILE_FAST : CONN_PROFILE_IDLE;
+    
+    uint16_t connIds[BLE_MAX_CONNECTIONS];
+    uint8_t requestCount = 0;
+    
+    portENTER_CRITICAL(&connectionLock);
+    for (uint8_t i = 0; i < BLE_MAX_CONNECTIONS; i++) {
+        BLEConnection& connection = connections[i];
+        if (!connection.active) {
+            continue;
+        }
+        if (connection.requestedProfile != CONN_PROFILE_NONE && 
+            currentTime - connection.lastParamRequest < BLE_PARAM_RETRY_INTERVAL) {
+            continue;
+        }
         
-        int brightness = 0;
-        try {
-            brightness = std::stoi(value);
-            
-            if (brightness >= 0 && brightness <= 100) {
-                Serial.print("BLE Command: Set LED Brightness to ");
-                Serial.print(brightness);
-                Serial.println("%");
-                
-                if (brightness == 0) {
-                    // Brightness 0 means turn LED off
-                    setLEDState(LED_STATE_OFF);
-                    setLEDBrightness(0);  // Store the brightness value
-                } else {
-                    // Brightness > 0 means turn LED on with that brightness
-                    setLEDState(LED_STATE_ON);
-                    setLEDBrightness(brightness);
-                }
-            } else {
-                Serial.print("Invalid brightness value received: ");
-                Serial.print(brightness);
-                Serial.println(". Value must be between 0-100!");
+        if (connection.requestedProfile == profile) {
+            if (connection.paramRetries >= BLE_PARAM_MAX_RETRIES ||
+                (!connection.paramRequestFailed && connectionHasProfile(connection, profile))) {
+                continue;
+            }
+            connection.paramRetries++;
+        } else {
+            connection.requestedProfile = profile;
+            connection.paramRetries = 0;
+        }
+        
+        connection.lastParamRequest = currentTime;
+        connIds[requestCount++] = connection.connId;
+    }
+    portEXIT_CRITICAL(&connectionLock);
+    
+    for (uint8_t i = 0; i < requestCount; i++) {
+        bool result = requestConnectionProfile(connIds[i], profile);
+        
+        portENTER_CRITICAL(&connectionLock);
+        for (uint8_t j = 0; j < BLE_MAX_CONNECTIONS; j++) {
+            if (connections[j].active && connections[j].connId == connIds[i]) {
+                connections[j].paramRequestFailed = !result;
+                break;
             }
-        } catch (...) {
-            Serial.println("Invalid LED Brightness value received! Must be a number between 0-100.");
         }
+        portEXIT_CRITICAL(&connectionLock);
     }
 }
 
-void BLEControl::handleDoorPositionWrite(BLECharacteristic* characteristic) {
-    if (characteristic == pDoorPosition) {
-        std::string value = characteristic->getValue();
-        
-        int position = 0;
-        try {
-            position = std::stoi(value);
-            
-            if (position == 50 || position == 100) {
-                Serial.print("BLE Command: Set Door Position to ");
-                Serial.println(position);
-                
-                setDoorPosition(position);
-                updateDoorPosition(position);
-            } else {
-                Serial.print("Invalid door position value received: ");
-                Serial.print(position);
-                Serial.println(". Value must be either 50 or 100!");
+void BLEControl::checkWiFiScan() {
+    uint8_t page = scanPageRequest.exchange(WIFI_SCAN_NO_REQUEST);
+    
+    // New results start again from the first page
+    if (wifiControlRef->getScanResultsVersion() != scanResultsVersion) {
+        scanResultsVersion = wifiControlRef->getScanResultsVersion();
+        page = 0;
+    }
+    
+    if (page != WIFI_SCAN_NO_REQUEST && transport) {
+        updateWiFiScanPage(page);
+    }
+}
+
+void BLEControl::updateWiFiScanPage(uint8_t page) {
+    // Pages fit a notification to every connected client
+    uint16_t pageSize = BLE_PREFERRED_MTU - 3;
+    portENTER_CRITICAL(&connectionLock);
+    for (uint8_t i = 0; i < BLE_MAX_CONNECTIONS; i++) {
+        if (connections[i].active && connections[i].mtu - 3 < pageSize) {
+            pageSize = connections[i].mtu - 3;
+        }
+    }
+    portEXIT_CRITICAL(&connectionLock);
+    if (pageSize < WIFI_SCAN_PAGE_MIN_SIZE) {
+        pageSize = WIFI_SCAN_PAGE_MIN_SIZE;
+    }
+    
+    // Split the results into pages, filling each as far as it goes
+    uint8_t count = wifiControlRef->getScanResultCount();
+    uint8_t pageCount = count > 0 ? 1 : 0;
+    uint8_t pageFirst = 0;
+    uint8_t pageEnd = 0;
+    uint16_t used = WIFI_SCAN_PAGE_HEADER_SIZE;
+    for (uint8_t i = 0; i < count; i++) {
+        uint16_t entrySize = WIFI_SCAN_ENTRY_HEADER_SIZE + strlen(wifiControlRef->getScanResult(i).ssid);
+        if (used + entrySize > pageSize) {
+            if (pageCount - 1 == page) {
+                pageEnd = i;
+            }
+            pageCount++;
+            used = WIFI_SCAN_PAGE_HEADER_SIZE;
+            if (pageCount - 1 == page) {
+                pageFirst = i;
+            }
+        }
+        used += entrySize;
+    }
+    if (pageCount - 1 == page) {
+        pageEnd = count;
+    }
+    if (page >= pageCount) {
+        pageFirst = pageEnd = 0;
+    }
+    
+    uint8_t buffer[BLE_PREFERRED_MTU];
+    buffer[0] = page;
+    buffer[1] = pageCount;
+    buffer[2] = count;
+    size_t length = WIFI_SCAN_PAGE_HEADER_SIZE;
+    for (uint8_t i = pageFirst; i < pageEnd; i++) {
+        const WiFiScanResult& result = wifiControlRef->getScanResult(i);
+        uint8_t ssidLength = strlen(result.ssid);
+        buffer[length++] = (uint8_t)result.rssi;
+        buffer[length++] = result.channel;
+        buffer[length++] = result.flags;
+        buffer[length++] = ssidLength;
+        memcpy(buffer + length, result.ssid, ssidLength);
+        length += ssidLength;
+    }
+    
+    transport->setValue(CHAR_ID_WIFI_SCAN, buffer, length);
+    notifyCharacteristic(CHAR_ID_WIFI_SCAN);
+    
+    LOG_D("BLE WiFi scan page %u/%u: %u networks", page + 1, pageCount, pageEnd - pageFirst);
+}
+
+bool BLEControl::requestConnectionProfile(uint16_t connId, uint8_t profile) {
+    bool result;
+    if (profile == CONN_PROFILE_FAST) {
+        result = transport->updateConnParams(connId, CONN_FAST_MIN_INTERVAL, CONN_FAST_MAX_INTERVAL, 
+                                             CONN_FAST_LATENCY, CONN_FAST_TIMEOUT);
+    } else {
+        result = transport->updateConnParams(connId, CONN_IDLE_MIN_INTERVAL, CONN_IDLE_MAX_INTERVAL, 
+                                             CONN_IDLE_LATENCY, CONN_IDLE_TIMEOUT);
+    }
+    
+    LOG_D("BLE requested %s connection profile (%d)", profile == CONN_PROFILE_FAST ? "fast" : "idle", result);
+    return result;
+}
+
+bool BLEControl::getConnection(uint16_t connId, BLEConnection& connection) {
+    bool found = false;
+    
+    portENTER_CRITICAL(&connectionLock);
+    for (uint8_t i = 0; i < BLE_MAX_CONNECTIONS; i++) {
+        if (connections[i].active && connections[i].connId == connId) {
+            connection = connections[i];
+            found = true;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&connectionLock);
+    
+    return found;
+}
+
+void BLEControl::printConnectionInfo() {
+    BLEConnection snapshot[BLE_MAX_CONNECTIONS];
+    
+    portENTER_CRITICAL(&connectionLock);
+    memcpy(snapshot, connections, sizeof(snapshot));
+    portEXIT_CRITICAL(&connectionLock);
+    
+    if (transport) {
+        LOG_I("BLE backend %s: heap %u bytes (internal %u), setup %u ms, image %u bytes", transport->getName(), 
+              footprint.heapUsed, footprint.internalUsed, footprint.setupTime, footprint.imageSize);
+    }
+    LOG_I("BLE connections: %u/%u, bonds: %u/%u", connectionCount, BLE_MAX_CONNECTIONS, getBondCount(), BLE_MAX_BONDS);
+    const char* readyNames[2] = { "new", "bonded" };
+    for (uint8_t i = 0; i < 2; i++) {
+        const BLEReadyStats& stats = readyStats[i];
+        if (stats.count > 0) {
+            LOG_I("  Ready after connect, %s (ms): last %u, avg %u, max %u, n=%u", readyNames[i], stats.last, 
+                  (uint32_t)(stats.total / stats.count), stats.max, stats.count);
+        }
+    }
+    for (uint8_t i = 0; i < BLE_MAX_CONNECTIONS; i++) {
+        if (snapshot[i].active) {
+            const BLEConnection& connection = snapshot[i];
+            LOG_I("  ID %u: MTU %u, subscriptions 0x%03X, notified %u, failed %u", connection.connId, 
+                  connection.mtu, connection.subscriptions, connection.notifications, connection.notifyFailures);
+            LOG_I("    %s, ready after %u ms, first notification after %u ms", 
+                  connection.returning ? "returning bond" : (connection.bonded ? "new bond" : "not bonded"), 
+                  connection.readyTime, connection.firstNotifyTime);
+            LOG_I("    profile %s, interval %u us, latency %u, timeout %u ms", 
+                  connection.requestedProfile == CONN_PROFILE_FAST ? "fast" : "idle", 
+                  connection.interval * 1250, connection.latency, connection.timeout * 10);
+            if (connection.rttCount > 0) {
+                LOG_I("    RTT (us): last %u, min %u, avg %u, max %u, n=%u", connection.rttLast, connection.rttMin,
+                      (uint32_t)(connection.rttTotal / connection.rttCount), connection.rttMax, connection.rttCount);
             }
-        } catch (...) {
-            Serial.println("Invalid Door Position value received! Must be either 50 or 100.");
         }
     }
 }
 
-void BLEControl::handleLEDColorWrite(BLECharacteristic* characteristic) {
-    if (characteristic == pLEDColor) {
-        std::string value = characteristic->getValue();
-        String ledColor = String(value.c_str());
+// Characteristic write handlers run in the BLE stack task: they only validate
+// the value and queue a command, which the control loop applies on its next tick
+bool BLEControl::queueCommand(uint8_t type, uint8_t value, uint8_t traceTarget) {
+    noteActivity();
+    
+    PodCommand command = {};
+    command.type = type;
+    command.source = TRACE_SOURCE_BLE;
+    command.value = value;
+    if (traceTarget < TRACE_TARGET_COUNT) {
+        command.traceId = traceCommandReceived(TRACE_SOURCE_BLE, traceTarget);
+    }
+    
+    if (!commandQueueRef->push(command)) {
+        LOG_W("BLE command queue full, command %u dropped", type);
+        traceCommandDiscarded(command.traceId);
+        return false;
+    }
+    return true;
+}
+
+void BLEControl::handleDoorStatusWrite(const std::string& value) {
+    if (value == "1") {
+        LOG_I("BLE Command: Open Pod");
+        queueCommand(CMD_SET_POD_OPEN, 1, TRACE_TARGET_DOOR);
+    } 
+    else if (value == "0") {
+        LOG_I("BLE Command: Close Pod");
+        queueCommand(CMD_SET_POD_OPEN, 0, TRACE_TARGET_DOOR);
+    }
+    else {
+        LOG_W("Invalid Door Status value received! Only 0 or 1 allowed.");
+    }
+}
+
+void BLEControl::handleLEDStatusWrite(const std::string& value) {
+    if (value == "1") {
+        LOG_I("BLE Command: Turn LED ON");
+        queueCommand(CMD_SET_LED_STATE, LED_STATE_ON, TRACE_TARGET_LED);
+    } 
+    else if (value == "0") {
+        LOG_I("BLE Command: Turn LED OFF");
+        queueCommand(CMD_SET_LED_STATE, LED_STATE_OFF, TRACE_TARGET_LED);
+    }
+    else {
+        LOG_W("Invalid LED Status value received! Only 0 or 1 allowed.");
+    }
+}
+
+void BLEControl::handleLEDBrightnessWrite(const std::string& value) {
+    int brightness = 0;
+    try {
+        brightness = std::stoi(value);
         
-        Serial.print("BLE Command: Set LED Color to ");
-        Serial.println(ledColor);
+        if (brightness >= 0 && brightness <= 100) {
+            LOG_D("BLE Command: Set LED Brightness to %d%%", brightness);
+            queueCommand(CMD_SET_LED_BRIGHTNESS, brightness, TRACE_TARGET_LED);
+        } else {
+            LOG_W("Invalid brightness value received: %d. Value must be between 0-100!", brightness);
+        }
+    } catch (...) {
+        LOG_W("Invalid LED Brightness value received! Must be a number between 0-100.");
+    }
+}
+
+void BLEControl::handleDoorPositionWrite(const std::string& value) {
+    int position = 0;
+    try {
+        position = std::stoi(value);
         
-        setLEDColor(ledColor);
+        if (position == 50 || position == 100) {
+            LOG_I("BLE Command: Set Door Position to %d", position);
+            queueCommand(CMD_SET_DOOR_POSITION, position, TRACE_TARGET_NONE);
+        } else {
+            LOG_W("Invalid door position value received: %d. Value must be either 50 or 100!", position);
+        }
+    } catch (...) {
+        LOG_W("Invalid Door Position value received! Must be either 50 or 100.");
+    }
+}
+
+void BLEControl::handleLEDColorWrite(const std::string& value) {
+    PodCommand command = {};
+    if (!parseLEDColor(value.c_str(), command.color)) {
+        return;
     }
+    
+    LOG_D("BLE Command: Set LED Color to %s", command.color);
+    command.type = CMD_SET_LED_COLOR;
+    command.source = TRACE_SOURCE_BLE;
+    command.traceId = traceCommandReceived(TRACE_SOURCE_BLE, TRACE_TARGET_LED);
+    noteActivity();
+    
+    if (!commandQueueRef->push(command)) {
+        LOG_W("BLE command queue full, command %u dropped", command.type);
+        traceCommandDiscarded(command.traceId);
+    }
+}
+
+void BLEControl::handleWiFiCredentialsWrite(const std::string& value) {
+    onNetworkReceived(value);
 }
 
-void BLEControl::handleWiFiCredentialsWrite(BLECharacteristic* characteristic) {
-    if (characteristic == pWiFiCredentials) {
-        std::string value = characteristic->getValue();
-        onNetworkReceived(value);
+void BLEControl::handleChildLockWrite(const std::string& value) {
+    if (value == "1") {
+        LOG_I("BLE Command: Enable Child Lock");
+        queueCommand(CMD_SET_CHILD_LOCK, 1, TRACE_TARGET_NONE);
+    } 
+    else if (value == "0") {
+        LOG_I("BLE Command: Disable Child Lock");
+        queueCommand(CMD_SET_CHILD_LOCK, 0, TRACE_TARGET_NONE);
+    }
+    else {
+        LOG_W("Invalid Child Lock value received! Only 0 or 1 allowed.");
     }
 }
 
-void BLEControl::handleChildLockWrite(BLECharacteristic* characteristic) {
-    if (characteristic == pChildLock) {
-        std::string value = characteristic->getValue();
-        String childLockStatus = String(value.c_str());
+// Validate a whole command frame and queue its operations as one batch, so the
+// control loop applies them in the same tick. A frame with any invalid
+// operation is rejected as a whole.
+void BLEControl::handleCommandFrameWrite(const std::string& value) {
+    const uint8_t* data = (const uint8_t*)value.data();
+    size_t length = value.length();
+    
+    if (length < COMMAND_FRAME_HEADER_SIZE || data[0] != COMMAND_FRAME_VERSION) {
+        LOG_W("Invalid command frame header (%u bytes)", length);
+        return;
+    }
+    uint16_t sequence = data[1] | (data[2] << 8);
+    
+    // Room for the acknowledgement after the operations
+    PodCommand commands[COMMAND_FRAME_MAX_OPS + 1];
+    uint8_t count = 0;
+    size_t offset = COMMAND_FRAME_HEADER_SIZE;
+    
+    while (offset < length) {
+        if (length - offset < 2 || count >= COMMAND_FRAME_MAX_OPS) {
+            LOG_W("Malformed command frame %u", sequence);
+            return;
+        }
+        
+        uint8_t type = data[offset];
+        uint8_t opLength = data[offset + 1];
+        if (length - offset - 2 < opLength) {
+            LOG_W("Truncated operation in command frame %u", sequence);
+            return;
+        }
         
-        if (childLockStatus == "1") {
-            Serial.println("BLE Command: Enable Child Lock");
-            *childLockRef = true;
-        } 
-        else if (childLockStatus == "0") {
-            Serial.println("BLE Command: Disable Child Lock");
-            *childLockRef = false;
+        if (!parseFrameOperation(type, data + offset + 2, opLength, commands[count])) {
+            LOG_W("Invalid operation %u in command frame %u", type, sequence);
+            return;
         }
-        else {
-            Serial.println("Invalid Child Lock value received! Only 0 or 1 allowed.");
+        
+        count++;
+        offset += 2 + opLength;
+    }
+    
+    // One trace per target, matching the single-command handlers. The last
+    // command of each type is the one the control loop keeps when coalescing.
+    bool doorTraced = false;
+    bool ledTraced = false;
+    for (int8_t i = count - 1; i >= 0; i--) {
+        uint8_t type = commands[i].type;
+        if (type == CMD_SET_POD_OPEN && !doorTraced) {
+            commands[i].traceId = traceCommandReceived(TRACE_SOURCE_BLE, TRACE_TARGET_DOOR);
+            doorTraced = true;
+        } else if ((type == CMD_SET_LED_STATE || type == CMD_SET_LED_BRIGHTNESS || type == CMD_SET_LED_COLOR) && 
+                   !ledTraced) {
+            commands[i].traceId = traceCommandReceived(TRACE_SOURCE_BLE, TRACE_TARGET_LED);
+            ledTraced = true;
         }
     }
+    
+    // Acknowledge the frame in the binary status once its commands are applied
+    PodCommand& ack = commands[count++];
+    ack = PodCommand();
+    ack.type = CMD_FRAME_ACK;
+    ack.source = TRACE_SOURCE_BLE;
+    ack.sequence = sequence;
+    
+    noteActivity();
+    if (!commandQueueRef->pushBatch(commands, count)) {
+        LOG_W("BLE command queue full, command frame %u dropped", sequence);
+        for (uint8_t i = 0; i < count; i++) {
+            traceCommandDiscarded(commands[i].traceId);
+        }
+        return;
+    }
+    
+    LOG_D("BLE Command frame %u: %u operations", sequence, count - 1);
+}
+
+// Runs in the BLE task: the page is built by checkWiFiScan() in the main loop
+void BLEControl::handleWiFiScanWrite(const std::string& value) {
+    if (value.length() != 1) {
+        LOG_W("Invalid WiFi scan request (%u bytes)", value.length());
+        return;
+    }
+    
+    uint8_t page = value[0];
+    if (page == WIFI_SCAN_RESCAN) {
+        LOG_D("BLE WiFi rescan requested");
+        wifiControlRef->requestScan();
+        return;
+    }
+    scanPageRequest.store(page);
+}
+
+bool BLEControl::parseFrameOperation(uint8_t type, const uint8_t* value, uint8_t length, PodCommand& command) {
+    command = PodCommand();
+    command.type = type;
+    command.source = TRACE_SOURCE_BLE;
+    
+    switch (type) {
+        case CMD_SET_POD_OPEN:
+        case CMD_SET_CHILD_LOCK:
+            if (length != 1 || value[0] > 1) return false;
+            command.value = value[0];
+            return true;
+            
+        case CMD_SET_LED_STATE:
+            if (length != 1 || value[0] > 1) return false;
+            command.value = value[0] ? LED_STATE_ON : LED_STATE_OFF;
+            return true;
+            
+        case CMD_SET_DOOR_POSITION:
+            if (length != 1 || (value[0] != 50 && value[0] != 100)) return false;
+            command.value = value[0];
+            return true;
+            
+        case CMD_SET_LED_BRIGHTNESS:
+            if (length != 1 || value[0] > MAX_BRIGHTNESS) return false;
+            command.value = value[0];
+            return true;
+            
+        case CMD_SET_LED_COLOR:
+            // Raw R, G, B bytes
+            if (length != 3) return false;
+            snprintf(command.color, sizeof(command.color), "%02X%02X%02X", value[0], value[1], value[2]);
+            return true;
+            
+        default:
+            return false;
+    }
 }
 
 void BLEControl::onNetworkReceived(const std::string& value) {
@@ -456,53 +1181,60 @@ void BLEControl::onNetworkReceived(const std::string& value) {
         
         networkBuffer = ssid;
         passwordBuffer = password;
-        Serial.printf("Received Network SSID: %s\n", ssid.c_str());
-        Serial.printf("Received Password: %s\n", password.c_str());
+        LOG_I("Received Network SSID: %s", ssid);
+        LOG_D("Received Password: %s", password);
+        
+        // Optional priority among known networks: <0-9>ENDPRIORITY
+        uint8_t priority = WIFI_DEFAULT_PRIORITY;
+        int priorityIndex = data.indexOf("ENDPRIORITY", passwordIndex);
+        if (priorityIndex != -1) {
+            long value = data.substring(passwordIndex + 11, priorityIndex).toInt();
+            if (value >= 0 && value <= WIFI_MAX_PRIORITY) {
+                priority = value;
+            }
+        }
         
-        finalizeNetwork();
+        finalizeNetwork(priority);
     } else {
-        Serial.println("Invalid format, missing ENDNETWORK or ENDPASSWORD.");
+        LOG_W("Invalid format, missing ENDNETWORK or ENDPASSWORD.");
     }
 }
 
-void BLEControl::finalizeNetwork() {
-    if (networkBuffer.length() > 0 && passwordBuffer.length() > 0) {
-        Serial.println("Attempting to connect to WiFi with new credentials...");
-        
-        bool connected = wifiControlRef->updateWiFiCredentials(networkBuffer, passwordBuffer);
+// Runs in the BLE task: hand the credentials to the WiFi manager and return.
+// Progress reaches the WiFi status characteristic from the main loop.
+void BLEControl::finalizeNetwork(uint8_t priority) {
+    // An empty password joins an open network
+    if (networkBuffer.length() > 0) {
+        LOG_I("Queueing new WiFi credentials...");
         
-        String status;
-        if (connected) {
-            status = "CONNECTED:" + networkBuffer + ":" + wifiControlRef->getLocalIP().toString();
-            Serial.println("WiFi connection successful!");
-        } else {
-            status = "FAILED:" + networkBuffer;
-            Serial.println("WiFi connection failed!");
+        if (!wifiControlRef->updateWiFiCredentials(networkBuffer, passwordBuffer, priority)) {
+            LOG_W("WiFi credentials rejected!");
         }
         
-        updateWiFiStatus(status);
-        
         networkBuffer = "";
         passwordBuffer = "";
     }
 }
 
-// All the update methods remain the same
 void BLEControl::updateDoorStatus(bool isOpen) {
-    if (pDoorStatus) {
-        String status = isOpen ? "1" : "0";
-        pDoorStatus->setValue(status.c_str());
-        Serial.print("BLE Door Status updated: ");
-        Serial.println(status);
+    uint8_t status = isOpen ? 1 : 0;
+    
+    if (transport && statusCache.doorStatus != status) {
+        statusCache.doorStatus = status;
+        transport->setValue(CHAR_ID_DOOR_STATUS, isOpen ? "1" : "0");
+        markFieldDirty(STATUS_FIELD_DOOR_STATUS);
+        LOG_D("BLE Door Status updated: %u", status);
     }
 }
 
 void BLEControl::updateLEDStatus(uint8_t ledState) {
-    if (pLEDStatus) {
-        String status = (ledState == LED_STATE_ON) ? "1" : "0";
-        pLEDStatus->setValue(status.c_str());
-        Serial.print("BLE LED Status updated: ");
-        Serial.println(status);
+    uint8_t status = (ledState == LED_STATE_ON) ? 1 : 0;
+    
+    if (transport && statusCache.ledStatus != status) {
+        statusCache.ledStatus = status;
+        transport->setValue(CHAR_ID_LIGHTS, status ? "1" : "0");
+        markFieldDirty(STATUS_FIELD_LED_STATUS);
+        LOG_D("BLE LED Status updated: %u", status);
     }
 }
 
@@ -511,12 +1243,12 @@ void BLEControl::updateLEDBrightness(uint8_t brightness) {
         brightness = MAX_BRIGHTNESS;
     }
     
-    if (pLEDBrightness) {
+    if (transport && statusCache.ledBrightness != brightness) {
+        statusCache.ledBrightness = brightness;
         String value = String(brightness);
-        pLEDBrightness->setValue(value.c_str());
-        Serial.print("BLE LED Brightness updated: ");
-        Serial.print(brightness);
-        Serial.println(" (0-100 scale)");
+        transport->setValue(CHAR_ID_LIGHTS_BRIGHTNESS, value.c_str());
+        markFieldDirty(STATUS_FIELD_LED_BRIGHTNESS);
+        LOG_D("BLE LED Brightness updated: %u (0-100 scale)", brightness);
     }
 }
 
@@ -525,35 +1257,66 @@ void BLEControl::updateDoorPosition(uint8_t position) {
         position = 100;
     }
     
-    if (pDoorPosition) {
+    if (transport && statusCache.doorPosition != position) {
+        statusCache.doorPosition = position;
         String value = String(position);
-        pDoorPosition->setValue(value.c_str());
-        Serial.print("BLE Door Position updated: ");
-        Serial.println(position);
+        transport->setValue(CHAR_ID_DOOR_POSITION, value.c_str());
+        markFieldDirty(STATUS_FIELD_DOOR_POSITION);
+        LOG_D("BLE Door Position updated: %u", position);
     }
 }
 
 void BLEControl::updateLEDColor(String color) {
-    if (pLEDColor) {
-        pLEDColor->setValue(color.c_str());
-        Serial.print("BLE LED Color updated: ");
-        Serial.println(color);
+    if (transport && strncmp(statusCache.ledColor, color.c_str(), sizeof(statusCache.ledColor) - 1) != 0) {
+        strncpy(statusCache.ledColor, color.c_str(), sizeof(statusCache.ledColor) - 1);
+        statusCache.ledColor[sizeof(statusCache.ledColor) - 1] = '\0';
+        transport->setValue(CHAR_ID_LIGHTS_COLOR, statusCache.ledColor);
+        markFieldDirty(STATUS_FIELD_LED_COLOR);
+        LOG_D("BLE LED Color updated: %s", statusCache.ledColor);
     }
 }
 
 void BLEControl::updateWiFiStatus(const String& status) {
-    if (pWiFiStatus) {
-        pWiFiStatus->setValue(status.c_str());
-        Serial.print("BLE WiFi Status updated: ");
-        Serial.println(status);
+    if (transport && statusCache.wifiStatus != status) {
+        statusCache.wifiStatus = status;
+        statusCache.wifiState = wifiControlRef->getWiFiStatus();
+        transport->setValue(CHAR_ID_WIFI_STATUS, status.c_str());
+        markFieldDirty(STATUS_FIELD_WIFI_STATUS);
+        LOG_D("BLE WiFi Status updated: %s", status);
     }
 }
 
 void BLEControl::updateChildLock(bool childLockOn) {
-    if (pChildLock) {
-        String status = childLockOn ? "1" : "0";
-        pChildLock->setValue(status.c_str());
-        Serial.print("BLE Child Lock updated: ");
-        Serial.println(childLockOn ? "ENABLED" : "DISABLED");
+    uint8_t status = childLockOn ? 1 : 0;
+    
+    if (transport && statusCache.childLock != status) {
+        statusCache.childLock = status;
+        transport->setValue(CHAR_ID_CHILD_LOCK, childLockOn ? "1" : "0");
+        markFieldDirty(STATUS_FIELD_CHILD_LOCK);
+        LOG_D("BLE Child Lock updated: %s", childLockOn ? "ENABLED" : "DISABLED");
+    }
+}
+
+// Pod state and safety status are only published through the binary status
+void BLEControl::updatePodState(uint8_t podState, bool podTarget) {
+    uint8_t target = podTarget ? 1 : 0;
+    
+    if (statusCache.podState != podState || statusCache.podTarget != target) {
+        statusCache.podState = podState;
+        statusCache.podTarget = target;
+        markFieldDirty(STATUS_FIELD_POD_STATE);
     }
-}
\ No newline at end of file
+}
+
+void BLEControl::updateSafetyStatus(uint8_t safetyStatus) {
+    if (statusCache.safetyStatus != safetyStatus) {
+        statusCache.safetyStatus = safetyStatus;
+        markFieldDirty(STATUS_FIELD_SAFETY);
+    }
+}
+
+// Always publish the acknowledgement, even if a client re-sent the same sequence
+void BLEControl::updateFrameAck(uint16_t sequence) {
+    statusCache.frameAck = sequence;
+    markFieldDirty(STATUS_FIELD_FRAME_ACK);
+}
@@ -2,13 +2,12 @@
 #define BLECONTROL_H
 
 #include <Arduino.h>
-#include <BLEDevice.h>
-#include <BLEServer.h>
-#include <BLECharacteristic.h>
-#include <BLEService.h>
-#include <BLEAdvertising.h>
 #include <ArduinoJson.h>  // Add this for JSON support
+#include <atomic>
 #include "WiFiControl.h"
+#include "CommandQueue.h"
+#include "BleTransport.h"
+#include "BleBondStore.h"
 
 // Define Service and Characteristic UUIDs
 #define UUID_SERVICE           "7d840001-11eb-4c13-89f2-246b6e0b0000"
@@ -21,60 +20,231 @@
 #define UUID_WIFI_STATUS       "7d840008-11eb-4c13-89f2-246b6e0b0007"
 #define UUID_CHILD_LOCK        "7d840006-11eb-4c13-89f2-246b6e0b0008"
 #define UUID_JSON_STATUS       "7d840009-11eb-4c13-89f2-246b6e0b0009"  // New JSON status characteristic
+#define UUID_BINARY_STATUS     "7d84000a-11eb-4c13-89f2-246b6e0b000a"  // Packed BinaryStatus
+#define UUID_COMMAND_FRAME     "7d84000b-11eb-4c13-89f2-246b6e0b000b"  // Batched TLV commands
+#define UUID_WIFI_SCAN         "7d84000c-11eb-4c13-89f2-246b6e0b000c"  // Paged WiFi scan results
+
+// Characteristic IDs, assigned at creation and used to dispatch GATT callbacks
+#define CHAR_ID_DOOR_STATUS 0
+#define CHAR_ID_DOOR_POSITION 1
+#define CHAR_ID_LIGHTS 2
+#define CHAR_ID_LIGHTS_BRIGHTNESS 3
+#define CHAR_ID_LIGHTS_COLOR 4
+#define CHAR_ID_WIFI_CREDENTIALS 5
+#define CHAR_ID_WIFI_STATUS 6
+#define CHAR_ID_CHILD_LOCK 7
+#define CHAR_ID_JSON_STATUS 8
+#define CHAR_ID_BINARY_STATUS 9
+#define CHAR_ID_COMMAND_FRAME 10
+#define CHAR_ID_WIFI_SCAN 11
+#define CHAR_ID_COUNT 12
+#define CHAR_ID_NONE 0xFF
+static_assert(CHAR_ID_COUNT <= BLE_TRANSPORT_MAX_CHARACTERISTICS, "Too many characteristics for the transport");
+
+// Connection limits (BLE_MAX_CONNECTIONS must not exceed CONFIG_BT_ACL_CONNECTIONS)
+#define BLE_MAX_CONNECTIONS 3             // Simultaneous centrals (phones)
+#define BLE_DEFAULT_MTU 23                // ATT MTU until the central negotiates a larger one
+#define BLE_PREFERRED_MTU 185             // Largest MTU accepted when the central requests an exchange
+#define BLE_DEVICE_NAME "Sole Pod"
+#ifndef BLE_BONDING_ENABLED
+#define BLE_BONDING_ENABLED 1             // Ask centrals to bond so they can cache the GATT database
+#endif
+static_assert(BLE_MAX_CONNECTIONS <= BLE_TRANSPORT_MAX_CONNECTIONS, "Too many connections for the transport");
+
+// Connection parameter profiles (intervals in 1.25 ms units, timeouts in 10 ms units)
+#define CONN_PROFILE_NONE 0
+#define CONN_PROFILE_FAST 1               // While commanding or moving
+#define CONN_PROFILE_IDLE 2               // After BLE_IDLE_TIMEOUT without activity
+#define CONN_FAST_MIN_INTERVAL 6          // 7.5 ms
+#define CONN_FAST_MAX_INTERVAL 12         // 15 ms
+#define CONN_FAST_LATENCY 0
+#define CONN_FAST_TIMEOUT 400             // 4 s
+#define CONN_IDLE_MIN_INTERVAL 80         // 100 ms
+#define CONN_IDLE_MAX_INTERVAL 120        // 150 ms
+#define CONN_IDLE_LATENCY 4               // Peripheral may skip 4 connection events
+#define CONN_IDLE_TIMEOUT 600             // 6 s
+#define BLE_IDLE_TIMEOUT 5000             // Switch to the idle profile after this long without activity (ms)
+#define BLE_PARAM_RETRY_INTERVAL 2000     // Minimum time between parameter requests per connection (ms)
+#define BLE_PARAM_MAX_RETRIES 3           // Re-requests of one profile the central rejected or overrode
 
 // Valid ranges for BLE characteristics
 #define MIN_BRIGHTNESS 0
 #define MAX_BRIGHTNESS 100
 
-// JSON update interval (milliseconds)
-#define JSON_UPDATE_INTERVAL 1000  // Update every 1 second
+// Status notification timing (milliseconds)
+#define STATUS_NOTIFY_MIN_INTERVAL 50     // Minimum time between notifications of one field
+#define STATUS_JSON_MIN_INTERVAL 1000     // Minimum time between JSON status notifications
+#define STATUS_HEARTBEAT_INTERVAL 10000   // Status is re-sent this often when nothing changes
 
-// Forward declarations
-class BLEControl;
+// Status fields, each backed by its own characteristic
+#define STATUS_FIELD_DOOR_STATUS 0
+#define STATUS_FIELD_DOOR_POSITION 1
+#define STATUS_FIELD_LED_STATUS 2
+#define STATUS_FIELD_LED_BRIGHTNESS 3
+#define STATUS_FIELD_LED_COLOR 4
+#define STATUS_FIELD_WIFI_STATUS 5
+#define STATUS_FIELD_CHILD_LOCK 6
+#define STATUS_FIELD_POD_STATE 7          // Binary status only (no characteristic)
+#define STATUS_FIELD_SAFETY 8             // Binary status only (no characteristic)
+#define STATUS_FIELD_FRAME_ACK 9          // Binary status only (no characteristic)
+#define STATUS_FIELD_COUNT 10
 
-// BLE Server callback class to handle connections
-class BLEServerCallback : public BLEServerCallbacks {
-private:
-    BLEControl* bleControl;
+// Command frame: [version][sequence u16 LE] followed by TLV operations
+// [type][length][value...], where type is a CMD_* command type
+#define COMMAND_FRAME_VERSION 1
+#define COMMAND_FRAME_HEADER_SIZE 3
+#define COMMAND_FRAME_MAX_OPS 8
 
-public:
-    BLEServerCallback(BLEControl* control) : bleControl(control) {}
-    
-    void onConnect(BLEServer* pServer) override;
-    void onDisconnect(BLEServer* pServer) override;
+// WiFi scan page: [page][page count][network count] followed by entries
+// [rssi][channel][flags][ssid length][ssid...], strongest first. Pages are
+// sized to the smallest MTU of the connected clients. Writing a page number
+// selects that page; writing WIFI_SCAN_RESCAN asks for a new scan.
+#define WIFI_SCAN_PAGE_HEADER_SIZE 3
+#define WIFI_SCAN_ENTRY_HEADER_SIZE 4
+#define WIFI_SCAN_PAGE_MIN_SIZE (WIFI_SCAN_PAGE_HEADER_SIZE + WIFI_SCAN_ENTRY_HEADER_SIZE + 32)  // One entry always fits; read it in full below MTU 42
+#define WIFI_SCAN_RESCAN 0xFF
+#define WIFI_SCAN_NO_REQUEST 0xFE
+
+// Binary status layout version, bumped whenever BinaryStatus changes
+#define BINARY_STATUS_VERSION 2
+
+// Packed little-endian status notified on UUID_BINARY_STATUS. Fits in a single
+// notification at the default ATT MTU (20 byte payload).
+struct __attribute__((packed)) BinaryStatus {
+    uint8_t version;           // BINARY_STATUS_VERSION
+    uint16_t sequence;         // Incremented on every notification
+    uint8_t podState;          // POD_STATE_*
+    uint8_t podTarget;         // 1 = opening/open, 0 = closing/closed
+    uint8_t doorPosition;      // 50 or 100
+    uint8_t ledStatus;         // 1 = on, 0 = off
+    uint8_t ledBrightness;     // 0-100
+    uint8_t ledRed;
+    uint8_t ledGreen;
+    uint8_t ledBlue;
+    uint8_t childLock;         // 1 = locked, 0 = unlocked
+    uint8_t wifiState;         // wl_status_t
+    uint8_t safetyStatus;      // SAFETY_STATUS_*
+    uint16_t frameAck;         // Sequence of the last applied command frame (v2)
 };
+static_assert(sizeof(BinaryStatus) <= 20, "BinaryStatus must fit in one 20-byte notification");
 
-// Generic callback class for BLE characteristics
-class BLECharacteristicCallback : public BLECharacteristicCallbacks {
-private:
-    BLEControl* bleControl;
-    std::string characteristicUUID;
+// Last values published over BLE
+struct BLEStatusCache {
+    uint8_t doorStatus;        // 1 = open, 0 = closed
+    uint8_t doorPosition;      // 50 or 100
+    uint8_t ledStatus;         // LED_STATE_ON / LED_STATE_OFF
+    uint8_t ledBrightness;     // 0-100
+    char ledColor[7];          // 6-digit hex
+    String wifiStatus;
+    uint8_t wifiState;         // wl_status_t
+    uint8_t childLock;         // 1 = locked, 0 = unlocked
+    uint8_t podState;          // POD_STATE_*
+    uint8_t podTarget;         // 1 = opening/open, 0 = closing/closed
+    uint8_t safetyStatus;      // SAFETY_STATUS_*
+    uint16_t frameAck;         // Sequence of the last applied command frame
+};
 
-public:
-    BLECharacteristicCallback(BLEControl* control, const std::string& uuid) 
-        : bleControl(control), characteristicUUID(uuid) {}
+// Advertised status (manufacturer specific data)
+#define ADV_COMPANY_ID 0xFFFF             // Bluetooth SIG ID reserved for unassigned/test use
+#define ADV_STATUS_VERSION 1
+#define ADV_UPDATE_MIN_INTERVAL 250       // Minimum time between advertising data updates (ms)
+#define ADV_FLAG_TARGET_OPEN 0x01
+#define ADV_FLAG_LED_ON 0x02
+#define ADV_FLAG_CHILD_LOCK 0x04
+
+// Status broadcast in every advertisement so apps can show it without connecting.
+// Together with the flags and the 128-bit service UUID this fits the 31-byte
+// advertising payload.
+struct __attribute__((packed)) AdvertisedStatus {
+    uint16_t companyId;        // ADV_COMPANY_ID, little-endian
+    uint8_t version;           // ADV_STATUS_VERSION
+    uint8_t podState;          // POD_STATE_*
+    uint8_t flags;             // ADV_FLAG_*
+    uint8_t faultCode;         // SAFETY_STATUS_*
+    uint8_t sequence;          // Incremented whenever the advertised status changes
+};
+static_assert(sizeof(AdvertisedStatus) <= 8, "AdvertisedStatus must fit next to the service UUID");
+
+// One connected central
+struct BLEConnection {
+    bool active;
+    uint16_t connId;
+    uint16_t mtu;              // Negotiated ATT MTU
+    uint16_t subscriptions;    // Bit per CHAR_ID_* with notifications enabled by this central
+    uint32_t notifications;    // Notifications sent
+    uint32_t notifyFailures;   // Notifications rejected by the stack (congestion)
+    unsigned long connectedAt; // millis() at connection
+    uint32_t firstNotifyTime;  // Connect to first notification sent (ms, 0 = none yet)
+    
+    // Connection parameters
+    uint8_t requestedProfile;  // CONN_PROFILE_*
+    unsigned long lastParamRequest;
+    bool paramRequestFailed;   // The stack refused the last request
+    uint8_t paramRetries;      // Re-requests of requestedProfile so far
+    uint16_t interval;         // Achieved connection interval (1.25 ms units, 0 = unknown)
+    uint16_t latency;          // Achieved slave latency
+    uint16_t timeout;          // Achieved supervision timeout (10 ms units)
     
-    void onWrite(BLECharacteristic* characteristic) override;
-    void onRead(BLECharacteristic* characteristic) override;
+    // Round trip, measured on indications (CCCD bit 1) confirmed by the central
+    uint16_t indications;      // Bit per CHAR_ID_* with indications enabled
+    bool indicationPending;
+    uint8_t indicationCharacteristic;  // CHAR_ID_* of the pending indication
+    uint32_t indicationSentAt; // micros()
+    uint32_t rttLast;          // Microseconds
+    uint32_t rttMin;
+    uint32_t rttMax;
+    uint64_t rttTotal;
+    uint32_t rttCount;
+    
+    // Bonding and time to ready
+    bool bonded;               // Bonded on this or an earlier connection
+    bool returning;            // Bonded before this connection (may use its GATT cache)
+    uint8_t address[6];        // Identity address, valid when bonded
+    uint32_t readyTime;        // Connect to first enabled CCCD (ms, 0 = not ready yet)
+};
+
+// Connect-to-ready times, kept apart for returning bonded centrals and the rest
+#define READY_STATS_NEW 0
+#define READY_STATS_BONDED 1
+struct BLEReadyStats {
+    uint32_t count;
+    uint32_t last;             // Milliseconds
+    uint32_t max;
+    uint64_t total;
 };
 
-class BLEControl {
+// BLE stack footprint, measured around transport setup
+struct BLEFootprint {
+    uint32_t heapUsed;         // Heap taken by the stack and the GATT service (bytes)
+    uint32_t internalUsed;     // Of which internal RAM (bytes)
+    uint32_t setupTime;        // Stack start to advertising (ms)
+    uint32_t imageSize;        // Firmware image size, compare between backend builds (bytes)
+};
+
+class BLEControl : public BleTransportListener {
 private:
-    BLEServer* pServer;
-    BLEAdvertising* pAdvertising;
-    BLECharacteristic* pDoorStatus;
-    BLECharacteristic* pDoorPosition;
-    BLECharacteristic* pLEDStatus;
-    BLECharacteristic* pLEDBrightness;
-    BLECharacteristic* pLEDColor;
-    BLECharacteristic* pWiFiCredentials;
-    BLECharacteristic* pWiFiStatus;
-    BLECharacteristic* pChildLock;
-    BLECharacteristic* pJSONStatus;  // New JSON status characteristic
-    
-    // Connection state tracking
-    bool isClientConnected;
-    uint16_t connectedClientId;
+    // Write handler for each CHAR_ID_* (nullptr for read-only characteristics)
+    typedef void (BLEControl::*WriteHandler)(const std::string& value);
+    static const WriteHandler writeHandlers[CHAR_ID_COUNT];
+    
+    // GATT service backend, selected by BLE_BACKEND
+    BleTransport* transport;
+    BLEFootprint footprint;
+    
+    // FNV-1a hash of the characteristics; a bonded central that last saw a
+    // different layout is sent Service Changed
+    uint32_t gattLayoutHash;
+    BLEReadyStats readyStats[2];
+    
+    // Connection state tracking; connections are added and removed by the BLE
+    // task and read by the main loop, guarded by connectionLock
+    BLEConnection connections[BLE_MAX_CONNECTIONS];
+    uint8_t connectionCount;
+    portMUX_TYPE connectionLock;
+    uint8_t notifyRotation;
+    
+    // Last command or motion, used to pick the connection parameter profile
+    volatile unsigned long lastActivity;
     
     // Reference to external state flag to control door state
     bool* podOpenFlagRef;
@@ -85,49 +255,99 @@ private:
     // Reference to child lock state
     bool* childLockRef;
     
+    // Queue carrying validated commands from the BLE task to the control loop
+    CommandQueue* commandQueueRef;
+    
     // Network credentials buffers
     String networkBuffer;
     String passwordBuffer;
     
-    // JSON update timing
+    // Change tracking: fields are marked dirty when their value changes and
+    // notified from the main loop, at most once per STATUS_NOTIFY_MIN_INTERVAL
+    BLEStatusCache statusCache;
+    std::atomic<uint16_t> dirtyFields;
+    unsigned long lastFieldNotify[STATUS_FIELD_COUNT];
+    
+    // JSON and binary status timing
     unsigned long lastJSONUpdate;
+    volatile bool jsonUpdatePending;
+    unsigned long lastBinaryUpdate;
+    volatile bool binaryUpdatePending;
+    uint16_t binaryStatusSequence;
+    
+    // WiFi scan pages, built in the main loop
+    std::atomic<uint8_t> scanPageRequest;  // Page asked for by a client, or WIFI_SCAN_NO_REQUEST
+    uint32_t scanResultsVersion;           // WiFiControl results last published
+    
+    // Advertised status
+    AdvertisedStatus advertisedStatus;
+    unsigned long lastAdvertisingUpdate;
+    volatile bool advertisingUpdatePending;
+    
+    void markFieldDirty(uint8_t field);
+    void notifyCharacteristic(uint8_t characteristicId);
+    bool requestConnectionProfile(uint16_t connId, uint8_t profile);
+    void addCharacteristic(uint8_t characteristicId, const char* uuid, uint8_t properties);
+    bool recordReady(BLEConnection& connection);
+    bool parseFrameOperation(uint8_t type, const uint8_t* value, uint8_t length, PodCommand& command);
 
 public:
     // Constructor
-    BLEControl(bool* podOpenFlag, WiFiControl* wifiControl, bool* childLock);
+    BLEControl(bool* podOpenFlag, WiFiControl* wifiControl, bool* childLock, CommandQueue* commandQueue);
     
     // Main initialization
     void begin();
     
     // JSON status management
     void updateJSONStatus();
-    void checkJSONUpdate();  // Call this from main loop
+    void updateBinaryStatus();
+    void updateAdvertisingData();
+    void checkJSONUpdate();  // Call this from main loop - sends pending notifications and the idle heartbeat
+    void checkConnectionParameters();  // Call this from main loop - switches between fast and idle profiles
+    void checkWiFiScan();  // Call this from main loop - publishes new scan results and requested pages
+    void updateWiFiScanPage(uint8_t page);
+    void noteActivity() { lastActivity = millis(); }
     
     // Connection management
     void startAdvertising();
     void stopAdvertising();
-    bool getConnectionStatus() const { return isClientConnected; }
+    bool getConnectionStatus() const { return connectionCount > 0; }
+    uint8_t getConnectionCount() const { return connectionCount; }
+    bool getConnection(uint16_t connId, BLEConnection& connection);  // Copy of a connection's state
+    void printConnectionInfo();
+    const BLEFootprint& getFootprint() const { return footprint; }
+    BleTransport* getTransport() { return transport; }
     
     // Internal setup methods
-    void createCharacteristics(BLEService* pService);
+    void createCharacteristics();
     void setInitialValues();
     
-    // Connection event handlers (called by BLEServerCallback)
-    void handleClientConnect(uint16_t clientId);
-    void handleClientDisconnect();
+    // Transport events (BleTransportListener)
+    void onTransportConnect(uint16_t connId) override;
+    void onTransportDisconnect(uint16_t connId) override;
+    void onTransportWrite(uint8_t characteristicId, const std::string& value) override;
+    void onTransportRead(uint8_t characteristicId) override;
+    void onTransportSubscribe(uint16_t connId, uint8_t characteristicId, uint16_t cccdValue) override;
+    void onTransportMtuChange(uint16_t connId, uint16_t mtu) override;
+    void onTransportConnParams(uint16_t connId, uint16_t interval, uint16_t latency, uint16_t timeout) override;
+    void onTransportIndicationConfirm(uint16_t connId, uint8_t characteristicId) override;
+    void onTransportAuthComplete(uint16_t connId, const uint8_t* address, uint8_t addressType, bool bonded) override;
     
     // Characteristic write handlers
-    void handleDoorStatusWrite(BLECharacteristic* characteristic);
-    void handleDoorPositionWrite(BLECharacteristic* characteristic);
-    void handleLEDStatusWrite(BLECharacteristic* characteristic);
-    void handleLEDBrightnessWrite(BLECharacteristic* characteristic);
-    void handleLEDColorWrite(BLECharacteristic* characteristic);
-    void handleWiFiCredentialsWrite(BLECharacteristic* characteristic);
-    void handleChildLockWrite(BLECharacteristic* characteristic);
+    void handleDoorStatusWrite(const std::string& value);
+    void handleDoorPositionWrite(const std::string& value);
+    void handleLEDStatusWrite(const std::string& value);
+    void handleLEDBrightnessWrite(const std::string& value);
+    void handleLEDColorWrite(const std::string& value);
+    void handleWiFiCredentialsWrite(const std::string& value);
+    void handleChildLockWrite(const std::string& value);
+    void handleCommandFrameWrite(const std::string& value);
+    void handleWiFiScanWrite(const std::string& value);
     
     // Helper methods
+    bool queueCommand(uint8_t type, uint8_t value, uint8_t traceTarget);
     void onNetworkReceived(const std::string& value);
-    void finalizeNetwork();
+    void finalizeNetwork(uint8_t priority);
     
     // BLE characteristic update methods
     void updateDoorStatus(bool isOpen);
@@ -137,6 +357,9 @@ public:
     void updateLEDColor(String color);
     void updateWiFiStatus(const String& status);
     void updateChildLock(bool childLockOn);
+    void updatePodState(uint8_t podState, bool podTarget);
+    void updateSafetyStatus(uint8_t safetyStatus);
+    void updateFrameAck(uint16_t sequence);
 };
 
 #endif // BLECONTROL_H
\ No newline at end of file
@@ -0,0 +1,113 @@
+#include "BleBondStore.h"
+#include "Logger.h"
+
+Preferences bondPreferences;
+
+// Bonds, most recently used first. Changed by the BLE task, written to
+// flash by runBondPersistence() from the main loop.
+BondEntry bonds[BLE_MAX_BONDS];
+uint8_t bondCount = 0;
+volatile bool bondsDirty = false;
+portMUX_TYPE bondLock = portMUX_INITIALIZER_UNLOCKED;
+
+void initBondStore() {
+    bondPreferences.begin(BOND_NAMESPACE, true);
+    uint8_t version = bondPreferences.getUChar("version", 0);
+    size_t length = bondPreferences.getBytesLength("bonds");
+    if (version == BOND_STORE_VERSION && length <= sizeof(bonds) && length % sizeof(BondEntry) == 0) {
+        bondPreferences.getBytes("bonds", bonds, length);
+        bondCount = length / sizeof(BondEntry);
+    }
+    bondPreferences.end();
+    
+    LOG_I("Bond store initialized (%u/%u bonds)", bondCount, BLE_MAX_BONDS);
+}
+
+void runBondPersistence() {
+    if (!bondsDirty) {
+        return;
+    }
+    
+    BondEntry snapshot[BLE_MAX_BONDS];
+    uint8_t count;
+    
+    portENTER_CRITICAL(&bondLock);
+    memcpy(snapshot, bonds, sizeof(snapshot));
+    count = bondCount;
+    bondsDirty = false;
+    portEXIT_CRITICAL(&bondLock);
+    
+    bondPreferences.begin(BOND_NAMESPACE, false);
+    bondPreferences.putUChar("version", BOND_STORE_VERSION);
+    bondPreferences.putBytes("bonds", snapshot, count * sizeof(BondEntry));
+    bondPreferences.end();
+    
+    LOG_D("Bond store saved (%u bonds)", count);
+}
+
+// Index of a bond, or -1. Call with bondLock held.
+int8_t findBondIndex(const uint8_t* address) {
+    for (uint8_t i = 0; i < bondCount; i++) {
+        if (memcmp(bonds[i].address, address, sizeof(bonds[i].address)) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool getBond(const uint8_t* address, BondEntry& entry) {
+    portENTER_CRITICAL(&bondLock);
+    int8_t index = findBondIndex(address);
+    if (index >= 0) {
+        entry = bonds[index];
+    }
+    portEXIT_CRITICAL(&bondLock);
+    
+    return index >= 0;
+}
+
+bool touchBond(const uint8_t* address, uint8_t addressType, uint32_t layoutHash, BondEntry& evicted) {
+    bool evictedOne = false;
+    
+    portENTER_CRITICAL(&bondLock);
+    int8_t index = findBondIndex(address);
+    BondEntry entry;
+    if (index >= 0) {
+        entry = bonds[index];
+    } else {
+        memset(&entry, 0, sizeof(entry));
+        memcpy(entry.address, address, sizeof(entry.address));
+        
+        // Full: the least recently used bond, at the end, makes room
+        if (bondCount == BLE_MAX_BONDS) {
+            evicted = bonds[BLE_MAX_BONDS - 1];
+            evictedOne = true;
+            bondCount--;
+        }
+        index = bondCount++;
+    }
+    entry.addressType = addressType;
+    entry.layoutHash = layoutHash;
+    
+    memmove(&bonds[1], &bonds[0], index * sizeof(BondEntry));
+    bonds[0] = entry;
+    bondsDirty = true;
+    portEXIT_CRITICAL(&bondLock);
+    
+    return evictedOne;
+}
+
+void saveBondSubscriptions(const uint8_t* address, uint16_t subscriptions, uint16_t indications) {
+    portENTER_CRITICAL(&bondLock);
+    int8_t index = findBondIndex(address);
+    if (index >= 0 && (bonds[index].subscriptions != subscriptions || bonds[index].indications != indications)) {
+        bonds[index].subscriptions = subscriptions;
+        bonds[index].indications = indications;
+        bondsDirty = true;
+    }
+    portEXIT_CRITICAL(&bondLock);
+}
+
+uint8_t getBondCount() {
+    return bondCount;
+}
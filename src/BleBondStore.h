@@ -0,0 +1,36 @@
+#ifndef BLE_BOND_STORE_H
+#define BLE_BOND_STORE_H
+
+#include <Arduino.h>
+#include <Preferences.h>
+
+// Bonded centrals, most recently used first. The BLE stack keeps the keys;
+// this list decides which bond to evict and remembers, per bond, the CCCDs
+// it enabled and the GATT layout it last discovered.
+#define BOND_NAMESPACE "solebonds"
+#define BLE_MAX_BONDS 3                   // Must not exceed the stack's bond limit (CONFIG_BT_*_MAX_BONDS)
+#define BOND_STORE_VERSION 1
+
+struct BondEntry {
+    uint8_t address[6];        // Identity address
+    uint8_t addressType;
+    uint16_t subscriptions;    // Bit per CHAR_ID_* with notifications enabled
+    uint16_t indications;      // Bit per CHAR_ID_* with indications enabled
+    uint32_t layoutHash;       // GATT layout the central last discovered
+};
+
+// Function prototypes
+void initBondStore();
+void runBondPersistence();  // Call from main loop - writes the list after a change
+
+// Looks up a bond; returns false if the address is not bonded
+bool getBond(const uint8_t* address, BondEntry& entry);
+
+// Moves a bond to the front, adding it if new. When the list is full the
+// least recently used bond is dropped and returned in evicted.
+bool touchBond(const uint8_t* address, uint8_t addressType, uint32_t layoutHash, BondEntry& evicted);
+
+void saveBondSubscriptions(const uint8_t* address, uint16_t subscriptions, uint16_t indications);
+uint8_t getBondCount();
+
+#endif // BLE_BOND_STORE_H
@@ -0,0 +1,19 @@
+#include "BleTransport.h"
+
+#if BLE_BACKEND == BLE_BACKEND_NIMBLE
+#include "NimBLETransport.h"
+#elif BLE_BACKEND == BLE_BACKEND_LOOPBACK
+#include "LoopbackTransport.h"
+#else
+#include "BluedroidTransport.h"
+#endif
+
+BleTransport* createBleTransport() {
+#if BLE_BACKEND == BLE_BACKEND_NIMBLE
+    return new NimBLETransport();
+#elif BLE_BACKEND == BLE_BACKEND_LOOPBACK
+    return new LoopbackTransport();
+#else
+    return new BluedroidTransport();
+#endif
+}
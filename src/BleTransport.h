@@ -0,0 +1,100 @@
+#ifndef BLE_TRANSPORT_H
+#define BLE_TRANSPORT_H
+
+#include <Arduino.h>
+#include <string>
+
+// BLE stack backends, selected at build time with -DBLE_BACKEND=<n>
+#define BLE_BACKEND_BLUEDROID 1           // Arduino BLE library (Bluedroid)
+#define BLE_BACKEND_NIMBLE 2              // NimBLE-Arduino, smaller and faster to connect
+#define BLE_BACKEND_LOOPBACK 3            // In-process, no radio (host tests)
+
+#ifndef BLE_BACKEND
+#define BLE_BACKEND BLE_BACKEND_BLUEDROID
+#endif
+
+// Characteristic properties
+#define BLE_PROP_READ 0x01
+#define BLE_PROP_WRITE 0x02
+#define BLE_PROP_WRITE_NR 0x04
+#define BLE_PROP_NOTIFY 0x08              // Notify and indicate; the central picks through the CCCD
+
+// Transport limits
+#define BLE_TRANSPORT_MAX_CHARACTERISTICS 16
+#define BLE_TRANSPORT_MAX_CONNECTIONS 4
+
+// CCCD bits written by a central
+#define BLE_CCCD_NOTIFY 0x0001
+#define BLE_CCCD_INDICATE 0x0002
+
+// Events raised by a transport. Called from the BLE stack task, except on
+// the loopback transport where they run in the caller's context.
+class BleTransportListener {
+public:
+    virtual ~BleTransportListener() {}
+
+    virtual void onTransportConnect(uint16_t connId) = 0;
+    virtual void onTransportDisconnect(uint16_t connId) = 0;
+    virtual void onTransportWrite(uint8_t characteristicId, const std::string& value) = 0;
+    virtual void onTransportRead(uint8_t characteristicId) {}
+    virtual void onTransportSubscribe(uint16_t connId, uint8_t characteristicId, uint16_t cccdValue) = 0;
+    virtual void onTransportMtuChange(uint16_t connId, uint16_t mtu) = 0;
+    virtual void onTransportConnParams(uint16_t connId, uint16_t interval, uint16_t latency, uint16_t timeout) = 0;
+    virtual void onTransportIndicationConfirm(uint16_t connId, uint8_t characteristicId) = 0;
+    virtual void onTransportAuthComplete(uint16_t connId, const uint8_t* address, uint8_t addressType,
+                                         bool bonded) = 0;
+};
+
+// A single GATT service with characteristics addressed by a small ID
+// (0 to BLE_TRANSPORT_MAX_CHARACTERISTICS - 1). Call order: begin(),
+// addCharacteristic() for each characteristic, start().
+class BleTransport {
+public:
+    virtual ~BleTransport() {}
+
+    virtual const char* getName() const = 0;
+
+    // Setup
+    virtual void begin(const char* deviceName, const char* serviceUUID, uint16_t preferredMtu,
+                       BleTransportListener* listener) = 0;
+    virtual bool addCharacteristic(uint8_t characteristicId, const char* uuid, uint8_t properties) = 0;
+    virtual void start() = 0;
+
+    // Values
+    virtual void setValue(uint8_t characteristicId, const uint8_t* data, size_t length) = 0;
+    virtual std::string getValue(uint8_t characteristicId) = 0;
+
+    // Sends a notification, or an indication when indicate is set, to one
+    // connection. Returns false if the stack rejected it (congestion).
+    virtual bool notify(uint8_t characteristicId, uint16_t connId, const uint8_t* data, size_t length,
+                        bool indicate) = 0;
+
+    // Advertising: flags, the service UUID and manufacturer data; the scan
+    // response carries the device name
+    virtual void setAdvertisingData(const uint8_t* manufacturerData, size_t length) = 0;
+    virtual void startAdvertising() = 0;
+    virtual void stopAdvertising() = 0;
+
+    // Connection management (intervals in 1.25 ms units, timeout in 10 ms units)
+    virtual void disconnect(uint16_t connId) = 0;
+    virtual bool updateConnParams(uint16_t connId, uint16_t minInterval, uint16_t maxInterval, uint16_t latency,
+                                  uint16_t timeout) = 0;
+
+    // Bonding (Just Works). Once enabled, the pod asks every central to encrypt
+    // as it connects, so bonded centrals are recognised without pairing again.
+    virtual void enableBonding() = 0;
+    virtual void removeBond(const uint8_t* address, uint8_t addressType) = 0;
+
+    // Tells a bonded central that its cached GATT database is stale
+    virtual void indicateServiceChanged(uint16_t connId) = 0;
+
+    // Convenience for text values
+    void setValue(uint8_t characteristicId, const char* value) {
+        setValue(characteristicId, (const uint8_t*)value, strlen(value));
+    }
+};
+
+// Creates the transport selected by BLE_BACKEND
+BleTransport* createBleTransport();
+
+#endif // BLE_TRANSPORT_H
@@ -0,0 +1,335 @@
+#include "BluedroidTransport.h"
+
+#if BLE_BACKEND == BLE_BACKEND_BLUEDROID
+
+// Server Callbacks Implementation
+void BluedroidServerCallback::onConnect(BLEServer* pServer, esp_ble_gatts_cb_param_t* param) {
+    transport->handleConnect(param->connect.conn_id, param->connect.remote_bda);
+}
+
+void BluedroidServerCallback::onDisconnect(BLEServer* pServer, esp_ble_gatts_cb_param_t* param) {
+    transport->handleDisconnect(param->disconnect.conn_id);
+}
+
+// Characteristic Callbacks Implementation
+void BluedroidCharacteristicCallback::onWrite(BLECharacteristic* characteristic) {
+    transport->listener->onTransportWrite(characteristicId, characteristic->getValue());
+}
+
+void BluedroidCharacteristicCallback::onRead(BLECharacteristic* characteristic) {
+    transport->listener->onTransportRead(characteristicId);
+}
+
+BluedroidTransport* BluedroidTransport::instance = nullptr;
+
+BluedroidTransport::BluedroidTransport()
+    : listener(nullptr), pServer(nullptr), pService(nullptr), pAdvertising(nullptr), bondingEnabled(false) {
+    for (uint8_t i = 0; i < BLE_TRANSPORT_MAX_CHARACTERISTICS; i++) {
+        characteristics[i] = nullptr;
+        cccdDescriptors[i] = nullptr;
+    }
+    memset(peers, 0, sizeof(peers));
+    peerLock = portMUX_INITIALIZER_UNLOCKED;
+}
+
+void BluedroidTransport::begin(const char* deviceName, const char* uuid, uint16_t preferredMtu,
+                               BleTransportListener* transportListener) {
+    listener = transportListener;
+    serviceUUID = uuid;
+
+    BLEDevice::init(deviceName);
+    pServer = BLEDevice::createServer();
+    pServer->setCallbacks(new BluedroidServerCallback(this));
+
+    // Per-connection subscriptions, MTU and parameters come from the raw events
+    instance = this;
+    BLEDevice::setCustomGattsHandler(gattsEventHandler);
+    BLEDevice::setCustomGapHandler(gapEventHandler);
+
+    // Accept a large MTU; the central starts the exchange
+    BLEDevice::setMTU(preferredMtu);
+
+    pService = pServer->createService(BLEUUID(uuid), BLUEDROID_SERVICE_HANDLES, 0);
+
+    // The advertisement carries the service UUID and status, the scan response the name
+    pAdvertising = BLEDevice::getAdvertising();
+    BLEAdvertisementData scanResponseData;
+    scanResponseData.setName(deviceName);
+    pAdvertising->setScanResponseData(scanResponseData);
+}
+
+// Notifying characteristics get a CCCD (BLE2902) that each central writes to subscribe
+bool BluedroidTransport::addCharacteristic(uint8_t characteristicId, const char* uuid, uint8_t properties) {
+    if (!pService || characteristicId >= BLE_TRANSPORT_MAX_CHARACTERISTICS) {
+        return false;
+    }
+
+    uint32_t bluedroidProperties = 0;
+    if (properties & BLE_PROP_READ) bluedroidProperties |= BLECharacteristic::PROPERTY_READ;
+    if (properties & BLE_PROP_WRITE) bluedroidProperties |= BLECharacteristic::PROPERTY_WRITE;
+    if (properties & BLE_PROP_WRITE_NR) bluedroidProperties |= BLECharacteristic::PROPERTY_WRITE_NR;
+    if (properties & BLE_PROP_NOTIFY) {
+        bluedroidProperties |= BLECharacteristic::PROPERTY_NOTIFY | BLECharacteristic::PROPERTY_INDICATE;
+    }
+
+    BLECharacteristic* characteristic = pService->createCharacteristic(uuid, bluedroidProperties);
+    if (properties & BLE_PROP_NOTIFY) {
+        BLE2902* cccd = new BLE2902();
+        characteristic->addDescriptor(cccd);
+        cccdDescriptors[characteristicId] = cccd;
+    }
+    characteristic->setCallbacks(new BluedroidCharacteristicCallback(this, characteristicId));
+    characteristics[characteristicId] = characteristic;
+    return true;
+}
+
+void BluedroidTransport::start() {
+    if (pService) {
+        pService->start();
+    }
+}
+
+void BluedroidTransport::setValue(uint8_t characteristicId, const uint8_t* data, size_t length) {
+    if (characteristicId < BLE_TRANSPORT_MAX_CHARACTERISTICS && characteristics[characteristicId]) {
+        characteristics[characteristicId]->setValue((uint8_t*)data, length);
+    }
+}
+
+std::string BluedroidTransport::getValue(uint8_t characteristicId) {
+    if (characteristicId < BLE_TRANSPORT_MAX_CHARACTERISTICS && characteristics[characteristicId]) {
+        return characteristics[characteristicId]->getValue();
+    }
+    return std::string();
+}
+
+bool BluedroidTransport::notify(uint8_t characteristicId, uint16_t connId, const uint8_t* data, size_t length,
+                                bool indicate) {
+    if (characteristicId >= BLE_TRANSPORT_MAX_CHARACTERISTICS || !characteristics[characteristicId]) {
+        return false;
+    }
+
+    esp_err_t result = esp_ble_gatts_send_indicate(pServer->getGattsIf(), connId,
+                                                   characteristics[characteristicId]->getHandle(), length,
+                                                   (uint8_t*)data, indicate);
+    return result == ESP_OK;
+}
+
+void BluedroidTransport::setAdvertisingData(const uint8_t* manufacturerData, size_t length) {
+    if (!pAdvertising) return;
+
+    BLEAdvertisementData advertisementData;
+    advertisementData.setFlags(ESP_BLE_ADV_FLAG_GEN_DISC | ESP_BLE_ADV_FLAG_BREDR_NOT_SPT);
+    advertisementData.setCompleteServices(BLEUUID(serviceUUID));
+    advertisementData.setManufacturerData(std::string((const char*)manufacturerData, length));
+    pAdvertising->setAdvertisementData(advertisementData);
+}
+
+void BluedroidTransport::startAdvertising() {
+    if (pAdvertising) {
+        pAdvertising->start();
+    }
+}
+
+void BluedroidTransport::stopAdvertising() {
+    if (pAdvertising) {
+        pAdvertising->stop();
+    }
+}
+
+void BluedroidTransport::disconnect(uint16_t connId) {
+    if (pServer) {
+        pServer->disconnect(connId);
+    }
+}
+
+bool BluedroidTransport::updateConnParams(uint16_t connId, uint16_t minInterval, uint16_t maxInterval,
+                                          uint16_t latency, uint16_t timeout) {
+    esp_ble_conn_update_params_t params;
+    if (!findPeerAddress(connId, params.bda)) {
+        return false;
+    }
+
+    params.min_int = minInterval;
+    params.max_int = maxInterval;
+    params.latency = latency;
+    params.timeout = timeout;
+    return esp_ble_gap_update_conn_params(&params) == ESP_OK;
+}
+
+void BluedroidTransport::handleConnect(uint16_t connId, const esp_bd_addr_t address) {
+    portENTER_CRITICAL(&peerLock);
+    for (uint8_t i = 0; i < BLE_TRANSPORT_MAX_CONNECTIONS; i++) {
+        if (!peers[i].active) {
+            peers[i].active = true;
+            peers[i].connId = connId;
+            memcpy(peers[i].address, address, sizeof(esp_bd_addr_t));
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&peerLock);
+
+    listener->onTransportConnect(connId);
+
+    // Bonded centrals re-encrypt with their stored keys, new ones pair
+    if (bondingEnabled) {
+        esp_bd_addr_t peerAddress;
+        memcpy(peerAddress, address, sizeof(esp_bd_addr_t));
+        esp_ble_set_encryption(peerAddress, ESP_BLE_SEC_ENCRYPT);
+    }
+}
+
+void BluedroidTransport::handleDisconnect(uint16_t connId) {
+    portENTER_CRITICAL(&peerLock);
+    for (uint8_t i = 0; i < BLE_TRANSPORT_MAX_CONNECTIONS; i++) {
+        if (peers[i].active && peers[i].connId == connId) {
+            peers[i].active = false;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&peerLock);
+
+    listener->onTransportDisconnect(connId);
+}
+
+// Connection ID of a connected peer, or -1
+int32_t BluedroidTransport::findPeer(const esp_bd_addr_t address) {
+    int32_t connId = -1;
+
+    portENTER_CRITICAL(&peerLock);
+    for (uint8_t i = 0; i < BLE_TRANSPORT_MAX_CONNECTIONS; i++) {
+        if (peers[i].active && memcmp(peers[i].address, address, sizeof(esp_bd_addr_t)) == 0) {
+            connId = peers[i].connId;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&peerLock);
+
+    return connId;
+}
+
+bool BluedroidTransport::findPeerAddress(uint16_t connId, esp_bd_addr_t address) {
+    bool found = false;
+
+    portENTER_CRITICAL(&peerLock);
+    for (uint8_t i = 0; i < BLE_TRANSPORT_MAX_CONNECTIONS; i++) {
+        if (peers[i].active && peers[i].connId == connId) {
+            memcpy(address, peers[i].address, sizeof(esp_bd_addr_t));
+            found = true;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&peerLock);
+
+    return found;
+}
+
+// Just Works bonding with secure connections; keys are stored by Bluedroid
+void BluedroidTransport::enableBonding() {
+    BLESecurity* security = new BLESecurity();
+    security->setAuthenticationMode(ESP_LE_AUTH_REQ_SC_BOND);
+    security->setCapability(ESP_IO_CAP_NONE);
+    security->setInitEncryptionKey(ESP_BLE_ENC_KEY_MASK | ESP_BLE_ID_KEY_MASK);
+    security->setRespEncryptionKey(ESP_BLE_ENC_KEY_MASK | ESP_BLE_ID_KEY_MASK);
+    bondingEnabled = true;
+}
+
+void BluedroidTransport::removeBond(const uint8_t* address, uint8_t addressType) {
+    esp_bd_addr_t bondAddress;
+    memcpy(bondAddress, address, sizeof(esp_bd_addr_t));
+    esp_ble_remove_bond_device(bondAddress);
+}
+
+void BluedroidTransport::indicateServiceChanged(uint16_t connId) {
+    esp_bd_addr_t address;
+    if (pServer && findPeerAddress(connId, address)) {
+        esp_ble_gatts_send_service_change_indication(pServer->getGattsIf(), address);
+    }
+}
+
+uint8_t BluedroidTransport::findCharacteristic(uint16_t handle) const {
+    for (uint8_t id = 0; id < BLE_TRANSPORT_MAX_CHARACTERISTICS; id++) {
+        if (characteristics[id] && characteristics[id]->getHandle() == handle) {
+            return id;
+        }
+    }
+    return 0xFF;
+}
+
+uint8_t BluedroidTransport::findCccd(uint16_t handle) const {
+    for (uint8_t id = 0; id < BLE_TRANSPORT_MAX_CHARACTERISTICS; id++) {
+        if (cccdDescriptors[id] && cccdDescriptors[id]->getHandle() == handle) {
+            return id;
+        }
+    }
+    return 0xFF;
+}
+
+// Raw GATT server events, delivered before BLEServer handles them
+void BluedroidTransport::gattsEventHandler(esp_gatts_cb_event_t event, esp_gatt_if_t gattsIf,
+                                           esp_ble_gatts_cb_param_t* param) {
+    if (!instance) {
+        return;
+    }
+
+    uint8_t id;
+    switch (event) {
+        case ESP_GATTS_WRITE_EVT:
+            // CCCD writes are 2 bytes
+            if (!param->write.is_prep && param->write.len == 2) {
+                id = instance->findCccd(param->write.handle);
+                if (id != 0xFF) {
+                    instance->listener->onTransportSubscribe(param->write.conn_id, id,
+                                                             param->write.value[0] | (param->write.value[1] << 8));
+                }
+            }
+            break;
+
+        case ESP_GATTS_MTU_EVT:
+            instance->listener->onTransportMtuChange(param->mtu.conn_id, param->mtu.mtu);
+            break;
+
+        case ESP_GATTS_CONF_EVT:
+            // Raised for notifications too; the listener only counts pending indications
+            id = instance->findCharacteristic(param->conf.handle);
+            if (id != 0xFF) {
+                instance->listener->onTransportIndicationConfirm(param->conf.conn_id, id);
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+// Raw GAP events: achieved connection parameters and pairing results
+void BluedroidTransport::gapEventHandler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t* param) {
+    if (!instance) {
+        return;
+    }
+
+    int32_t connId;
+    switch (event) {
+        case ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT:
+            connId = instance->findPeer(param->update_conn_params.bda);
+            if (param->update_conn_params.status == 0 && connId >= 0) {
+                instance->listener->onTransportConnParams(connId, param->update_conn_params.conn_int,
+                                                          param->update_conn_params.latency,
+                                                          param->update_conn_params.timeout);
+            }
+            break;
+
+        case ESP_GAP_BLE_AUTH_CMPL_EVT:
+            connId = instance->findPeer(param->ble_security.auth_cmpl.bd_addr);
+            if (connId >= 0) {
+                const esp_ble_auth_cmpl_t& result = param->ble_security.auth_cmpl;
+                instance->listener->onTransportAuthComplete(connId, result.bd_addr, result.addr_type,
+                                                            result.success && (result.auth_mode & ESP_LE_AUTH_BOND));
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+#endif // BLE_BACKEND == BLE_BACKEND_BLUEDROID
@@ -0,0 +1,122 @@
+#ifndef BLUEDROID_TRANSPORT_H
+#define BLUEDROID_TRANSPORT_H
+
+#include "BleTransport.h"
+
+#if BLE_BACKEND == BLE_BACKEND_BLUEDROID
+
+#include <BLEDevice.h>
+#include <BLEServer.h>
+#include <BLECharacteristic.h>
+#include <BLEService.h>
+#include <BLEAdvertising.h>
+#include <BLE2902.h>
+#include <BLESecurity.h>
+#include <esp_gatts_api.h>
+#include <esp_gap_ble_api.h>
+
+// Room for every characteristic with a CCCD, plus the service declaration
+#define BLUEDROID_SERVICE_HANDLES (BLE_TRANSPORT_MAX_CHARACTERISTICS * 3 + 1)
+
+class BluedroidTransport;
+
+// Server callback forwarding connections to the transport
+class BluedroidServerCallback : public BLEServerCallbacks {
+private:
+    BluedroidTransport* transport;
+
+public:
+    BluedroidServerCallback(BluedroidTransport* owner) : transport(owner) {}
+
+    void onConnect(BLEServer* pServer, esp_ble_gatts_cb_param_t* param) override;
+    void onDisconnect(BLEServer* pServer, esp_ble_gatts_cb_param_t* param) override;
+};
+
+// One instance per characteristic, tagged with its ID
+class BluedroidCharacteristicCallback : public BLECharacteristicCallbacks {
+private:
+    BluedroidTransport* transport;
+    uint8_t characteristicId;
+
+public:
+    BluedroidCharacteristicCallback(BluedroidTransport* owner, uint8_t id)
+        : transport(owner), characteristicId(id) {}
+
+    void onWrite(BLECharacteristic* characteristic) override;
+    void onRead(BLECharacteristic* characteristic) override;
+};
+
+// Connected central; Bluedroid addresses parameter updates by device address
+struct BluedroidPeer {
+    bool active;
+    uint16_t connId;
+    esp_bd_addr_t address;
+};
+
+class BluedroidTransport : public BleTransport {
+private:
+    // Instance receiving raw GATT server and GAP events (subscriptions, MTU,
+    // indication confirms and connection parameters)
+    static BluedroidTransport* instance;
+    static void gattsEventHandler(esp_gatts_cb_event_t event, esp_gatt_if_t gattsIf,
+                                  esp_ble_gatts_cb_param_t* param);
+    static void gapEventHandler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t* param);
+
+    BleTransportListener* listener;
+    BLEServer* pServer;
+    BLEService* pService;
+    BLEAdvertising* pAdvertising;
+    std::string serviceUUID;
+    bool bondingEnabled;
+
+    // Characteristics and their CCCDs (nullptr if not notifying), by ID
+    BLECharacteristic* characteristics[BLE_TRANSPORT_MAX_CHARACTERISTICS];
+    BLEDescriptor* cccdDescriptors[BLE_TRANSPORT_MAX_CHARACTERISTICS];
+
+    // Peers are added by the BLE task and read by the main loop
+    BluedroidPeer peers[BLE_TRANSPORT_MAX_CONNECTIONS];
+    portMUX_TYPE peerLock;
+
+    uint8_t findCharacteristic(uint16_t handle) const;
+    uint8_t findCccd(uint16_t handle) const;
+    int32_t findPeer(const esp_bd_addr_t address);
+    bool findPeerAddress(uint16_t connId, esp_bd_addr_t address);
+    void handleConnect(uint16_t connId, const esp_bd_addr_t address);
+    void handleDisconnect(uint16_t connId);
+
+    friend class BluedroidServerCallback;
+    friend class BluedroidCharacteristicCallback;
+
+public:
+    BluedroidTransport();
+
+    const char* getName() const override { return "bluedroid"; }
+
+    void begin(const char* deviceName, const char* uuid, uint16_t preferredMtu,
+               BleTransportListener* transportListener) override;
+    bool addCharacteristic(uint8_t characteristicId, const char* uuid, uint8_t properties) override;
+    void start() override;
+
+    void setValue(uint8_t characteristicId, const uint8_t* data, size_t length) override;
+    std::string getValue(uint8_t characteristicId) override;
+    bool notify(uint8_t characteristicId, uint16_t connId, const uint8_t* data, size_t length,
+                bool indicate) override;
+
+    void setAdvertisingData(const uint8_t* manufacturerData, size_t length) override;
+    void startAdvertising() override;
+    void stopAdvertising() override;
+
+    void disconnect(uint16_t connId) override;
+    bool updateConnParams(uint16_t connId, uint16_t minInterval, uint16_t maxInterval, uint16_t latency,
+                          uint16_t timeout) override;
+
+    void enableBonding() override;
+    void removeBond(const uint8_t* address, uint8_t addressType) override;
+    void indicateServiceChanged(uint16_t connId) override;
+
+    using BleTransport::setValue;
+};
+
+#endif // BLE_BACKEND == BLE_BACKEND_BLUEDROID
+
+#endif // BLUEDROID_TRANSPORT_H
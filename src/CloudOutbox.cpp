@@ -0,0 +1,253 @@
+#include "CloudOutbox.h"
+#include "Logger.h"
+#include <atomic>
+#include <esp_system.h>
+
+Preferences outboxPreferences;
+
+// Oldest first
+OutboxEntry outbox[CLOUD_OUTBOX_SIZE];
+uint8_t outboxCount = 0;
+
+uint32_t nextOutboxToken = 0;
+uint32_t lastReplayAt = 0;
+bool outboxOnline = false;
+bool outboxPersisted = false;          // Flash holds entries
+
+// Read by the control loop for reporting
+std::atomic<uint32_t> outboxDepth(0);
+std::atomic<uint32_t> outboxInFlight(0);
+std::atomic<uint32_t> outboxAcked(0);
+std::atomic<uint32_t> outboxRejected(0);
+std::atomic<uint32_t> outboxRetransmits(0);
+std::atomic<uint32_t> outboxExpired(0);
+std::atomic<uint32_t> outboxSuperseded(0);
+std::atomic<uint32_t> outboxReplayed(0);
+std::atomic<uint32_t> outboxRestored(0);
+std::atomic<uint32_t> outboxFlashWrites(0);
+
+// Fields of updates that were given up, collected by the control loop
+std::atomic<uint8_t> outboxUndeliveredFields(0);
+
+void writeOutbox() {
+    outboxPreferences.begin(OUTBOX_NAMESPACE, false);
+    if (outboxCount > 0) {
+        outboxPreferences.putUChar("version", OUTBOX_VERSION);
+        outboxPreferences.putBytes("entries", outbox, outboxCount * sizeof(OutboxEntry));
+    } else {
+        outboxPreferences.remove("entries");
+    }
+    outboxPreferences.end();
+
+    outboxPersisted = outboxCount > 0;
+    outboxFlashWrites++;
+    LOG_D("Outbox saved (%u updates)", outboxCount);
+}
+
+// Keeps flash in step while offline, and until the restored entries are delivered
+void outboxChanged() {
+    uint8_t inFlight = 0;
+    for (uint8_t i = 0; i < outboxCount; i++) {
+        if (outbox[i].flags & OUTBOX_IN_FLIGHT) {
+            inFlight++;
+        }
+    }
+    outboxDepth = outboxCount;
+    outboxInFlight = inFlight;
+
+    if (!outboxOnline || outboxPersisted) {
+        writeOutbox();
+    }
+}
+
+void removeOutboxEntry(uint8_t index) {
+    memmove(&outbox[index], &outbox[index + 1], (outboxCount - index - 1) * sizeof(OutboxEntry));
+    outboxCount--;
+}
+
+void initOutbox() {
+    nextOutboxToken = esp_random();
+
+    outboxPreferences.begin(OUTBOX_NAMESPACE, true);
+    uint8_t version = outboxPreferences.getUChar("version", 0);
+    size_t length = outboxPreferences.getBytesLength("entries");
+    if (version == OUTBOX_VERSION && length <= sizeof(outbox) && length % sizeof(OutboxEntry) == 0) {
+        outboxPreferences.getBytes("entries", outbox, length);
+        outboxCount = length / sizeof(OutboxEntry);
+    }
+    outboxPreferences.end();
+
+    // millis() from the previous boot means nothing now
+    for (uint8_t i = 0; i < outboxCount; i++) {
+        outbox[i].postedAt = 0;
+        outbox[i].flags = OUTBOX_REPLAY;
+        outbox[i].sends = 0;
+    }
+    outboxPersisted = outboxCount > 0;
+    outboxRestored = outboxCount;
+    outboxDepth = outboxCount;
+
+    LOG_I("Outbox initialized (%u updates restored)", outboxCount);
+}
+
+void addOutboxEntry(const CloudDeviceStatus& status, uint8_t fields, uint32_t postedAt) {
+    // Older entries no longer need to carry these fields
+    for (int8_t i = outboxCount - 1; i >= 0; i--) {
+        outbox[i].fields &= ~fields;
+        if (outbox[i].fields == 0) {
+            removeOutboxEntry(i);
+            outboxSuperseded++;
+        }
+    }
+
+    // Cannot happen while fields are disjoint; keep the newest regardless
+    if (outboxCount == CLOUD_OUTBOX_SIZE) {
+        LOG_W("Outbox full, update %08x dropped", outbox[0].token);
+        outboxUndeliveredFields.fetch_or(outbox[0].fields);
+        removeOutboxEntry(0);
+    }
+
+    OutboxEntry& entry = outbox[outboxCount++];
+    entry.token = nextOutboxToken++;
+    entry.postedAt = postedAt;
+    entry.sentAt = 0;
+    entry.status = status;
+    entry.fields = fields;
+    entry.flags = outboxOnline ? 0 : OUTBOX_REPLAY;
+    entry.sends = 0;
+    outboxChanged();
+}
+
+bool sendOutboxEntry(AwsMqttHandler& mqtt, OutboxEntry& entry) {
+    char token[9];
+    snprintf(token, sizeof(token), "%08x", entry.token);
+    if (!mqtt.publishReported(entry.fields, entry.status.podOpen, entry.status.ledOn, entry.status.color,
+                              entry.status.brightness, token)) {
+        return false;
+    }
+
+    if (entry.sends > 0) {
+        outboxRetransmits++;
+    }
+    if (entry.flags & OUTBOX_REPLAY) {
+        outboxReplayed++;
+        lastReplayAt = millis();
+    }
+    entry.sentAt = millis();
+    entry.flags |= OUTBOX_IN_FLIGHT;
+    entry.sends++;
+    return true;
+}
+
+void runOutbox(AwsMqttHandler& mqtt) {
+    unsigned long currentTime = millis();
+    bool changed = false;
+
+    // Unacknowledged updates go back in line, or are given up
+    uint8_t inFlight = 0;
+    for (int8_t i = outboxCount - 1; i >= 0; i--) {
+        OutboxEntry& entry = outbox[i];
+        if (!(entry.flags & OUTBOX_IN_FLIGHT)) {
+            continue;
+        }
+        if (currentTime - entry.sentAt < CLOUD_ACK_TIMEOUT) {
+            inFlight++;
+            continue;
+        }
+
+        if (entry.sends >= CLOUD_MAX_RETRIES) {
+            LOG_W("Outbox update %08x not acknowledged after %u sends, dropped", entry.token, entry.sends);
+            outboxUndeliveredFields.fetch_or(entry.fields);
+            removeOutboxEntry(i);
+            outboxExpired++;
+        } else {
+            entry.flags &= ~OUTBOX_IN_FLIGHT;
+        }
+        changed = true;
+    }
+
+    // Live updates first, then replayed ones no faster than the replay interval
+    bool blocked = false;
+    for (uint8_t pass = 0; pass < 2 && !blocked && inFlight < CLOUD_INFLIGHT_WINDOW; pass++) {
+        for (uint8_t i = 0; i < outboxCount && inFlight < CLOUD_INFLIGHT_WINDOW; i++) {
+            OutboxEntry& entry = outbox[i];
+            bool replay = entry.flags & OUTBOX_REPLAY;
+            if ((entry.flags & OUTBOX_IN_FLIGHT) || replay != (pass == 1)) {
+                continue;
+            }
+            if (replay && currentTime - lastReplayAt < CLOUD_REPLAY_INTERVAL) {
+                break;
+            }
+
+            // A failed publish means the connection is in trouble; try next time
+            if (!sendOutboxEntry(mqtt, entry)) {
+                blocked = true;
+                break;
+            }
+            inFlight++;
+            changed = true;
+        }
+    }
+
+    if (changed) {
+        outboxChanged();
+    }
+}
+
+bool acknowledgeOutboxEntry(uint32_t token, bool accepted, uint32_t& postedAt) {
+    for (uint8_t i = 0; i < outboxCount; i++) {
+        if (outbox[i].token != token || !(outbox[i].flags & OUTBOX_IN_FLIGHT)) {
+            continue;
+        }
+
+        // A rejected update would be rejected again, so it is not resent
+        if (accepted) {
+            outboxAcked++;
+        } else {
+            LOG_W("Shadow rejected update %08x", token);
+            outboxRejected++;
+            outboxUndeliveredFields.fetch_or(outbox[i].fields);
+        }
+        postedAt = outbox[i].postedAt;
+        removeOutboxEntry(i);
+        outboxChanged();
+        return true;
+    }
+    return false;
+}
+
+void setOutboxOnline(bool online) {
+    if (online == outboxOnline) {
+        return;
+    }
+    outboxOnline = online;
+
+    if (!online) {
+        // Acknowledgements for these will not arrive; replay them after reconnecting.
+        // Sends lost with the connection do not count towards the retry limit.
+        for (uint8_t i = 0; i < outboxCount; i++) {
+            outbox[i].flags = OUTBOX_REPLAY;
+            outbox[i].sends = 0;
+        }
+        if (outboxCount > 0) {
+            outboxChanged();
+        }
+    }
+}
+
+void getOutboxStats(OutboxStats& stats) {
+    stats.depth = outboxDepth.load();
+    stats.inFlight = outboxInFlight.load();
+    stats.acked = outboxAcked.load();
+    stats.rejected = outboxRejected.load();
+    stats.retransmits = outboxRetransmits.load();
+    stats.expired = outboxExpired.load();
+    stats.superseded = outboxSuperseded.load();
+    stats.replayed = outboxReplayed.load();
+    stats.restored = outboxRestored.load();
+    stats.flashWrites = outboxFlashWrites.load();
+}
+
+uint8_t takeUndeliveredFields() {
+    return outboxUndeliveredFields.exchange(0);
+}
@@ -0,0 +1,73 @@
+#ifndef CLOUD_OUTBOX_H
+#define CLOUD_OUTBOX_H
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include "AwsMqttHandler.h"
+#include "CloudTask.h"
+
+// Reported-state updates waiting for the shadow to acknowledge them. PubSubClient
+// only publishes at QoS 0, so each update carries a clientToken and counts as
+// delivered when it comes back on update/accepted or update/rejected. Only the
+// cloud task uses the outbox, apart from takeUndeliveredFields().
+//
+// A newer update removes its fields from older ones, and an update left with no
+// fields is dropped. Each field is then in at most one update, so updates can be
+// sent in any order without older values overwriting newer ones.
+#define OUTBOX_NAMESPACE "soleoutbox"
+#define OUTBOX_VERSION 1
+#define CLOUD_OUTBOX_SIZE 4            // One per reported field at most
+#define CLOUD_INFLIGHT_WINDOW 2        // Updates sent and not yet acknowledged
+#define CLOUD_ACK_TIMEOUT 5000         // Resend an update not acknowledged in this time (ms)
+#define CLOUD_MAX_RETRIES 5            // Sends before an update is given up
+#define CLOUD_REPLAY_INTERVAL 500      // Minimum gap between updates replayed after an outage (ms)
+
+// Outbox entry flags
+#define OUTBOX_IN_FLIGHT 0x01          // Sent, waiting for the acknowledgement
+#define OUTBOX_REPLAY 0x02             // Queued while offline; rate limited after reconnecting
+
+struct OutboxEntry {
+    uint32_t token;                    // clientToken
+    uint32_t postedAt;                 // millis() of the oldest merged update (0 if restored from flash)
+    uint32_t sentAt;
+    CloudDeviceStatus status;
+    uint8_t fields;                    // REPORTED_* bits still to deliver
+    uint8_t flags;                     // OUTBOX_*
+    uint8_t sends;
+};
+
+struct OutboxStats {
+    uint32_t depth;
+    uint32_t inFlight;
+    uint32_t acked;
+    uint32_t rejected;
+    uint32_t retransmits;
+    uint32_t expired;                  // Given up after CLOUD_MAX_RETRIES sends
+    uint32_t superseded;               // Dropped because newer updates covered every field
+    uint32_t replayed;                 // Sends of updates queued while offline
+    uint32_t restored;                 // Updates loaded from flash at boot
+    uint32_t flashWrites;
+};
+
+// Function prototypes
+void initOutbox();
+
+// Queues a report. While offline it is written to flash and later replayed.
+void addOutboxEntry(const CloudDeviceStatus& status, uint8_t fields, uint32_t postedAt);
+
+// Retransmits timed-out updates and sends queued ones within the window
+void runOutbox(AwsMqttHandler& mqtt);
+
+// Removes an acknowledged update; returns false if the token is not outstanding
+bool acknowledgeOutboxEntry(uint32_t token, bool accepted, uint32_t& postedAt);
+
+// Connection changes: in-flight updates are resent after reconnecting
+void setOutboxOnline(bool online);
+
+void getOutboxStats(OutboxStats& stats);
+
+// Any task: REPORTED_* fields of updates given up (expired, rejected or pushed
+// out of a full outbox) since the last call
+uint8_t takeUndeliveredFields();
+
+#endif // CLOUD_OUTBOX_H
@@ -0,0 +1,323 @@
+#include "CloudTask.h"
+#include "AwsMqttHandler.h"
+#include "CloudOutbox.h"
+#include "Logger.h"
+#include <WiFi.h>
+#include <atomic>
+
+// The MQTT client is used only by the cloud task
+AwsMqttHandler awsMqtt;
+
+QueueHandle_t cloudQueue = nullptr;
+TaskHandle_t cloudTaskHandle = nullptr;
+
+// Control loop side
+int16_t lastPostedValues[CLOUD_MSG_TYPE_COUNT] = { -1, -1, -1, -1 };
+char lastPostedColor[7] = "";
+uint32_t cloudPosted = 0;
+uint32_t cloudDrops = 0;
+uint32_t cloudMaxDepth = 0;
+
+// Cloud task side, read by the control loop for reporting
+std::atomic<uint32_t> cloudReports(0);
+std::atomic<uint32_t> cloudAcked(0);
+std::atomic<uint32_t> cloudCoalesced(0);
+std::atomic<uint32_t> cloudConnects(0);
+volatile uint32_t cloudLatencyLast = 0;
+volatile uint32_t cloudLatencyMax = 0;
+volatile uint32_t cloudLatencyAverage = 0;
+uint64_t cloudLatencyTotal = 0;
+volatile uint32_t cloudConnectTimeLast = 0;
+volatile bool cloudConnected = false;
+
+// Reported state waiting for the coalescing window to close (cloud task only)
+CloudDeviceStatus pendingReport;
+uint8_t pendingFields = 0;             // REPORTED_* bits changed since the last publish
+uint32_t pendingSince = 0;             // millis() when the first change arrived
+uint32_t pendingPostedAt = 0;          // postedAt of the oldest merged update
+
+// Folds a queued update into the pending report
+void mergeCloudMessage(const CloudMessage& message) {
+    if (pendingFields == 0) {
+        pendingSince = millis();
+        pendingPostedAt = message.postedAt;
+    } else {
+        cloudCoalesced++;
+    }
+
+    switch (message.type) {
+        case CLOUD_MSG_POD_STATUS:
+            pendingReport.podOpen = message.value;
+            pendingFields |= REPORTED_IS_OPEN;
+            break;
+        case CLOUD_MSG_LED_STATUS:
+            pendingReport.ledOn = message.value;
+            pendingFields |= REPORTED_NIGHTLIGHT;
+            break;
+        case CLOUD_MSG_LED_BRIGHTNESS:
+            pendingReport.brightness = message.value;
+            pendingFields |= REPORTED_BRIGHTNESS;
+            break;
+        case CLOUD_MSG_LED_COLOR:
+            memcpy(pendingReport.color, message.color, sizeof(pendingReport.color));
+            pendingFields |= REPORTED_COLOR;
+            break;
+        case CLOUD_MSG_DEVICE_STATUS:
+            pendingReport = message.device;
+            pendingFields = REPORTED_ALL;
+            break;
+    }
+}
+
+// Shadow acknowledgement, called from awsMqtt.loop()
+void onCloudAck(uint32_t token, bool accepted) {
+    uint32_t postedAt;
+    if (!acknowledgeOutboxEntry(token, accepted, postedAt) || postedAt == 0) {
+        return;
+    }
+
+    uint32_t latency = millis() - postedAt;
+    cloudLatencyLast = latency;
+    if (latency > cloudLatencyMax) {
+        cloudLatencyMax = latency;
+    }
+    cloudLatencyTotal += latency;
+    cloudAcked++;
+    cloudLatencyAverage = cloudLatencyTotal / cloudAcked.load();
+}
+
+// Connects, keeps the MQTT session serviced and publishes queued updates.
+// Updates arriving within CLOUD_COALESCE_WINDOW of each other become one
+// shadow update, which the outbox sends until it is acknowledged. TLS
+// handshakes and socket writes block only this task.
+void runCloudTask() {
+    CloudMessage message;
+
+    bool online = WiFi.status() == WL_CONNECTED;
+    if (!online) {
+        cloudConnected = false;
+    } else {
+        cloudConnected = awsMqtt.isConnected();
+        if (!cloudConnected) {
+            // reconnect() returns at once until its retry interval has passed
+            unsigned long connectStart = millis();
+            if (awsMqtt.reconnect()) {
+                cloudConnectTimeLast = millis() - connectStart;
+                cloudConnects++;
+                LOG_I("Cloud connected in %lu ms", cloudConnectTimeLast);
+                return;
+            }
+        } else {
+            awsMqtt.loop();
+        }
+    }
+    setOutboxOnline(cloudConnected);
+
+    // Merge everything queued, waiting no longer than the open window
+    uint32_t wait = online ? CLOUD_TASK_INTERVAL : CLOUD_WIFI_WAIT;
+    if (pendingFields) {
+        uint32_t elapsed = millis() - pendingSince;
+        uint32_t remaining = elapsed >= CLOUD_COALESCE_WINDOW ? 0 : CLOUD_COALESCE_WINDOW - elapsed;
+        if (remaining < wait) {
+            wait = remaining;
+        }
+    }
+    while (xQueueReceive(cloudQueue, &message, pdMS_TO_TICKS(wait)) == pdTRUE) {
+        mergeCloudMessage(message);
+        wait = 0;
+    }
+
+    if (pendingFields && millis() - pendingSince >= CLOUD_COALESCE_WINDOW) {
+        addOutboxEntry(pendingReport, pendingFields, pendingPostedAt);
+        cloudReports++;
+        pendingFields = 0;
+    }
+
+    if (cloudConnected) {
+        runOutbox(awsMqtt);
+    }
+}
+
+void cloudTask(void* parameter) {
+    awsMqtt.begin();
+
+    for (;;) {
+        runCloudTask();
+    }
+}
+
+void initCloudTask(CommandQueue* commandQueue) {
+    if (!CLOUD_ENABLED || cloudTaskHandle != nullptr) {
+        return;
+    }
+
+    awsMqtt.setCommandQueue(commandQueue);
+    awsMqtt.setAckCallback(onCloudAck);
+    initOutbox();
+
+    cloudQueue = xQueueCreate(CLOUD_QUEUE_SIZE, sizeof(CloudMessage));
+    xTaskCreatePinnedToCore(cloudTask, "cloud", CLOUD_TASK_STACK, nullptr,
+                            CLOUD_TASK_PRIORITY, &cloudTaskHandle, tskNO_AFFINITY);
+
+    LOG_I("Cloud task started (queue %d messages)", CLOUD_QUEUE_SIZE);
+}
+
+TaskHandle_t getCloudTask() {
+    return cloudTaskHandle;
+}
+
+bool postCloudMessage(CloudMessage& message) {
+    if (!cloudQueue) {
+        return false;
+    }
+
+    message.postedAt = millis();
+    if (xQueueSend(cloudQueue, &message, 0) != pdTRUE) {
+        cloudDrops++;
+        return false;
+    }
+    cloudPosted++;
+
+    uint32_t depth = uxQueueMessagesWaiting(cloudQueue);
+    if (depth > cloudMaxDepth) {
+        cloudMaxDepth = depth;
+    }
+    return true;
+}
+
+// Values the shadow never accepted must not suppress the same value later
+void forgetUndeliveredValues() {
+    uint8_t fields = takeUndeliveredFields();
+    if (fields == 0) {
+        return;
+    }
+
+    if (fields & REPORTED_IS_OPEN) {
+        lastPostedValues[CLOUD_MSG_POD_STATUS] = -1;
+    }
+    if (fields & REPORTED_NIGHTLIGHT) {
+        lastPostedValues[CLOUD_MSG_LED_STATUS] = -1;
+    }
+    if (fields & REPORTED_BRIGHTNESS) {
+        lastPostedValues[CLOUD_MSG_LED_BRIGHTNESS] = -1;
+    }
+    if (fields & REPORTED_COLOR) {
+        lastPostedColor[0] = '\0';
+    }
+}
+
+// Posts a single-byte value unless it matches the last one posted
+bool postCloudValue(uint8_t type, uint8_t value) {
+    forgetUndeliveredValues();
+    if (lastPostedValues[type] == value) {
+        return true;
+    }
+
+    CloudMessage message;
+    message.type = type;
+    message.value = value;
+    if (!postCloudMessage(message)) {
+        return false;
+    }
+    lastPostedValues[type] = value;
+    return true;
+}
+
+bool postCloudPodStatus(bool isOpen) {
+    return postCloudValue(CLOUD_MSG_POD_STATUS, isOpen ? 1 : 0);
+}
+
+bool postCloudLedStatus(bool isOn) {
+    return postCloudValue(CLOUD_MSG_LED_STATUS, isOn ? 1 : 0);
+}
+
+bool postCloudLedBrightness(uint8_t brightness) {
+    return postCloudValue(CLOUD_MSG_LED_BRIGHTNESS, brightness);
+}
+
+bool postCloudLedColor(const String& color) {
+    forgetUndeliveredValues();
+    if (color.length() != 6 || strcmp(lastPostedColor, color.c_str()) == 0) {
+        return color.length() == 6;
+    }
+
+    CloudMessage message;
+    message.type = CLOUD_MSG_LED_COLOR;
+    memcpy(message.color, color.c_str(), sizeof(message.color));
+    if (!postCloudMessage(message)) {
+        return false;
+    }
+    memcpy(lastPostedColor, message.color, sizeof(lastPostedColor));
+    return true;
+}
+
+bool postCloudDeviceStatus(bool podOpen, bool ledOn, uint8_t brightness, const String& color) {
+    CloudMessage message;
+    message.type = CLOUD_MSG_DEVICE_STATUS;
+    message.device.podOpen = podOpen;
+    message.device.ledOn = ledOn;
+    message.device.brightness = brightness;
+    strncpy(message.device.color, color.c_str(), sizeof(message.device.color) - 1);
+    message.device.color[sizeof(message.device.color) - 1] = '\0';
+    if (!postCloudMessage(message)) {
+        return false;
+    }
+
+    // Later single-value updates with the same values are redundant
+    lastPostedValues[CLOUD_MSG_POD_STATUS] = podOpen ? 1 : 0;
+    lastPostedValues[CLOUD_MSG_LED_STATUS] = ledOn ? 1 : 0;
+    lastPostedValues[CLOUD_MSG_LED_BRIGHTNESS] = brightness;
+    memcpy(lastPostedColor, message.device.color, sizeof(lastPostedColor));
+    return true;
+}
+
+void getCloudStats(CloudStats& stats) {
+    stats.depth = cloudQueue ? uxQueueMessagesWaiting(cloudQueue) : 0;
+    stats.maxDepth = cloudMaxDepth;
+    stats.posted = cloudPosted;
+    stats.drops = cloudDrops;
+    stats.reports = cloudReports.load();
+    stats.acked = cloudAcked.load();
+    stats.coalesced = cloudCoalesced.load();
+    stats.latencyLast = cloudLatencyLast;
+    stats.latencyMax = cloudLatencyMax;
+    stats.latencyAverage = cloudLatencyAverage;
+    stats.connects = cloudConnects.load();
+    stats.connectTimeLast = cloudConnectTimeLast;
+    stats.connected = cloudConnected;
+}
+
+void printCloudStats() {
+    if (!cloudTaskHandle) {
+        LOG_I("Cloud: disabled");
+        return;
+    }
+
+    CloudStats stats;
+    getCloudStats(stats);
+    LOG_I("Cloud: %s, connects: %u, last connect: %u ms", stats.connected ? "connected" : "disconnected",
+          stats.connects, stats.connectTimeLast);
+    LOG_I("  Queue: %u/%u (max %u), posted: %u, dropped: %u", stats.depth, CLOUD_QUEUE_SIZE, stats.maxDepth,
+          stats.posted, stats.drops);
+    LOG_I("  Shadow updates: %u, coalesced (saved): %u, latency to ack last/avg/max: %u/%u/%u ms",
+          stats.reports, stats.coalesced, stats.latencyLast, stats.latencyAverage, stats.latencyMax);
+
+    OutboxStats outbox;
+    getOutboxStats(outbox);
+    LOG_I("  Outbox: %u (in flight %u), acked: %u, rejected: %u, resent: %u, expired: %u, superseded: %u",
+          outbox.depth, outbox.inFlight, outbox.acked, outbox.rejected, outbox.retransmits, outbox.expired,
+          outbox.superseded);
+    LOG_I("  Replayed: %u, restored at boot: %u, flash writes: %u", outbox.replayed, outbox.restored,
+          outbox.flashWrites);
+
+#if AWS_TLS_SESSION_RESUMPTION
+    const TlsStats& tls = awsMqtt.getTlsStats();
+    LOG_I("  TLS (%s key): full %u (last %u ms, avg %u ms), resumed %u (last %u ms, avg %u ms), failed %u",
+          awsMqtt.getKeyType(), tls.fullHandshakes, tls.fullTimeLast,
+          tls.fullHandshakes > 0 ? tls.fullTimeTotal / tls.fullHandshakes : 0, tls.resumedHandshakes,
+          tls.resumedTimeLast, tls.resumedHandshakes > 0 ? tls.resumedTimeTotal / tls.resumedHandshakes : 0,
+          tls.failedHandshakes);
+    LOG_I("  TLS session: %s%s", tls.sessionCached ? "cached" : "none",
+          tls.sessionFromRtc ? " (restored from RTC at boot)" : "");
+#endif
+}
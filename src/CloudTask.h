@@ -0,0 +1,87 @@
+#ifndef CLOUD_TASK_H
+#define CLOUD_TASK_H
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include "CommandQueue.h"
+
+// Cloud reporting (override with -DCLOUD_ENABLED=0 to build without AWS IoT)
+#ifndef CLOUD_ENABLED
+#define CLOUD_ENABLED 1
+#endif
+
+// Cloud task configuration
+#define CLOUD_QUEUE_SIZE 16            // State updates waiting to be published
+#define CLOUD_TASK_STACK 8192          // TLS handshakes need a large stack (bytes)
+#define CLOUD_TASK_PRIORITY 1          // Same as the Arduino loop task
+#define CLOUD_TASK_INTERVAL 20         // Longest wait for a queued update between MQTT loop() calls (ms)
+#define CLOUD_COALESCE_WINDOW 100      // Updates this close together share one shadow update (ms)
+#define CLOUD_WIFI_WAIT 500            // Poll interval while WiFi is down (ms)
+
+// Cloud message types
+#define CLOUD_MSG_POD_STATUS 0         // value: 1 = open, 0 = closed
+#define CLOUD_MSG_LED_STATUS 1         // value: 1 = on, 0 = off
+#define CLOUD_MSG_LED_BRIGHTNESS 2     // value: 0-100
+#define CLOUD_MSG_LED_COLOR 3          // color: 6-digit hex
+#define CLOUD_MSG_TYPE_COUNT 4
+#define CLOUD_MSG_DEVICE_STATUS 4      // device: full reported state (not deduplicated)
+
+struct CloudDeviceStatus {
+    bool podOpen;
+    bool ledOn;
+    uint8_t brightness;
+    char color[7];
+};
+
+// State update posted by the control loop; the cloud task merges these into
+// one reported-state document per coalescing window
+struct CloudMessage {
+    uint8_t type;                      // CLOUD_MSG_*
+    uint32_t postedAt;                 // millis() when queued
+    union {
+        uint8_t value;
+        char color[7];
+        CloudDeviceStatus device;
+    };
+};
+
+struct CloudStats {
+    uint32_t depth;                    // Messages waiting now
+    uint32_t maxDepth;
+    uint32_t posted;
+    uint32_t drops;                    // Rejected because the queue was full
+    uint32_t reports;                  // Shadow updates handed to the outbox
+    uint32_t acked;                    // Accepted or rejected, with a known post time
+    uint32_t coalesced;                // Updates merged into another one's shadow update (messages saved)
+    uint32_t latencyLast;              // Oldest merged update posted to acknowledged (ms)
+    uint32_t latencyMax;
+    uint32_t latencyAverage;
+    uint32_t connects;
+    uint32_t connectTimeLast;          // TLS and MQTT connect (ms)
+    bool connected;
+};
+
+// Function prototypes
+// Desired state from shadow deltas is pushed to commandQueue
+void initCloudTask(CommandQueue* commandQueue);
+TaskHandle_t getCloudTask();
+
+// One pass of the cloud task: connect or service MQTT, merge queued updates
+// and run the outbox. Blocks for at most CLOUD_WIFI_WAIT.
+void runCloudTask();
+
+// Control loop side - never block; return false if the update was dropped.
+// Values equal to the last one posted are skipped.
+bool postCloudPodStatus(bool isOpen);
+bool postCloudLedStatus(bool isOn);
+bool postCloudLedBrightness(uint8_t brightness);
+bool postCloudLedColor(const String& color);
+
+// Reports every value, even unchanged ones, so the shadow can clear a delta
+bool postCloudDeviceStatus(bool podOpen, bool ledOn, uint8_t brightness, const String& color);
+
+void getCloudStats(CloudStats& stats);
+void printCloudStats();
+
+#endif // CLOUD_TASK_H
@@ -0,0 +1,120 @@
+#include "CommandDispatch.h"
+#include "CommandTrace.h"
+#include "LEDControl.h"
+#include "MotorControl.h"
+#include "SystemSettings.h"
+#include "CloudTask.h"
+#include "Logger.h"
+
+// State owned by the control loop (main.cpp)
+bool* dispatchPodOpen = nullptr;
+bool* dispatchChildLock = nullptr;
+BLEControl* dispatchBle = nullptr;
+
+// Commands written over BLE or received as shadow deltas
+CommandQueue* dispatchBleQueue = nullptr;
+CommandQueue* dispatchMqttQueue = nullptr;
+uint32_t commandsApplied = 0;
+
+void initCommandDispatch(bool* podOpen, bool* childLock, BLEControl* ble,
+                         CommandQueue* bleQueue, CommandQueue* mqttQueue) {
+    dispatchPodOpen = podOpen;
+    dispatchChildLock = childLock;
+    dispatchBle = ble;
+    dispatchBleQueue = bleQueue;
+    dispatchMqttQueue = mqttQueue;
+}
+
+void runCommandQueue() {
+    CommandQueue* queues[] = { dispatchBleQueue, dispatchMqttQueue };
+    PodCommand commands[CMD_TYPE_COUNT];
+    
+    for (uint8_t q = 0; q < 2; q++) {
+        uint8_t count = queues[q]->popLatest(commands, CMD_TYPE_COUNT);
+        
+        for (uint8_t i = 0; i < count; i++) {
+            applyCommand(commands[i]);
+        }
+        commandsApplied += count;
+    }
+}
+
+uint32_t getCommandsApplied() {
+    return commandsApplied;
+}
+
+void printCommandStats() {
+    LOG_I("Commands received: %u BLE, %u MQTT, applied: %u, coalesced: %u, dropped: %u",
+          dispatchBleQueue->getReceivedCount(), dispatchMqttQueue->getReceivedCount(), commandsApplied,
+          dispatchBleQueue->getCoalescedCount() + dispatchMqttQueue->getCoalescedCount(),
+          dispatchBleQueue->getDropCount() + dispatchMqttQueue->getDropCount());
+    LOG_I("Settings writes: %u, deferred: %u", getSettingsWriteCount(), getSettingsDeferredCount());
+}
+
+void applyCommand(const PodCommand& command) {
+    switch (command.type) {
+        case CMD_SET_POD_OPEN:
+            // The door is already heading that way; nothing will be actuated for this command
+            if (*dispatchPodOpen == (command.value != 0)) {
+                traceCommandDiscarded(command.traceId);
+                break;
+            }
+            traceCommandDequeued(TRACE_TARGET_DOOR, command.traceId);
+            *dispatchPodOpen = command.value;
+            break;
+            
+        case CMD_SET_DOOR_POSITION:
+            setDoorPosition(command.value);
+            dispatchBle->updateDoorPosition(command.value);
+            break;
+            
+        case CMD_SET_LED_STATE:
+            traceCommandDequeued(TRACE_TARGET_LED, command.traceId);
+            traceCommandStage(TRACE_TARGET_LED, TRACE_STAGE_DECIDED);
+            setLEDState(command.value);
+            break;
+            
+        case CMD_SET_LED_BRIGHTNESS:
+            traceCommandDequeued(TRACE_TARGET_LED, command.traceId);
+            traceCommandStage(TRACE_TARGET_LED, TRACE_STAGE_DECIDED);
+            if (command.value == 0) {
+                // Brightness 0 means turn LED off
+                setLEDState(LED_STATE_OFF);
+                setLEDBrightness(0);  // Store the brightness value
+            } else {
+                // Brightness > 0 means turn LED on with that brightness
+                setLEDState(LED_STATE_ON);
+                setLEDBrightness(command.value);
+            }
+            break;
+            
+        case CMD_SET_LED_COLOR:
+            // The new color is only stored while the LED is off
+            if (getLEDState() == LED_STATE_ON) {
+                traceCommandDequeued(TRACE_TARGET_LED, command.traceId);
+                traceCommandStage(TRACE_TARGET_LED, TRACE_STAGE_DECIDED);
+            } else {
+                traceCommandDiscarded(command.traceId);
+            }
+            setLEDColor(command.color);
+            break;
+            
+        case CMD_SET_CHILD_LOCK:
+            *dispatchChildLock = command.value;
+            break;
+            
+        case CMD_FRAME_ACK:
+            dispatchBle->updateFrameAck(command.sequence);
+            break;
+            
+        case CMD_SHADOW_ACK:
+            // LED commands are already applied. The door has only been commanded, so
+            // report its target, as runDoorControl() does.
+            postCloudDeviceStatus(*dispatchPodOpen, getLEDState() == LED_STATE_ON, getLEDBrightness(), getLEDColor());
+            break;
+            
+        default:
+            LOG_W("Unknown command type: %u", command.type);
+            break;
+    }
+}
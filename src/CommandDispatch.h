@@ -0,0 +1,22 @@
+#ifndef COMMAND_DISPATCH_H
+#define COMMAND_DISPATCH_H
+
+#include <Arduino.h>
+#include "CommandQueue.h"
+#include "BLEControl.h"
+
+// Function prototypes
+// Commands change the flags and notify through ble; both queues are drained
+// by runCommandQueue() in the control loop
+void initCommandDispatch(bool* podOpen, bool* childLock, BLEControl* ble,
+                         CommandQueue* bleQueue, CommandQueue* mqttQueue);
+
+// Apply the newest queued command of each type; slider bursts collapse to one
+// LED update per tick
+void runCommandQueue();
+void applyCommand(const PodCommand& command);
+
+uint32_t getCommandsApplied();     // Commands applied after coalescing
+void printCommandStats();
+
+#endif // COMMAND_DISPATCH_H
@@ -0,0 +1,99 @@
+#include "CommandQueue.h"
+
+CommandQueue::CommandQueue() : head(0), tail(0), drops(0), received(0), coalesced(0) {
+}
+
+bool CommandQueue::push(const PodCommand& command) {
+    uint32_t currentHead = head.load(std::memory_order_relaxed);
+    uint32_t currentTail = tail.load(std::memory_order_acquire);
+
+    if (currentHead - currentTail >= COMMAND_QUEUE_SIZE) {
+        drops.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    slots[currentHead & (COMMAND_QUEUE_SIZE - 1)] = command;
+
+    // Publish the slot to the consumer
+    head.store(currentHead + 1, std::memory_order_release);
+    received.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+bool CommandQueue::pushBatch(const PodCommand* commands, uint8_t count) {
+    uint32_t currentHead = head.load(std::memory_order_relaxed);
+    uint32_t currentTail = tail.load(std::memory_order_acquire);
+
+    if (COMMAND_QUEUE_SIZE - (currentHead - currentTail) < count) {
+        drops.fetch_add(count, std::memory_order_relaxed);
+        return false;
+    }
+
+    for (uint8_t i = 0; i < count; i++) {
+        slots[(currentHead + i) & (COMMAND_QUEUE_SIZE - 1)] = commands[i];
+    }
+
+    // Publish the whole batch at once
+    head.store(currentHead + count, std::memory_order_release);
+    received.fetch_add(count, std::memory_order_relaxed);
+    return true;
+}
+
+bool CommandQueue::pop(PodCommand& command) {
+    uint32_t currentTail = tail.load(std::memory_order_relaxed);
+    uint32_t currentHead = head.load(std::memory_order_acquire);
+
+    if (currentTail == currentHead) {
+        return false;
+    }
+
+    command = slots[currentTail & (COMMAND_QUEUE_SIZE - 1)];
+
+    // Hand the slot back to the producer
+    tail.store(currentTail + 1, std::memory_order_release);
+    return true;
+}
+
+uint8_t CommandQueue::popLatest(PodCommand* commands, uint8_t maxCommands) {
+    uint8_t count = 0;
+    PodCommand command;
+
+    while (pop(command)) {
+        // Drop an older pending command of the same type
+        for (uint8_t i = 0; i < count; i++) {
+            if (commands[i].type == command.type) {
+                memmove(&commands[i], &commands[i + 1], (count - i - 1) * sizeof(PodCommand));
+                count--;
+                coalesced++;
+                break;
+            }
+        }
+
+        if (count < maxCommands) {
+            commands[count++] = command;
+        } else {
+            // More distinct types than the caller has room for - keep the newest
+            memmove(&commands[0], &commands[1], (count - 1) * sizeof(PodCommand));
+            commands[count - 1] = command;
+            coalesced++;
+        }
+    }
+
+    return count;
+}
+
+uint32_t CommandQueue::size() const {
+    return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+}
+
+uint32_t CommandQueue::getDropCount() const {
+    return drops.load(std::memory_order_relaxed);
+}
+
+uint32_t CommandQueue::getReceivedCount() const {
+    return received.load(std::memory_order_relaxed);
+}
+
+uint32_t CommandQueue::getCoalescedCount() const {
+    return coalesced;
+}
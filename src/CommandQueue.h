@@ -0,0 +1,70 @@
+#ifndef COMMAND_QUEUE_H
+#define COMMAND_QUEUE_H
+
+#include <Arduino.h>
+#include <atomic>
+
+// Queue configuration
+#define COMMAND_QUEUE_SIZE 32      // Slots per queue (must be a power of two)
+
+// Command types
+#define CMD_NONE 0
+#define CMD_SET_POD_OPEN 1         // value: 1 = open, 0 = close
+#define CMD_SET_DOOR_POSITION 2    // value: 50 or 100
+#define CMD_SET_LED_STATE 3        // value: LED_STATE_ON / LED_STATE_OFF
+#define CMD_SET_LED_BRIGHTNESS 4   // value: 0-100 (0 turns the LED off)
+#define CMD_SET_LED_COLOR 5        // color: 6-digit uppercase hex
+#define CMD_SET_CHILD_LOCK 6       // value: 1 = locked, 0 = unlocked
+#define CMD_FRAME_ACK 7            // sequence: command frame applied (sent after the frame's commands)
+#define CMD_SHADOW_ACK 8           // Shadow delta applied: report the current state
+#define CMD_TYPE_COUNT 9
+
+// Typed command passed from a producer task into the control loop
+struct PodCommand {
+    uint8_t type;                  // CMD_*
+    uint8_t source;                // TRACE_SOURCE_*
+    uint32_t traceId;              // Trace ID from traceCommandReceived() (0 if untraced)
+    union {
+        uint8_t value;
+        char color[7];
+        uint16_t sequence;
+    };
+};
+
+// Bounded lock-free single-producer/single-consumer queue.
+// One producer task (e.g. the BLE stack or the cloud task) pushes; the control loop pops.
+class CommandQueue {
+private:
+    PodCommand slots[COMMAND_QUEUE_SIZE];
+    std::atomic<uint32_t> head;    // Next slot to write (producer)
+    std::atomic<uint32_t> tail;    // Next slot to read (consumer)
+    std::atomic<uint32_t> drops;   // Commands rejected because the queue was full
+    std::atomic<uint32_t> received; // Commands accepted by push()
+    uint32_t coalesced;            // Commands replaced by a newer one of the same type (consumer only)
+
+public:
+    CommandQueue();
+
+    // Producer side - never blocks; returns false if the queue is full
+    bool push(const PodCommand& command);
+
+    // Producer side - pushes all commands or none; the consumer sees the whole
+    // batch in the same pop pass
+    bool pushBatch(const PodCommand* commands, uint8_t count);
+
+    // Consumer side - returns false if the queue is empty
+    bool pop(PodCommand& command);
+
+    // Consumer side - drains the queue keeping only the newest command of each
+    // type. Returns the number written to commands, ordered by arrival of the kept
+    // commands so an LED state change and a later brightness change still apply
+    // in the order they were sent.
+    uint8_t popLatest(PodCommand* commands, uint8_t maxCommands);
+
+    uint32_t size() const;
+    uint32_t getDropCount() const;
+    uint32_t getReceivedCount() const;
+    uint32_t getCoalescedCount() const;
+};
+
+#endif // COMMAND_QUEUE_H
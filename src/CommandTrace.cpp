@@ -0,0 +1,188 @@
+#include "CommandTrace.h"
+#include <esp_timer.h>
+#include "Logger.h"
+
+// Upper bound (milliseconds) of each latency bucket; the last bucket is open-ended
+const uint32_t TraceBucketLimits[TRACE_HISTOGRAM_BUCKETS] = {
+    1, 2, 5, 10, 20, 50, 100, UINT32_MAX
+};
+
+// Names for reports
+const char* TraceSourceNames[TRACE_SOURCE_COUNT] = { "ble", "button", "mqtt" };
+
+// A command in flight towards its target
+struct PendingTrace {
+    uint32_t id;
+    uint8_t source;
+    uint8_t nextStage;                     // Next stage expected for this trace
+    uint32_t stamps[TRACE_STAGE_COUNT];    // esp_timer microseconds per stage
+};
+
+PendingTrace pendingTraces[TRACE_TARGET_COUNT];
+volatile uint8_t pendingTraceMask = 0;    // Bit per target with a trace in flight
+volatile uint8_t dequeuedTraceMask = 0;   // Bit per target whose trace the control loop has picked up
+uint32_t nextTraceId = 1;
+
+TraceLatencyStats traceStats[TRACE_SOURCE_COUNT];
+
+// Commands are received in the BLE task and completed in the loop task
+portMUX_TYPE traceMux = portMUX_INITIALIZER_UNLOCKED;
+
+uint32_t traceCommandReceived(uint8_t source, uint8_t target) {
+    if (source >= TRACE_SOURCE_COUNT || target >= TRACE_TARGET_COUNT) {
+        return 0;
+    }
+
+    uint32_t now = (uint32_t)esp_timer_get_time();
+
+    portENTER_CRITICAL(&traceMux);
+    PendingTrace& trace = pendingTraces[target];
+
+    // A newer command replaces one that has not reached its output yet
+    if (pendingTraceMask & (1 << target)) {
+        traceStats[trace.source].superseded++;
+    }
+
+    uint32_t id = nextTraceId++;
+    trace.id = id;
+    trace.source = source;
+    trace.nextStage = TRACE_STAGE_DEQUEUED;
+    trace.stamps[TRACE_STAGE_RECEIVED] = now;
+    pendingTraceMask |= (1 << target);
+    dequeuedTraceMask &= ~(1 << target);
+    portEXIT_CRITICAL(&traceMux);
+
+    return id;
+}
+
+void traceCommandDequeued(uint8_t target, uint32_t traceId) {
+    if (traceId == 0 || target >= TRACE_TARGET_COUNT) {
+        return;
+    }
+
+    uint32_t now = (uint32_t)esp_timer_get_time();
+
+    portENTER_CRITICAL(&traceMux);
+    PendingTrace& trace = pendingTraces[target];
+
+    // A superseded command no longer owns the trace
+    if ((pendingTraceMask & (1 << target)) && trace.id == traceId && trace.nextStage == TRACE_STAGE_DEQUEUED) {
+        trace.stamps[TRACE_STAGE_DEQUEUED] = now;
+        trace.nextStage = TRACE_STAGE_DEQUEUED + 1;
+        dequeuedTraceMask |= (1 << target);
+    }
+    portEXIT_CRITICAL(&traceMux);
+}
+
+void traceCommandDiscarded(uint32_t traceId) {
+    if (traceId == 0) {
+        return;
+    }
+
+    portENTER_CRITICAL(&traceMux);
+    for (uint8_t target = 0; target < TRACE_TARGET_COUNT; target++) {
+        PendingTrace& trace = pendingTraces[target];
+        if ((pendingTraceMask & (1 << target)) && trace.id == traceId) {
+            traceStats[trace.source].discarded++;
+            pendingTraceMask &= ~(1 << target);
+            dequeuedTraceMask &= ~(1 << target);
+        }
+    }
+    portEXIT_CRITICAL(&traceMux);
+}
+
+void traceCommandStage(uint8_t target, uint8_t stage) {
+    // Fast path: nothing picked up (called every loop iteration)
+    if (target >= TRACE_TARGET_COUNT || !(dequeuedTraceMask & (1 << target))) {
+        return;
+    }
+
+    uint32_t now = (uint32_t)esp_timer_get_time();
+    PendingTrace completed;
+    bool isComplete = false;
+
+    portENTER_CRITICAL(&traceMux);
+    PendingTrace& trace = pendingTraces[target];
+
+    // Stages are recorded once, in order; earlier stages that were skipped take this timestamp
+    if ((dequeuedTraceMask & (1 << target)) && stage >= trace.nextStage) {
+        for (uint8_t s = trace.nextStage; s <= stage; s++) {
+            trace.stamps[s] = now;
+        }
+        trace.nextStage = stage + 1;
+
+        if (stage == TRACE_STAGE_ACTUATED) {
+            completed = trace;
+            isComplete = true;
+            pendingTraceMask &= ~(1 << target);
+            dequeuedTraceMask &= ~(1 << target);
+        }
+    }
+    portEXIT_CRITICAL(&traceMux);
+
+    if (!isComplete) {
+        return;
+    }
+
+    // Accumulate latency for the command's source (loop task only)
+    TraceLatencyStats& stats = traceStats[completed.source];
+    uint32_t latency = completed.stamps[TRACE_STAGE_ACTUATED] - completed.stamps[TRACE_STAGE_RECEIVED];
+
+    stats.count++;
+    stats.totalMicros += latency;
+    if (latency > stats.maxMicros) {
+        stats.maxMicros = latency;
+    }
+    for (uint8_t s = TRACE_STAGE_DEQUEUED; s < TRACE_STAGE_COUNT; s++) {
+        stats.stageMicros[s] += completed.stamps[s] - completed.stamps[s - 1];
+    }
+
+    uint32_t latencyMs = latency / 1000;
+    uint8_t bucket = 0;
+    while (bucket < TRACE_HISTOGRAM_BUCKETS - 1 && latencyMs >= TraceBucketLimits[bucket]) {
+        bucket++;
+    }
+    stats.histogram[bucket]++;
+    stats.lastTraceId = completed.id;
+
+    LOG_D("Trace %u (%s): %u us (dequeue %u, decide %u, actuate %u)", completed.id,
+          TraceSourceNames[completed.source], latency,
+          completed.stamps[TRACE_STAGE_DEQUEUED] - completed.stamps[TRACE_STAGE_RECEIVED],
+          completed.stamps[TRACE_STAGE_DECIDED] - completed.stamps[TRACE_STAGE_DEQUEUED],
+          completed.stamps[TRACE_STAGE_ACTUATED] - completed.stamps[TRACE_STAGE_DECIDED]);
+}
+
+const TraceLatencyStats& getTraceStats(uint8_t source) {
+    return traceStats[source < TRACE_SOURCE_COUNT ? source : 0];
+}
+
+void resetTraceStats() {
+    portENTER_CRITICAL(&traceMux);
+    memset(traceStats, 0, sizeof(traceStats));
+    portEXIT_CRITICAL(&traceMux);
+}
+
+void printTraceReport() {
+    LOG_I("--- Command latency (us) ---");
+
+    for (uint8_t i = 0; i < TRACE_SOURCE_COUNT; i++) {
+        const TraceLatencyStats& stats = traceStats[i];
+        if (stats.count == 0 && stats.superseded == 0 && stats.discarded == 0) {
+            continue;
+        }
+
+        uint32_t count = stats.count > 0 ? stats.count : 1;
+        LOG_I("%s: n=%u avg=%u max=%u superseded=%u discarded=%u", TraceSourceNames[i], stats.count,
+              (uint32_t)(stats.totalMicros / count), stats.maxMicros, stats.superseded, stats.discarded);
+        LOG_I("  avg dequeue=%u decide=%u actuate=%u",
+              (uint32_t)(stats.stageMicros[TRACE_STAGE_DEQUEUED] / count),
+              (uint32_t)(stats.stageMicros[TRACE_STAGE_DECIDED] / count),
+              (uint32_t)(stats.stageMicros[TRACE_STAGE_ACTUATED] / count));
+        LOG_I("  <1ms:%u <2:%u <5:%u <10:%u", stats.histogram[0], stats.histogram[1],
+              stats.histogram[2], stats.histogram[3]);
+        LOG_I("  <20:%u <50:%u <100:%u >=100:%u", stats.histogram[4], stats.histogram[5],
+              stats.histogram[6], stats.histogram[7]);
+    }
+
+    LOG_I("----------------------------");
+}
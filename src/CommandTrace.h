@@ -0,0 +1,55 @@
+#ifndef COMMAND_TRACE_H
+#define COMMAND_TRACE_H
+
+#include <Arduino.h>
+
+// Command sources
+#define TRACE_SOURCE_BLE 0
+#define TRACE_SOURCE_BUTTON 1
+#define TRACE_SOURCE_MQTT 2
+#define TRACE_SOURCE_COUNT 3
+
+// Command targets (one command in flight per target)
+#define TRACE_TARGET_DOOR 0
+#define TRACE_TARGET_LED 1
+#define TRACE_TARGET_COUNT 2
+#define TRACE_TARGET_NONE 0xFF     // Command is not traced
+
+// Trace stages, in the order a command passes through them
+#define TRACE_STAGE_RECEIVED 0     // Command accepted from BLE, button or MQTT
+#define TRACE_STAGE_DEQUEUED 1     // Control loop picked the command up
+#define TRACE_STAGE_DECIDED 2      // Control logic chose the action
+#define TRACE_STAGE_ACTUATED 3     // GPIO / LED output written (completes the trace)
+#define TRACE_STAGE_COUNT 4
+
+// Latency histogram
+#define TRACE_HISTOGRAM_BUCKETS 8  // Bucket limits in TraceBucketLimits (milliseconds)
+
+// Per-source latency accumulator (receive to actuation)
+struct TraceLatencyStats {
+    uint32_t count;                                    // Completed traces
+    uint32_t superseded;                               // Traces replaced by a newer command before completing
+    uint32_t discarded;                                // Commands dropped from a full queue or that changed nothing
+    uint64_t totalMicros;                              // Sum of end-to-end latencies
+    uint32_t maxMicros;                                // Worst end-to-end latency
+    uint64_t stageMicros[TRACE_STAGE_COUNT];           // Sum of time spent reaching each stage
+    uint32_t histogram[TRACE_HISTOGRAM_BUCKETS];       // Completed traces per latency bucket
+    uint32_t lastTraceId;                              // ID of the most recent completed trace
+};
+
+// Function prototypes
+uint32_t traceCommandReceived(uint8_t source, uint8_t target);
+
+// The control loop picked up the command with this trace ID (0 = untraced).
+// Later stages only apply to a trace that has been picked up, so a command
+// still waiting in a queue is not completed by unrelated output writes.
+void traceCommandDequeued(uint8_t target, uint32_t traceId);
+void traceCommandStage(uint8_t target, uint8_t stage);
+
+// The command will never reach its output (queue full, or already in that state)
+void traceCommandDiscarded(uint32_t traceId);
+const TraceLatencyStats& getTraceStats(uint8_t source);
+void resetTraceStats();
+void printTraceReport();
+
+#endif // COMMAND_TRACE_H
@@ -1,4 +1,6 @@
 #include "LEDControl.h"
+#include "Logger.h"
+#include "CommandTrace.h"
 
 // Create the FastLED array
 CRGB leds[NUM_LEDS];
@@ -23,7 +25,7 @@ void initLEDs() {
     // Initialize LED button pin as input with internal pull-up resistor
     pinMode(LED_BTN, INPUT_PULLUP);
     
-    Serial.println("LED Control Initialized with FastLED!");
+    LOG_I("LED Control Initialized with FastLED!");
 }
 
 void handleLEDButton(bool childLockOn) {
@@ -37,7 +39,10 @@ void handleLEDButton(bool childLockOn) {
 
     // If the button was just pressed (transition from not pressed to pressed)
     if (ledBtnState == LOW && previousLedBtnState == HIGH) {
-        Serial.println("LED Button Pressed");
+        LOG_I("LED Button Pressed");
+        uint32_t traceId = traceCommandReceived(TRACE_SOURCE_BUTTON, TRACE_TARGET_LED);
+        traceCommandDequeued(TRACE_TARGET_LED, traceId);
+        traceCommandStage(TRACE_TARGET_LED, TRACE_STAGE_DECIDED);
         
         // Toggle the LED state
         setLEDState(lightState == LED_STATE_OFF ? LED_STATE_ON : LED_STATE_OFF);
@@ -52,7 +57,7 @@ void hexToRGB(const String& hexColor, uint8_t& r, uint8_t& g, uint8_t& b) {
     // Ensure we have a 6-character hex string
     String processedHex = hexColor;
     if (processedHex.length() != 6) {
-        Serial.println("Invalid hex color length in hexToRGB");
+        LOG_W("Invalid hex color length in hexToRGB");
         r = g = b = 0;
         return;
     }
@@ -72,8 +77,9 @@ void updateLEDColor() {
         // Set the LED color using FastLED
         leds[0] = CRGB(r, g, b);
         FastLED.show();
+        traceCommandStage(TRACE_TARGET_LED, TRACE_STAGE_ACTUATED);
         
-        Serial.printf("LED updated: R:%d G:%d B:%d (Brightness: %d%%)\n", r, g, b, ledBrightness);
+        LOG_D("LED updated: R:%d G:%d B:%d (Brightness: %d%%)", r, g, b, ledBrightness);
     }
 }
 
@@ -84,12 +90,13 @@ void setLEDState(uint8_t state) {
     if (lightState == LED_STATE_ON) {
         // Use the current stored color
         updateLEDColor();
-        Serial.println("LED turned ON");
+        LOG_D("LED turned ON");
     } else {
         // Turn off the LED
         leds[0] = CRGB::Black;
         FastLED.show();
-        Serial.println("LED turned OFF");
+        traceCommandStage(TRACE_TARGET_LED, TRACE_STAGE_ACTUATED);
+        LOG_D("LED turned OFF");
     }
     
     // Save the state change
@@ -117,11 +124,11 @@ void setLEDBrightness(uint8_t brightness) {
         uint8_t scaledBrightness = map(ledBrightness, 1, 100, 5, 255);
         FastLED.setBrightness(scaledBrightness);
         updateLEDColor(); // This will show the color with new brightness
-        Serial.printf("LED brightness set to: %d%% (scaled to %d/255)\n", ledBrightness, scaledBrightness);
+        LOG_D("LED brightness set to: %d%% (scaled to %d/255)", ledBrightness, scaledBrightness);
     } else {
         // If brightness is 0 or LED is off, just store the brightness value
         // The actual LED state is handled elsewhere
-        Serial.printf("LED brightness set to: %d%%\n", ledBrightness);
+        LOG_D("LED brightness set to: %d%%", ledBrightness);
     }
     
     // Save only the brightness setting
@@ -132,47 +139,58 @@ uint8_t getLEDBrightness() {
     return ledBrightness;
 }
 
-void setLEDColor(String colorHex) {
-    String rgbColor;
+// Validate a 6-char RGB or 8-char ARGB hex string and copy the uppercase
+// 6-char RGB part into rgbColor (7 bytes including terminator)
+bool parseLEDColor(const char* colorHex, char* rgbColor) {
+    size_t length = strlen(colorHex);
+    const char* rgbStart;
     
     // Process the incoming color
-    if (colorHex.length() == 8) {  
-        // Has alpha channel (e.g., "FF0019FF") - remove first 2 characters
-        rgbColor = colorHex.substring(2);
-        Serial.printf("8-char HEX received, extracted RGB: %s\n", rgbColor.c_str());
+    if (length == 8) {  
+        // Has alpha channel (e.g., "FF0019FF") - skip first 2 characters
+        rgbStart = colorHex + 2;
     } 
-    else if (colorHex.length() == 6) {  
+    else if (length == 6) {  
         // Already a 6-digit hex
-        rgbColor = colorHex;
-        Serial.printf("6-char HEX received: %s\n", rgbColor.c_str());
+        rgbStart = colorHex;
     }
     else {
-        Serial.printf("Invalid color format! Expected 6 or 8 character hex string, got %d characters: %s\n", 
-                     colorHex.length(), colorHex.c_str());
-        return;
+        LOG_W("Invalid color format! Expected 6 or 8 character hex string, got %d characters: %s", 
+              length, colorHex);
+        return false;
     }
     
     // Validate hex characters
-    for (int i = 0; i < rgbColor.length(); i++) {
-        char c = rgbColor.charAt(i);
+    for (int i = 0; i < 6; i++) {
+        char c = rgbStart[i];
         if (!((c >= '0' && c <= '9') || (c >= 'A' && c <= 'F') || (c >= 'a' && c <= 'f'))) {
-            Serial.printf("Invalid hex character '%c' in color string: %s\n", c, rgbColor.c_str());
-            return;
+            LOG_W("Invalid hex character '%c' in color string: %s", c, colorHex);
+            return false;
         }
+        rgbColor[i] = toupper(c);
     }
+    rgbColor[6] = '\0';
     
-    // Convert and validate RGB values
-    uint8_t r, g, b;
-    hexToRGB(rgbColor, r, g, b);
+    return true;
+}
+
+void setLEDColor(String colorHex) {
+    char rgbColor[7];
+    if (!parseLEDColor(colorHex.c_str(), rgbColor)) {
+        return;
+    }
     
-    // Store the new color (convert to uppercase for consistency)
+    // Store the new color
     ledColorHex = rgbColor;
-    ledColorHex.toUpperCase();
+    
+    // Convert for logging
+    uint8_t r, g, b;
+    hexToRGB(ledColorHex, r, g, b);
     
     // Update the physical LED if it's currently on
     updateLEDColor();
     
-    Serial.printf("LED color set to R:%d G:%d B:%d (HEX: %s)\n", r, g, b, ledColorHex.c_str());
+    LOG_D("LED color set to R:%d G:%d B:%d (HEX: %s)", r, g, b, ledColorHex);
     
     // Save the color setting to persistent storage
     saveLEDColor(ledColorHex);
@@ -28,6 +28,7 @@ String getLEDColor();
 
 // Helper function prototypes
 void hexToRGB(const String& hexColor, uint8_t& r, uint8_t& g, uint8_t& b);
+bool parseLEDColor(const char* colorHex, char* rgbColor);
 void updateLEDColor();
 
 // External variable declarations
@@ -0,0 +1,255 @@
+#include "Logger.h"
+
+// Ring buffer slot: bounded multi-producer queue with per-slot sequence numbers.
+// A producer claims a position with a single CAS, fills the record in place and
+// publishes it by advancing the slot sequence; the drain task is the only consumer.
+//
+// Sequences are stored relative to the slot index, so the zero-initialized ring
+// is already valid: logging works before initLogger() and from other static
+// constructors, with no initialization order to get wrong.
+struct LogSlot {
+    LogRecord record;                  // Must stay first (logCommit casts back to the slot)
+    std::atomic<uint32_t> sequence;    // Sequence minus the slot index
+};
+
+LogSlot logSlots[LOG_QUEUE_SIZE];
+std::atomic<uint32_t> logEnqueuePos(0);
+uint32_t logDequeuePos = 0;
+
+// Statistics
+std::atomic<uint32_t> logDropCount(0);
+std::atomic<uint32_t> logRecordCount(0);
+uint32_t logReportedDrops = 0;
+
+// Drain task handle
+TaskHandle_t logDrainTaskHandle = nullptr;
+
+// Level prefixes for formatted output
+const char* LogLevelNames[] = { "", "E", "W", "I", "D" };
+
+LogRecord* logClaim(uint8_t level, const char* format) {
+    uint32_t pos = logEnqueuePos.load(std::memory_order_relaxed);
+
+    for (;;) {
+        uint32_t index = pos & (LOG_QUEUE_SIZE - 1);
+        LogSlot* slot = &logSlots[index];
+        uint32_t sequence = slot->sequence.load(std::memory_order_acquire) + index;
+        int32_t diff = (int32_t)(sequence - pos);
+
+        if (diff == 0) {
+            // Slot is free for this position - try to claim it
+            if (logEnqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                LogRecord* record = &slot->record;
+                record->format = format;
+                record->timestamp = xTaskGetTickCount() * portTICK_PERIOD_MS;
+                record->level = level;
+                record->argCount = 0;
+                record->argTypes = 0;
+                record->poolUsed = 0;
+                return record;
+            }
+            // CAS failed: pos was reloaded, retry
+        } else if (diff < 0) {
+            // Ring is full - never block the caller
+            logDropCount.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        } else {
+            pos = logEnqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+void logCommit(LogRecord* record) {
+    LogSlot* slot = reinterpret_cast<LogSlot*>(record);
+
+    // Publish: the consumer waits for sequence == position + 1 (the slot index
+    // offset is unchanged by the increment)
+    uint32_t sequence = slot->sequence.load(std::memory_order_relaxed);
+    slot->sequence.store(sequence + 1, std::memory_order_release);
+    logRecordCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+void logPutString(LogRecord* record, const char* value) {
+    uint8_t index = record->argCount++;
+    uint8_t offset = record->poolUsed;
+
+    // Copy as much of the string as fits; the pool is always null-terminated.
+    // A cut string ends in '~', and one with no room left at all is printed as
+    // "~" (offset past the pool).
+    if (value == nullptr) {
+        value = "(null)";
+    }
+    size_t space = LOG_STRING_POOL - offset;
+    if (space > 1) {
+        size_t length = strnlen(value, space - 1);
+        memcpy(&record->strings[offset], value, length);
+        if (value[length] != '\0') {
+            record->strings[offset + length - 1] = '~';
+        }
+        record->strings[offset + length] = '\0';
+        record->poolUsed = offset + length + 1;
+    } else {
+        offset = LOG_STRING_POOL;
+    }
+
+    record->args[index] = offset;
+    record->argTypes |= LOG_ARG_STRING << (index * 2);
+}
+
+// Format a record into a line using its stored arguments
+size_t formatLogRecord(const LogRecord& record, char* line, size_t lineSize) {
+    // Reserve room for the trailing newline
+    lineSize--;
+
+    size_t length = snprintf(line, lineSize, "[%lu] %s ", (unsigned long)record.timestamp,
+                             LogLevelNames[record.level <= LOG_LEVEL_DEBUG ? record.level : 0]);
+    const char* p = record.format;
+    uint8_t argIndex = 0;
+
+    while (*p && length < lineSize - 1) {
+        if (*p != '%') {
+            line[length++] = *p++;
+            continue;
+        }
+
+        // Copy the conversion specification, e.g. "%-5.2f" or "%lu"
+        char spec[16];
+        size_t specLength = 0;
+        spec[specLength++] = *p++;
+        if (*p == '%') {
+            line[length++] = '%';
+            p++;
+            continue;
+        }
+        while (*p && strchr("-+ #0123456789.hlzjt", *p) && specLength < sizeof(spec) - 2) {
+            spec[specLength++] = *p++;
+        }
+        char conversion = *p ? *p++ : '\0';
+        spec[specLength++] = conversion;
+        spec[specLength] = '\0';
+
+        size_t space = lineSize - length;
+        int written = 0;
+
+        if (argIndex >= record.argCount) {
+            written = snprintf(&line[length], space, "?");
+        } else {
+            uint8_t type = (record.argTypes >> (argIndex * 2)) & 0x03;
+            uint32_t raw = record.args[argIndex];
+            bool isLong = strchr(spec, 'l') != nullptr;
+            argIndex++;
+
+            switch (conversion) {
+                case 's':
+                    written = snprintf(&line[length], space, spec,
+                                       type != LOG_ARG_STRING ? "?" :
+                                       raw < LOG_STRING_POOL ? &record.strings[raw] : "~");
+                    break;
+                case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': {
+                    float f = 0;
+                    if (type == LOG_ARG_FLOAT) {
+                        memcpy(&f, &raw, sizeof(f));
+                    } else {
+                        f = (type == LOG_ARG_INT) ? (float)(int32_t)raw : (float)raw;
+                    }
+                    written = snprintf(&line[length], space, spec, (double)f);
+                    break;
+                }
+                case 'd': case 'i':
+                    written = isLong ? snprintf(&line[length], space, spec, (long)(int32_t)raw)
+                                     : snprintf(&line[length], space, spec, (int)(int32_t)raw);
+                    break;
+                case 'u': case 'x': case 'X': case 'o':
+                    written = isLong ? snprintf(&line[length], space, spec, (unsigned long)raw)
+                                     : snprintf(&line[length], space, spec, (unsigned int)raw);
+                    break;
+                case 'c':
+                    written = snprintf(&line[length], space, spec, (int)raw);
+                    break;
+                default:
+                    written = snprintf(&line[length], space, "?");
+                    break;
+            }
+        }
+
+        if (written > 0) {
+            length += ((size_t)written < space) ? (size_t)written : space - 1;
+        }
+    }
+
+    // Terminate, stripping a trailing newline from the format (we add our own)
+    if (length > 0 && line[length - 1] == '\n') {
+        length--;
+    }
+    line[length++] = '\n';
+    line[length] = '\0';
+    return length;
+}
+
+// Pop one record if available (single consumer)
+bool logDequeue(LogRecord& out) {
+    uint32_t index = logDequeuePos & (LOG_QUEUE_SIZE - 1);
+    LogSlot* slot = &logSlots[index];
+    uint32_t sequence = slot->sequence.load(std::memory_order_acquire) + index;
+
+    if ((int32_t)(sequence - (logDequeuePos + 1)) < 0) {
+        return false;  // Empty
+    }
+
+    out = slot->record;
+    slot->sequence.store(logDequeuePos + LOG_QUEUE_SIZE - index, std::memory_order_release);
+    logDequeuePos++;
+    return true;
+}
+
+// Low-priority task that formats queued records and writes them to Serial
+void logDrainTask(void* parameter) {
+    LogRecord record;
+    char line[LOG_LINE_LENGTH];
+
+    for (;;) {
+        bool drained = false;
+
+        while (logDequeue(record)) {
+            size_t length = formatLogRecord(record, line, sizeof(line));
+            Serial.write((const uint8_t*)line, length);
+            drained = true;
+        }
+
+        // Report drops once per burst
+        uint32_t drops = logDropCount.load(std::memory_order_relaxed);
+        if (drops != logReportedDrops) {
+            int length = snprintf(line, sizeof(line), "[log] %lu records dropped\n",
+                                  (unsigned long)(drops - logReportedDrops));
+            Serial.write((const uint8_t*)line, length);
+            logReportedDrops = drops;
+        }
+
+        if (!drained) {
+            vTaskDelay(pdMS_TO_TICKS(LOG_DRAIN_INTERVAL));
+        }
+    }
+}
+
+void initLogger() {
+    if (logDrainTaskHandle != nullptr) {
+        return;
+    }
+
+    xTaskCreatePinnedToCore(logDrainTask, "logDrain", LOG_DRAIN_STACK, nullptr,
+                            LOG_DRAIN_PRIORITY, &logDrainTaskHandle, tskNO_AFFINITY);
+
+    LOG_I("Logger Initialized! (queue %d records)", LOG_QUEUE_SIZE);
+}
+
+TaskHandle_t getLogDrainTask() {
+    return logDrainTaskHandle;
+}
+
+uint32_t getLogDropCount() {
+    return logDropCount.load(std::memory_order_relaxed);
+}
+
+uint32_t getLogRecordCount() {
+    return logRecordCount.load(std::memory_order_relaxed);
+}
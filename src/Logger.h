@@ -0,0 +1,117 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <type_traits>
+
+// Log levels
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+// Compile-time level filter (override with -DLOG_LEVEL=...)
+// Calls above this level compile to nothing
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+// Logger configuration
+#define LOG_QUEUE_SIZE 128         // Records in the ring buffer (must be a power of two)
+#define LOG_MAX_ARGS 4             // Maximum arguments per record
+#define LOG_STRING_POOL 48         // Bytes per record for copied string arguments (cut strings end in '~')
+#define LOG_LINE_LENGTH 160        // Maximum formatted line length
+#define LOG_DRAIN_STACK 3072       // Drain task stack size (bytes)
+#define LOG_DRAIN_PRIORITY 1       // Drain task priority (just above idle)
+#define LOG_DRAIN_INTERVAL 10      // Drain task sleep when the queue is empty (ms)
+
+// Logging macros - arguments are stored raw and formatted later by the drain task
+#define LOG_WRITE(level, ...) do { if (LOG_LEVEL >= (level)) logWrite((level), __VA_ARGS__); } while (0)
+#define LOG_E(...) LOG_WRITE(LOG_LEVEL_ERROR, __VA_ARGS__)
+#define LOG_W(...) LOG_WRITE(LOG_LEVEL_WARN, __VA_ARGS__)
+#define LOG_I(...) LOG_WRITE(LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_D(...) LOG_WRITE(LOG_LEVEL_DEBUG, __VA_ARGS__)
+
+// Argument type tags (2 bits per argument)
+#define LOG_ARG_INT 0
+#define LOG_ARG_UINT 1
+#define LOG_ARG_FLOAT 2
+#define LOG_ARG_STRING 3
+
+// Compact log record: the format string pointer doubles as the format ID
+struct LogRecord {
+    const char* format;              // printf-style format (must be a string literal)
+    uint32_t timestamp;              // Tick count (ms) when the record was produced
+    uint8_t level;                   // LOG_LEVEL_*
+    uint8_t argCount;                // Number of used arguments
+    uint8_t argTypes;                // LOG_ARG_* tags, 2 bits per argument
+    uint8_t poolUsed;                // Bytes used in the string pool
+    uint32_t args[LOG_MAX_ARGS];     // Raw argument bits (or string pool offset)
+    char strings[LOG_STRING_POOL];   // Copied string arguments
+};
+
+// Function prototypes
+void initLogger();
+LogRecord* logClaim(uint8_t level, const char* format);
+void logCommit(LogRecord* record);
+TaskHandle_t getLogDrainTask();
+uint32_t getLogDropCount();
+uint32_t getLogRecordCount();
+
+// Argument encoding
+void logPutString(LogRecord* record, const char* value);
+
+template <typename T>
+inline typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type
+logPutArg(LogRecord* record, T value) {
+    uint8_t index = record->argCount++;
+    record->args[index] = (uint32_t)value;
+    uint8_t type = std::is_signed<T>::value ? LOG_ARG_INT : LOG_ARG_UINT;
+    record->argTypes |= type << (index * 2);
+}
+
+template <typename T>
+inline typename std::enable_if<std::is_floating_point<T>::value>::type
+logPutArg(LogRecord* record, T value) {
+    uint8_t index = record->argCount++;
+    float f = (float)value;
+    memcpy(&record->args[index], &f, sizeof(f));
+    record->argTypes |= LOG_ARG_FLOAT << (index * 2);
+}
+
+inline void logPutArg(LogRecord* record, const char* value) {
+    logPutString(record, value);
+}
+
+inline void logPutArg(LogRecord* record, const String& value) {
+    logPutString(record, value.c_str());
+}
+
+inline void logPutArg(LogRecord* record, const std::string& value) {
+    logPutString(record, value.c_str());
+}
+
+inline void logPutArgs(LogRecord* record) {
+}
+
+template <typename T, typename... Rest>
+inline void logPutArgs(LogRecord* record, const T& value, const Rest&... rest) {
+    if (record->argCount < LOG_MAX_ARGS) {
+        logPutArg(record, value);
+        logPutArgs(record, rest...);
+    }
+}
+
+// Enqueue a record without blocking; dropped (and counted) if the ring is full
+template <typename... Args>
+inline void logWrite(uint8_t level, const char* format, const Args&... args) {
+    LogRecord* record = logClaim(level, format);
+    if (record) {
+        logPutArgs(record, args...);
+        logCommit(record);
+    }
+}
+
+#endif // LOGGER_H
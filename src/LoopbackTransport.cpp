@@ -0,0 +1,136 @@
+#include "LoopbackTransport.h"
+
+LoopbackTransport::LoopbackTransport()
+    : listener(nullptr), started(false), advertising(false), bondingEnabled(false), bondsRemoved(0),
+      serviceChangedCount(0), notificationCount(0), connParamRequests(0), connParamsAccepted(true),
+      grantedInterval(0), grantedLatency(0), notifiedBytes(0) {
+    memset(properties, 0, sizeof(properties));
+    memset(valueReads, 0, sizeof(valueReads));
+}
+
+void LoopbackTransport::begin(const char* deviceName, const char* serviceUUID, uint16_t preferredMtu,
+                              BleTransportListener* transportListener) {
+    listener = transportListener;
+}
+
+bool LoopbackTransport::addCharacteristic(uint8_t characteristicId, const char* uuid,
+                                          uint8_t characteristicProperties) {
+    if (characteristicId >= BLE_TRANSPORT_MAX_CHARACTERISTICS) {
+        return false;
+    }
+
+    properties[characteristicId] = characteristicProperties;
+    return true;
+}
+
+void LoopbackTransport::setValue(uint8_t characteristicId, const uint8_t* data, size_t length) {
+    if (characteristicId < BLE_TRANSPORT_MAX_CHARACTERISTICS) {
+        values[characteristicId].assign((const char*)data, length);
+    }
+}
+
+std::string LoopbackTransport::getValue(uint8_t characteristicId) {
+    if (characteristicId < BLE_TRANSPORT_MAX_CHARACTERISTICS) {
+        valueReads[characteristicId]++;
+        return values[characteristicId];
+    }
+    return std::string();
+}
+
+bool LoopbackTransport::notify(uint8_t characteristicId, uint16_t connId, const uint8_t* data, size_t length,
+                               bool indicate) {
+    if (characteristicId >= BLE_TRANSPORT_MAX_CHARACTERISTICS || !(properties[characteristicId] & BLE_PROP_NOTIFY)) {
+        return false;
+    }
+
+    LoopbackNotification& notification = notifications[notificationCount % LOOPBACK_NOTIFY_LOG_SIZE];
+    notification.characteristicId = characteristicId;
+    notification.connId = connId;
+    notification.indicate = indicate;
+    notification.value.assign((const char*)data, length);
+    notification.buffer = data;
+    notificationCount++;
+    notifiedBytes += length;
+    return true;
+}
+
+void LoopbackTransport::setAdvertisingData(const uint8_t* data, size_t length) {
+    manufacturerData.assign((const char*)data, length);
+}
+
+// Disconnects complete immediately, as if the central acknowledged at once
+void LoopbackTransport::disconnect(uint16_t connId) {
+    simulateDisconnect(connId);
+}
+
+// Parameter requests are granted as asked, at the upper interval, unless
+// setConnParamsResponse() says otherwise
+bool LoopbackTransport::updateConnParams(uint16_t connId, uint16_t minInterval, uint16_t maxInterval,
+                                         uint16_t latency, uint16_t timeout) {
+    connParamRequests++;
+    if (!connParamsAccepted) {
+        return false;
+    }
+
+    if (grantedInterval != 0) {
+        maxInterval = grantedInterval;
+        latency = grantedLatency;
+    }
+    if (listener) {
+        listener->onTransportConnParams(connId, maxInterval, latency, timeout);
+    }
+    return true;
+}
+
+void LoopbackTransport::setConnParamsResponse(bool accepted, uint16_t interval, uint16_t latency) {
+    connParamsAccepted = accepted;
+    grantedInterval = interval;
+    grantedLatency = latency;
+}
+
+uint32_t LoopbackTransport::getValueReads(uint8_t characteristicId) const {
+    return characteristicId < BLE_TRANSPORT_MAX_CHARACTERISTICS ? valueReads[characteristicId] : 0;
+}
+
+const LoopbackNotification* LoopbackTransport::getNotification(uint32_t index) const {
+    uint32_t kept = notificationCount < LOOPBACK_NOTIFY_LOG_SIZE ? notificationCount : LOOPBACK_NOTIFY_LOG_SIZE;
+    if (index >= kept) {
+        return nullptr;
+    }
+    return &notifications[(notificationCount - kept + index) % LOOPBACK_NOTIFY_LOG_SIZE];
+}
+
+void LoopbackTransport::simulateConnect(uint16_t connId) {
+    advertising = false;
+    if (listener) listener->onTransportConnect(connId);
+}
+
+void LoopbackTransport::simulateDisconnect(uint16_t connId) {
+    if (listener) listener->onTransportDisconnect(connId);
+}
+
+void LoopbackTransport::simulateWrite(uint8_t characteristicId, const std::string& value) {
+    if (characteristicId >= BLE_TRANSPORT_MAX_CHARACTERISTICS) {
+        return;
+    }
+
+    values[characteristicId] = value;
+    if (listener) listener->onTransportWrite(characteristicId, value);
+}
+
+void LoopbackTransport::simulateSubscribe(uint16_t connId, uint8_t characteristicId, uint16_t cccdValue) {
+    if (listener) listener->onTransportSubscribe(connId, characteristicId, cccdValue);
+}
+
+void LoopbackTransport::simulateMtu(uint16_t connId, uint16_t mtu) {
+    if (listener) listener->onTransportMtuChange(connId, mtu);
+}
+
+void LoopbackTransport::simulateIndicationConfirm(uint16_t connId, uint8_t characteristicId) {
+    if (listener) listener->onTransportIndicationConfirm(connId, characteristicId);
+}
+
+// Pairing always uses a public address
+void LoopbackTransport::simulateAuthComplete(uint16_t connId, const uint8_t* address, bool bonded) {
+    if (listener) listener->onTransportAuthComplete(connId, address, 0, bonded);
+}
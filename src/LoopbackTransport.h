@@ -0,0 +1,106 @@
+#ifndef LOOPBACK_TRANSPORT_H
+#define LOOPBACK_TRANSPORT_H
+
+#include "BleTransport.h"
+
+#define LOOPBACK_NOTIFY_LOG_SIZE 16       // Notifications kept for inspection
+
+// A notification or indication as it would have gone over the air
+struct LoopbackNotification {
+    uint8_t characteristicId;
+    uint16_t connId;
+    bool indicate;
+    std::string value;
+    const uint8_t* buffer;                // Caller's data, to tell shared buffers from copies
+};
+
+// In-process transport without a radio. Values are stored locally, sent
+// notifications are recorded, and the simulate*() methods raise the events
+// a central would cause, in the caller's context. Built for every backend
+// so a host harness can drive BLEControl without a BLE stack.
+class LoopbackTransport : public BleTransport {
+private:
+    BleTransportListener* listener;
+    bool started;
+    bool advertising;
+    bool bondingEnabled;
+    uint32_t bondsRemoved;
+    uint32_t serviceChangedCount;
+
+    uint8_t properties[BLE_TRANSPORT_MAX_CHARACTERISTICS];
+    std::string values[BLE_TRANSPORT_MAX_CHARACTERISTICS];
+    std::string manufacturerData;
+
+    // Ring of the most recent notifications
+    LoopbackNotification notifications[LOOPBACK_NOTIFY_LOG_SIZE];
+    uint32_t notificationCount;
+
+    // Connection parameter requests, and what the central answers
+    uint32_t connParamRequests;
+    bool connParamsAccepted;
+    uint16_t grantedInterval;             // 0 = the requested maximum
+    uint16_t grantedLatency;
+
+    // Fan-out cost
+    uint32_t valueReads[BLE_TRANSPORT_MAX_CHARACTERISTICS];
+    uint32_t notifiedBytes;
+
+public:
+    LoopbackTransport();
+
+    const char* getName() const override { return "loopback"; }
+
+    void begin(const char* deviceName, const char* serviceUUID, uint16_t preferredMtu,
+               BleTransportListener* transportListener) override;
+    bool addCharacteristic(uint8_t characteristicId, const char* uuid, uint8_t characteristicProperties) override;
+    void start() override { started = true; }
+
+    void setValue(uint8_t characteristicId, const uint8_t* data, size_t length) override;
+    std::string getValue(uint8_t characteristicId) override;
+    bool notify(uint8_t characteristicId, uint16_t connId, const uint8_t* data, size_t length,
+                bool indicate) override;
+
+    void setAdvertisingData(const uint8_t* data, size_t length) override;
+    void startAdvertising() override { advertising = true; }
+    void stopAdvertising() override { advertising = false; }
+
+    void disconnect(uint16_t connId) override;
+    bool updateConnParams(uint16_t connId, uint16_t minInterval, uint16_t maxInterval, uint16_t latency,
+                          uint16_t timeout) override;
+
+    void enableBonding() override { bondingEnabled = true; }
+    void removeBond(const uint8_t* address, uint8_t addressType) override { bondsRemoved++; }
+    void indicateServiceChanged(uint16_t connId) override { serviceChangedCount++; }
+
+    using BleTransport::setValue;
+
+    // Central side
+    void simulateConnect(uint16_t connId);
+    void simulateDisconnect(uint16_t connId);
+    void simulateWrite(uint8_t characteristicId, const std::string& value);
+    void simulateSubscribe(uint16_t connId, uint8_t characteristicId, uint16_t cccdValue);
+    void simulateMtu(uint16_t connId, uint16_t mtu);
+    void simulateIndicationConfirm(uint16_t connId, uint8_t characteristicId);
+    void simulateAuthComplete(uint16_t connId, const uint8_t* address, bool bonded);
+
+    // Later parameter requests are refused by the stack, or granted with
+    // interval and latency in place of the requested ones (interval 0 grants
+    // what was asked)
+    void setConnParamsResponse(bool accepted, uint16_t interval = 0, uint16_t latency = 0);
+
+    // Inspection
+    bool isStarted() const { return started; }
+    bool isAdvertising() const { return advertising; }
+    bool isBondingEnabled() const { return bondingEnabled; }
+    uint32_t getBondsRemoved() const { return bondsRemoved; }
+    uint32_t getServiceChangedCount() const { return serviceChangedCount; }
+    const std::string& getAdvertisedData() const { return manufacturerData; }
+    uint32_t getNotificationCount() const { return notificationCount; }
+    const LoopbackNotification* getNotification(uint32_t index) const;  // 0 = oldest kept
+    void clearNotifications() { notificationCount = 0; notifiedBytes = 0; }
+    uint32_t getValueReads(uint8_t characteristicId) const;
+    uint32_t getConnParamRequests() const { return connParamRequests; }
+    uint32_t getNotifiedBytes() const { return notifiedBytes; }
+};
+
+#endif // LOOPBACK_TRANSPORT_H
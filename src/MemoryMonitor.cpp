@@ -0,0 +1,205 @@
+#include "MemoryMonitor.h"
+#include <esp_heap_caps.h>
+#include "Logger.h"
+
+// Monitored task table
+struct MonitoredTask {
+    TaskHandle_t handle;
+    const char* name;
+    uint32_t headroom;  // Stack high-water mark in bytes at the last sample
+};
+
+MonitoredTask monitoredTasks[MEMORY_MAX_TASKS];
+uint8_t monitoredTaskCount = 0;
+
+// Latest sample
+MemoryStats memoryStats = {};
+
+// Sampling bookkeeping
+unsigned long lastMemorySampleTime = 0;
+uint32_t loopsSinceSample = 0;
+uint32_t allocationsAtSample = 0;
+uint32_t allocationsAtLastLoop = 0;
+
+// Allocation counter, incremented by the malloc wrappers below
+volatile uint32_t allocationCount = 0;
+
+#ifdef MEMORY_COUNT_ALLOCATIONS
+// Linker-wrapped allocators (see -Wl,--wrap flags in platformio.ini).
+// Kept in IRAM so they stay callable while the flash cache is disabled.
+extern "C" {
+    void* __real_malloc(size_t size);
+    void* __real_calloc(size_t count, size_t size);
+    void* __real_realloc(void* ptr, size_t size);
+
+    void* IRAM_ATTR __wrap_malloc(size_t size) {
+        __atomic_fetch_add(&allocationCount, 1, __ATOMIC_RELAXED);
+        return __real_malloc(size);
+    }
+
+    void* IRAM_ATTR __wrap_calloc(size_t count, size_t size) {
+        __atomic_fetch_add(&allocationCount, 1, __ATOMIC_RELAXED);
+        return __real_calloc(count, size);
+    }
+
+    void* IRAM_ATTR __wrap_realloc(void* ptr, size_t size) {
+        __atomic_fetch_add(&allocationCount, 1, __ATOMIC_RELAXED);
+        return __real_realloc(ptr, size);
+    }
+}
+#endif
+
+// Take a full heap and stack sample
+void sampleMemory() {
+    uint8_t previousWarnings = memoryStats.warnings;
+
+    memoryStats.freeHeap = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    memoryStats.minFreeHeap = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+    memoryStats.largestFreeBlock = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+
+    // Per-task stack high-water marks (ESP-IDF reports these in bytes)
+    memoryStats.minStackHeadroom = UINT32_MAX;
+    for (uint8_t i = 0; i < monitoredTaskCount; i++) {
+        monitoredTasks[i].headroom = uxTaskGetStackHighWaterMark(monitoredTasks[i].handle);
+        if (monitoredTasks[i].headroom < memoryStats.minStackHeadroom) {
+            memoryStats.minStackHeadroom = monitoredTasks[i].headroom;
+        }
+    }
+    if (monitoredTaskCount == 0) {
+        memoryStats.minStackHeadroom = 0;
+    }
+
+    // Allocation rate over the sampling period
+    uint32_t allocations = allocationCount;
+    memoryStats.allocations = allocations;
+    if (loopsSinceSample > 0) {
+        memoryStats.allocsPerLoop = (allocations - allocationsAtSample) / (float)loopsSinceSample;
+    }
+    allocationsAtSample = allocations;
+    loopsSinceSample = 0;
+
+    // Evaluate thresholds
+    uint8_t warnings = MEMORY_WARN_NONE;
+    if (memoryStats.freeHeap < MEMORY_WARN_FREE_HEAP) {
+        warnings |= MEMORY_WARN_HEAP;
+    }
+    if (memoryStats.largestFreeBlock < MEMORY_WARN_LARGEST_BLOCK) {
+        warnings |= MEMORY_WARN_FRAGMENTATION;
+    }
+    if (monitoredTaskCount > 0 && memoryStats.minStackHeadroom < MEMORY_WARN_STACK_HEADROOM) {
+        warnings |= MEMORY_WARN_STACK;
+    }
+    memoryStats.warnings = warnings;
+
+    // Only report when a warning is newly raised
+    uint8_t raised = warnings & ~previousWarnings;
+    if (raised & MEMORY_WARN_HEAP) {
+        LOG_W("MEMORY WARNING: Free heap low (%u bytes)", memoryStats.freeHeap);
+    }
+    if (raised & MEMORY_WARN_FRAGMENTATION) {
+        LOG_W("MEMORY WARNING: Heap fragmented, largest block %u bytes", memoryStats.largestFreeBlock);
+    }
+    if (raised & MEMORY_WARN_STACK) {
+        for (uint8_t i = 0; i < monitoredTaskCount; i++) {
+            if (monitoredTasks[i].headroom < MEMORY_WARN_STACK_HEADROOM) {
+                LOG_W("MEMORY WARNING: Task %s stack headroom %u bytes",
+                      monitoredTasks[i].name, monitoredTasks[i].headroom);
+            }
+        }
+    }
+}
+
+void initMemoryMonitor() {
+    monitoredTaskCount = 0;
+
+    // Called from setup(), so the current task is the Arduino loop task
+    registerMemoryTask(xTaskGetCurrentTaskHandle(), "loopTask");
+
+    allocationsAtSample = allocationCount;
+    allocationsAtLastLoop = allocationsAtSample;
+    sampleMemory();
+    lastMemorySampleTime = millis();
+
+    LOG_I("Memory Monitor Initialized!");
+}
+
+void registerMemoryTask(TaskHandle_t task, const char* name) {
+    if (task == nullptr || monitoredTaskCount >= MEMORY_MAX_TASKS) {
+        return;
+    }
+
+    // Ignore duplicate registrations
+    for (uint8_t i = 0; i < monitoredTaskCount; i++) {
+        if (monitoredTasks[i].handle == task) {
+            return;
+        }
+    }
+
+    monitoredTasks[monitoredTaskCount].handle = task;
+    monitoredTasks[monitoredTaskCount].name = name;
+    monitoredTasks[monitoredTaskCount].headroom = uxTaskGetStackHighWaterMark(task);
+    monitoredTaskCount++;
+}
+
+// Register a task created elsewhere (e.g. by the BLE stack) by its FreeRTOS name
+bool registerMemoryTaskByName(const char* name) {
+    TaskHandle_t task = xTaskGetHandle(name);
+    if (task == nullptr) {
+        return false;
+    }
+
+    registerMemoryTask(task, name);
+    return true;
+}
+
+// Call once per loop iteration
+void runMemoryMonitor() {
+    // Cheap per-iteration bookkeeping: a single counter read
+    uint32_t allocations = allocationCount;
+    uint32_t allocsThisLoop = allocations - allocationsAtLastLoop;
+    if (allocsThisLoop > memoryStats.maxAllocsPerLoop) {
+        memoryStats.maxAllocsPerLoop = allocsThisLoop;
+    }
+    allocationsAtLastLoop = allocations;
+    loopsSinceSample++;
+
+    // Full heap walk only at the sampling interval
+    if (millis() - lastMemorySampleTime >= MEMORY_SAMPLE_INTERVAL) {
+        sampleMemory();
+        lastMemorySampleTime = millis();
+    }
+}
+
+const MemoryStats& getMemoryStats() {
+    return memoryStats;
+}
+
+// Restart the per-loop allocation peak (e.g. after boot-time setup)
+void resetMemoryPeaks() {
+    memoryStats.maxAllocsPerLoop = 0;
+    allocationsAtLastLoop = allocationCount;
+}
+
+uint8_t getMemoryTaskCount() {
+    return monitoredTaskCount;
+}
+
+const char* getMemoryTaskName(uint8_t index) {
+    return index < monitoredTaskCount ? monitoredTasks[index].name : "";
+}
+
+uint32_t getMemoryTaskHeadroom(uint8_t index) {
+    return index < monitoredTaskCount ? monitoredTasks[index].headroom : 0;
+}
+
+void printMemoryInfo() {
+    LOG_I("Heap: free %u, min %u, largest block %u",
+          memoryStats.freeHeap, memoryStats.minFreeHeap, memoryStats.largestFreeBlock);
+    LOG_I("Allocations: %.2f/loop (max %u)", memoryStats.allocsPerLoop, memoryStats.maxAllocsPerLoop);
+    for (uint8_t i = 0; i < monitoredTaskCount; i++) {
+        LOG_I("  Stack %s: %u bytes free", monitoredTasks[i].name, monitoredTasks[i].headroom);
+    }
+    if (memoryStats.warnings != MEMORY_WARN_NONE) {
+        LOG_W("Memory warnings: 0x%02X", memoryStats.warnings);
+    }
+}
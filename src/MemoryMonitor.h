@@ -0,0 +1,45 @@
+#ifndef MEMORY_MONITOR_H
+#define MEMORY_MONITOR_H
+
+#include <Arduino.h>
+
+// Sampling configuration
+#define MEMORY_SAMPLE_INTERVAL 2000      // Heap/stack sampling period in milliseconds
+#define MEMORY_MAX_TASKS 8               // Maximum number of tasks with stack monitoring
+
+// Warning thresholds (warn before the heap or a stack is exhausted)
+#define MEMORY_WARN_FREE_HEAP 30000      // Warn when free heap drops below this (bytes)
+#define MEMORY_WARN_LARGEST_BLOCK 8192   // Warn when the largest free block drops below this (bytes)
+#define MEMORY_WARN_STACK_HEADROOM 512   // Warn when a task's unused stack drops below this (bytes)
+
+// Warning flags (bitmask)
+#define MEMORY_WARN_NONE 0x00
+#define MEMORY_WARN_HEAP 0x01            // Free heap below threshold
+#define MEMORY_WARN_FRAGMENTATION 0x02   // Largest free block below threshold
+#define MEMORY_WARN_STACK 0x04           // At least one task stack below threshold
+
+// Snapshot of the most recent memory sample
+struct MemoryStats {
+    uint32_t freeHeap;           // Currently free heap (bytes)
+    uint32_t minFreeHeap;        // Lowest free heap since boot (bytes)
+    uint32_t largestFreeBlock;   // Largest block that can be allocated (bytes)
+    uint32_t minStackHeadroom;   // Lowest stack high-water mark of all monitored tasks (bytes)
+    uint32_t allocations;        // Total allocations since boot (0 if counting is disabled)
+    float allocsPerLoop;         // Average allocations per loop iteration over the last period
+    uint32_t maxAllocsPerLoop;   // Most allocations seen in a single loop iteration
+    uint8_t warnings;            // MEMORY_WARN_* flags
+};
+
+// Function prototypes
+void initMemoryMonitor();
+void registerMemoryTask(TaskHandle_t task, const char* name);
+bool registerMemoryTaskByName(const char* name);
+void runMemoryMonitor();
+const MemoryStats& getMemoryStats();
+void resetMemoryPeaks();
+uint8_t getMemoryTaskCount();
+const char* getMemoryTaskName(uint8_t index);
+uint32_t getMemoryTaskHeadroom(uint8_t index);
+void printMemoryInfo();
+
+#endif // MEMORY_MONITOR_H
@@ -1,6 +1,8 @@
 #include "MotorControl.h"
 #include "Sensors.h"
 #include "VoltageReader.h"
+#include "Logger.h"
+#include "CommandTrace.h"
 
 // Door position tracking
 uint8_t doorPosition = 100; // 0 = Door Closed, 100 = Door Fully Open
@@ -22,13 +24,16 @@ void initMotors() {
     // Initialize door button pin as input with internal pull-up resistor
     pinMode(DOOR_BTN, INPUT_PULLUP);
     
-    Serial.println("Motor Control Initialized!");
+    LOG_I("Motor Control Initialized!");
 }
 
 void manageMotors(bool podOpenFlag) {
     // Read the current state of the pod from sensors
     uint8_t currentState = readState();
     
+    // Any pending door command is decided here
+    traceCommandStage(TRACE_TARGET_DOOR, TRACE_STAGE_DECIDED);
+    
     // Determine whether to open or close pod based on flag
     if (podOpenFlag) {
         podOpen();
@@ -48,7 +53,9 @@ void handleDoorButton(bool &podOpenFlag, bool childLockOn) {
 
     // If the button was just pressed (transition from not pressed to pressed)
     if (doorBtnState == LOW && previousDoorBtnState == HIGH) {
-        Serial.println("Door Button Pressed");
+        LOG_I("Door Button Pressed");
+        uint32_t traceId = traceCommandReceived(TRACE_SOURCE_BUTTON, TRACE_TARGET_DOOR);
+        traceCommandDequeued(TRACE_TARGET_DOOR, traceId);
         podOpenFlag = !podOpenFlag; // Toggle the pod open/close state
     }
     
@@ -146,6 +153,9 @@ void setPodState(uint8_t transition) {
             stopAllMotors();
             break;
     }
+    
+    // Motor outputs now reflect any pending door command
+    traceCommandStage(TRACE_TARGET_DOOR, TRACE_STAGE_ACTUATED);
 }
 
 uint8_t getDoorPosition() {
@@ -156,12 +166,11 @@ void setDoorPosition(uint8_t position) {
     // Only allow values of 50 or 100
     if (position == 50 || position == 100) {
         doorPosition = position;
-        Serial.print("Door position set to: ");
-        Serial.println(doorPosition);
+        LOG_I("Door position set to: %u", doorPosition);
         
         // Save only the door position setting
         saveDoorPosition(doorPosition);
     } else {
-        Serial.println("Invalid door position! Only 50 or 100 allowed.");
+        LOG_W("Invalid door position! Only 50 or 100 allowed.");
     }
 }
\ No newline at end of file
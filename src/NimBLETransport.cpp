@@ -0,0 +1,234 @@
+#include "NimBLETransport.h"
+
+#if BLE_BACKEND == BLE_BACKEND_NIMBLE
+
+// Server Callbacks Implementation
+void NimBLEServerCallback::onConnect(NimBLEServer* pServer, ble_gap_conn_desc* desc) {
+    transport->listener->onTransportConnect(desc->conn_handle);
+
+    // Bonded centrals re-encrypt with their stored keys, new ones pair
+    if (transport->bondingEnabled) {
+        NimBLEDevice::startSecurity(desc->conn_handle);
+    }
+}
+
+void NimBLEServerCallback::onDisconnect(NimBLEServer* pServer, ble_gap_conn_desc* desc) {
+    transport->listener->onTransportDisconnect(desc->conn_handle);
+}
+
+void NimBLEServerCallback::onMTUChange(uint16_t MTU, ble_gap_conn_desc* desc) {
+    transport->listener->onTransportMtuChange(desc->conn_handle, MTU);
+}
+
+void NimBLEServerCallback::onAuthenticationComplete(ble_gap_conn_desc* desc) {
+    transport->listener->onTransportAuthComplete(desc->conn_handle, desc->peer_id_addr.val, desc->peer_id_addr.type,
+                                                 desc->sec_state.encrypted && desc->sec_state.bonded);
+}
+
+// Characteristic Callbacks Implementation
+void NimBLECharacteristicCallback::onWrite(NimBLECharacteristic* characteristic, ble_gap_conn_desc* desc) {
+    std::string value = characteristic->getValue();
+    transport->listener->onTransportWrite(characteristicId, value);
+}
+
+void NimBLECharacteristicCallback::onRead(NimBLECharacteristic* characteristic, ble_gap_conn_desc* desc) {
+    transport->listener->onTransportRead(characteristicId);
+}
+
+void NimBLECharacteristicCallback::onSubscribe(NimBLECharacteristic* characteristic, ble_gap_conn_desc* desc,
+                                               uint16_t subValue) {
+    transport->listener->onTransportSubscribe(desc->conn_handle, characteristicId, subValue);
+}
+
+NimBLETransport* NimBLETransport::instance = nullptr;
+
+NimBLETransport::NimBLETransport()
+    : listener(nullptr), pServer(nullptr), pService(nullptr), pAdvertising(nullptr), bondingEnabled(false) {
+    for (uint8_t i = 0; i < BLE_TRANSPORT_MAX_CHARACTERISTICS; i++) {
+        characteristics[i] = nullptr;
+    }
+}
+
+void NimBLETransport::begin(const char* deviceName, const char* uuid, uint16_t preferredMtu,
+                            BleTransportListener* transportListener) {
+    listener = transportListener;
+    serviceUUID = uuid;
+
+    NimBLEDevice::init(deviceName);
+    NimBLEDevice::setMTU(preferredMtu);
+
+    // Indication acks and achieved connection parameters come from raw GAP events
+    instance = this;
+    NimBLEDevice::setCustomGapHandler(gapEventHandler);
+
+    pServer = NimBLEDevice::createServer();
+    pServer->setCallbacks(new NimBLEServerCallback(this));
+    pService = pServer->createService(uuid);
+
+    // The advertisement carries the service UUID and status, the scan response the name
+    pAdvertising = NimBLEDevice::getAdvertising();
+    NimBLEAdvertisementData scanResponseData;
+    scanResponseData.setName(deviceName);
+    pAdvertising->setScanResponseData(scanResponseData);
+}
+
+// NimBLE adds the CCCD itself for notifying characteristics
+bool NimBLETransport::addCharacteristic(uint8_t characteristicId, const char* uuid, uint8_t properties) {
+    if (!pService || characteristicId >= BLE_TRANSPORT_MAX_CHARACTERISTICS) {
+        return false;
+    }
+
+    uint32_t nimbleProperties = 0;
+    if (properties & BLE_PROP_READ) nimbleProperties |= NIMBLE_PROPERTY::READ;
+    if (properties & BLE_PROP_WRITE) nimbleProperties |= NIMBLE_PROPERTY::WRITE;
+    if (properties & BLE_PROP_WRITE_NR) nimbleProperties |= NIMBLE_PROPERTY::WRITE_NR;
+    if (properties & BLE_PROP_NOTIFY) nimbleProperties |= NIMBLE_PROPERTY::NOTIFY | NIMBLE_PROPERTY::INDICATE;
+
+    NimBLECharacteristic* characteristic = pService->createCharacteristic(uuid, nimbleProperties);
+    characteristic->setCallbacks(new NimBLECharacteristicCallback(this, characteristicId));
+    characteristics[characteristicId] = characteristic;
+    return true;
+}
+
+void NimBLETransport::start() {
+    if (pService) {
+        pService->start();
+    }
+}
+
+void NimBLETransport::setValue(uint8_t characteristicId, const uint8_t* data, size_t length) {
+    if (characteristicId < BLE_TRANSPORT_MAX_CHARACTERISTICS && characteristics[characteristicId]) {
+        characteristics[characteristicId]->setValue(data, length);
+    }
+}
+
+std::string NimBLETransport::getValue(uint8_t characteristicId) {
+    if (characteristicId < BLE_TRANSPORT_MAX_CHARACTERISTICS && characteristics[characteristicId]) {
+        return characteristics[characteristicId]->getValue();
+    }
+    return std::string();
+}
+
+// Sent through the host API directly: the characteristic's notify() neither
+// reports congestion nor lets one connection get an indication and another
+// a notification
+bool NimBLETransport::notify(uint8_t characteristicId, uint16_t connId, const uint8_t* data, size_t length,
+                             bool indicate) {
+    if (characteristicId >= BLE_TRANSPORT_MAX_CHARACTERISTICS || !characteristics[characteristicId]) {
+        return false;
+    }
+
+    os_mbuf* buffer = ble_hs_mbuf_from_flat(data, length);
+    if (!buffer) {
+        return false;
+    }
+
+    uint16_t handle = characteristics[characteristicId]->getHandle();
+    int result = indicate ? ble_gattc_indicate_custom(connId, handle, buffer)
+                          : ble_gattc_notify_custom(connId, handle, buffer);
+    return result == 0;
+}
+
+void NimBLETransport::setAdvertisingData(const uint8_t* manufacturerData, size_t length) {
+    if (!pAdvertising) return;
+
+    NimBLEAdvertisementData advertisementData;
+    advertisementData.setFlags(BLE_HS_ADV_F_DISC_GEN | BLE_HS_ADV_F_BREDR_UNSUP);
+    advertisementData.setCompleteServices(NimBLEUUID(serviceUUID));
+    advertisementData.setManufacturerData(std::string((const char*)manufacturerData, length));
+    pAdvertising->setAdvertisementData(advertisementData);
+}
+
+void NimBLETransport::startAdvertising() {
+    if (pAdvertising) {
+        pAdvertising->start();
+    }
+}
+
+void NimBLETransport::stopAdvertising() {
+    if (pAdvertising) {
+        pAdvertising->stop();
+    }
+}
+
+void NimBLETransport::disconnect(uint16_t connId) {
+    if (pServer) {
+        pServer->disconnect(connId);
+    }
+}
+
+bool NimBLETransport::updateConnParams(uint16_t connId, uint16_t minInterval, uint16_t maxInterval,
+                                       uint16_t latency, uint16_t timeout) {
+    if (!pServer) {
+        return false;
+    }
+
+    pServer->updateConnParams(connId, minInterval, maxInterval, latency, timeout);
+    return true;
+}
+
+// Just Works bonding with secure connections; keys are stored by NimBLE,
+// which also keeps bonded centrals' CCCDs
+void NimBLETransport::enableBonding() {
+    NimBLEDevice::setSecurityAuth(true, false, true);
+    NimBLEDevice::setSecurityIOCap(BLE_HS_IO_NO_INPUT_OUTPUT);
+    NimBLEDevice::setSecurityInitKey(BLE_SM_PAIR_KEY_DIST_ENC | BLE_SM_PAIR_KEY_DIST_ID);
+    NimBLEDevice::setSecurityRespKey(BLE_SM_PAIR_KEY_DIST_ENC | BLE_SM_PAIR_KEY_DIST_ID);
+    bondingEnabled = true;
+}
+
+void NimBLETransport::removeBond(const uint8_t* address, uint8_t addressType) {
+    ble_addr_t bondAddress;
+    bondAddress.type = addressType;
+    memcpy(bondAddress.val, address, sizeof(bondAddress.val));
+    ble_gap_unpair(&bondAddress);
+}
+
+// NimBLE indicates the change to every connected central that enabled it and
+// remembers it for bonded centrals that are not connected
+void NimBLETransport::indicateServiceChanged(uint16_t connId) {
+    ble_svc_gatt_changed(0x0001, 0xFFFF);
+}
+
+uint8_t NimBLETransport::findCharacteristic(uint16_t handle) const {
+    for (uint8_t id = 0; id < BLE_TRANSPORT_MAX_CHARACTERISTICS; id++) {
+        if (characteristics[id] && characteristics[id]->getHandle() == handle) {
+            return id;
+        }
+    }
+    return 0xFF;
+}
+
+// Raw GAP events, delivered alongside NimBLEServer's own handling
+int NimBLETransport::gapEventHandler(ble_gap_event* event, void* arg) {
+    if (!instance) {
+        return 0;
+    }
+
+    ble_gap_conn_desc desc;
+    uint8_t id;
+    switch (event->type) {
+        case BLE_GAP_EVENT_NOTIFY_TX:
+            // An indication is acknowledged when its transmit completes with BLE_HS_EDONE
+            if (event->notify_tx.indication && event->notify_tx.status == BLE_HS_EDONE) {
+                id = instance->findCharacteristic(event->notify_tx.attr_handle);
+                if (id != 0xFF) {
+                    instance->listener->onTransportIndicationConfirm(event->notify_tx.conn_handle, id);
+                }
+            }
+            break;
+
+        case BLE_GAP_EVENT_CONN_UPDATE:
+            if (event->conn_update.status == 0 && ble_gap_conn_find(event->conn_update.conn_handle, &desc) == 0) {
+                instance->listener->onTransportConnParams(desc.conn_handle, desc.conn_itvl, desc.conn_latency,
+                                                          desc.supervision_timeout);
+            }
+            break;
+
+        default:
+            break;
+    }
+    return 0;
+}
+
+#endif // BLE_BACKEND == BLE_BACKEND_NIMBLE
@@ -0,0 +1,96 @@
+#ifndef NIMBLE_TRANSPORT_H
+#define NIMBLE_TRANSPORT_H
+
+#include "BleTransport.h"
+
+#if BLE_BACKEND == BLE_BACKEND_NIMBLE
+
+#include <NimBLEDevice.h>
+#include "nimble/nimble/host/services/gatt/include/services/gatt/ble_svc_gatt.h"
+
+class NimBLETransport;
+
+// Server callback forwarding connections and MTU changes to the transport
+class NimBLEServerCallback : public NimBLEServerCallbacks {
+private:
+    NimBLETransport* transport;
+
+public:
+    NimBLEServerCallback(NimBLETransport* owner) : transport(owner) {}
+
+    void onConnect(NimBLEServer* pServer, ble_gap_conn_desc* desc) override;
+    void onDisconnect(NimBLEServer* pServer, ble_gap_conn_desc* desc) override;
+    void onMTUChange(uint16_t MTU, ble_gap_conn_desc* desc) override;
+    void onAuthenticationComplete(ble_gap_conn_desc* desc) override;
+};
+
+// One instance per characteristic, tagged with its ID
+class NimBLECharacteristicCallback : public NimBLECharacteristicCallbacks {
+private:
+    NimBLETransport* transport;
+    uint8_t characteristicId;
+
+public:
+    NimBLECharacteristicCallback(NimBLETransport* owner, uint8_t id)
+        : transport(owner), characteristicId(id) {}
+
+    void onWrite(NimBLECharacteristic* characteristic, ble_gap_conn_desc* desc) override;
+    void onRead(NimBLECharacteristic* characteristic, ble_gap_conn_desc* desc) override;
+    void onSubscribe(NimBLECharacteristic* characteristic, ble_gap_conn_desc* desc, uint16_t subValue) override;
+};
+
+// NimBLE keeps connection handles stable and addresses every per-connection
+// call by handle, so no peer table is needed here
+class NimBLETransport : public BleTransport {
+private:
+    // Instance receiving raw GAP events (indication acks and connection parameters)
+    static NimBLETransport* instance;
+    static int gapEventHandler(ble_gap_event* event, void* arg);
+
+    BleTransportListener* listener;
+    NimBLEServer* pServer;
+    NimBLEService* pService;
+    NimBLEAdvertising* pAdvertising;
+    std::string serviceUUID;
+    bool bondingEnabled;
+
+    NimBLECharacteristic* characteristics[BLE_TRANSPORT_MAX_CHARACTERISTICS];
+
+    uint8_t findCharacteristic(uint16_t handle) const;
+
+    friend class NimBLEServerCallback;
+    friend class NimBLECharacteristicCallback;
+
+public:
+    NimBLETransport();
+
+    const char* getName() const override { return "nimble"; }
+
+    void begin(const char* deviceName, const char* uuid, uint16_t preferredMtu,
+               BleTransportListener* transportListener) override;
+    bool addCharacteristic(uint8_t characteristicId, const char* uuid, uint8_t properties) override;
+    void start() override;
+
+    void setValue(uint8_t characteristicId, const uint8_t* data, size_t length) override;
+    std::string getValue(uint8_t characteristicId) override;
+    bool notify(uint8_t characteristicId, uint16_t connId, const uint8_t* data, size_t length,
+                bool indicate) override;
+
+    void setAdvertisingData(const uint8_t* manufacturerData, size_t length) override;
+    void startAdvertising() override;
+    void stopAdvertising() override;
+
+    void disconnect(uint16_t connId) override;
+    bool updateConnParams(uint16_t connId, uint16_t minInterval, uint16_t maxInterval, uint16_t latency,
+                          uint16_t timeout) override;
+
+    void enableBonding() override;
+    void removeBond(const uint8_t* address, uint8_t addressType) override;
+    void indicateServiceChanged(uint16_t connId) override;
+
+    using BleTransport::setValue;
+};
+
+#endif // BLE_BACKEND == BLE_BACKEND_NIMBLE
+
+#endif // NIMBLE_TRANSPORT_H
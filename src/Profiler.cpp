@@ -0,0 +1,151 @@
+#include "Profiler.h"
+#include "Logger.h"
+
+// Upper bound (microseconds) of each histogram bucket; the last bucket is open-ended
+const uint32_t ProfileBucketLimits[PROFILE_HISTOGRAM_BUCKETS] = {
+    50, 100, 250, 500, 1000, 2500, 5000, UINT32_MAX
+};
+
+// Names of profiled zones for reports
+const char* ProfileZoneNames[PROFILE_ZONE_COUNT] = {
+    "door",
+    "led",
+    "wifi",
+    "childLock",
+    "jsonUpdate",
+    "debugInfo",
+    "memory",
+    "commands",
+    "bleLink"
+};
+
+// Accumulators
+ProfileZoneStats profileZones[PROFILE_ZONE_COUNT];
+ProfileLoopStats profileLoop;
+
+// Loop period tracking
+uint32_t lastLoopCycles = 0;
+uint32_t lastLoopPeriod = 0;
+bool loopTimingStarted = false;
+
+// CPU clock used to convert cycles to microseconds
+uint32_t cpuFrequencyMHz = 240;
+
+void initProfiler() {
+    cpuFrequencyMHz = ESP.getCpuFreqMHz();
+    if (cpuFrequencyMHz == 0) {
+        cpuFrequencyMHz = 240;
+    }
+
+    resetProfileStats();
+
+    LOG_I("Profiler Initialized! (%u MHz, enabled: %d)", cpuFrequencyMHz, PROFILING_ENABLED);
+}
+
+uint32_t profileCyclesToMicros(uint32_t cycles) {
+    return cycles / cpuFrequencyMHz;
+}
+
+void profileRecord(uint8_t zone, uint32_t cycles) {
+    if (zone >= PROFILE_ZONE_COUNT) {
+        return;
+    }
+
+    ProfileZoneStats& stats = profileZones[zone];
+    stats.count++;
+    stats.totalCycles += cycles;
+    if (cycles > stats.maxCycles) {
+        stats.maxCycles = cycles;
+    }
+
+    // Find the histogram bucket
+    uint32_t micros = profileCyclesToMicros(cycles);
+    uint8_t bucket = 0;
+    while (bucket < PROFILE_HISTOGRAM_BUCKETS - 1 && micros >= ProfileBucketLimits[bucket]) {
+        bucket++;
+    }
+    stats.histogram[bucket]++;
+}
+
+// Call once at the top of every loop iteration
+void profileLoopTick() {
+    uint32_t now = ESP.getCycleCount();
+
+    if (!loopTimingStarted) {
+        loopTimingStarted = true;
+        lastLoopCycles = now;
+        return;
+    }
+
+    uint32_t period = now - lastLoopCycles;
+    lastLoopCycles = now;
+
+    profileLoop.count++;
+    profileLoop.totalCycles += period;
+    if (period < profileLoop.minCycles) {
+        profileLoop.minCycles = period;
+    }
+    if (period > profileLoop.maxCycles) {
+        profileLoop.maxCycles = period;
+    }
+
+    // Jitter: change between consecutive periods
+    if (lastLoopPeriod != 0) {
+        uint32_t jitter = (period > lastLoopPeriod) ? period - lastLoopPeriod : lastLoopPeriod - period;
+        if (jitter > profileLoop.maxJitterCycles) {
+            profileLoop.maxJitterCycles = jitter;
+        }
+    }
+    lastLoopPeriod = period;
+
+    if (profileCyclesToMicros(period) > PROFILE_LOOP_OVERRUN_US) {
+        profileLoop.overruns++;
+    }
+}
+
+void resetProfileStats() {
+    memset(profileZones, 0, sizeof(profileZones));
+    memset(&profileLoop, 0, sizeof(profileLoop));
+    profileLoop.minCycles = UINT32_MAX;
+
+    // Restart period measurement so the reset itself is not counted as a long period
+    loopTimingStarted = false;
+    lastLoopPeriod = 0;
+}
+
+void printProfileReport() {
+    LOG_I("--- Profile (us) ---");
+
+    for (uint8_t i = 0; i < PROFILE_ZONE_COUNT; i++) {
+        const ProfileZoneStats& stats = profileZones[i];
+        if (stats.count == 0) {
+            continue;
+        }
+
+        uint32_t average = profileCyclesToMicros(stats.totalCycles / stats.count);
+        LOG_I("%s: n=%u avg=%u max=%u", ProfileZoneNames[i], stats.count, average,
+              profileCyclesToMicros(stats.maxCycles));
+        LOG_I("  <50:%u <100:%u <250:%u <500:%u", stats.histogram[0], stats.histogram[1],
+              stats.histogram[2], stats.histogram[3]);
+        LOG_I("  <1k:%u <2.5k:%u <5k:%u >=5k:%u", stats.histogram[4], stats.histogram[5],
+              stats.histogram[6], stats.histogram[7]);
+    }
+
+    if (profileLoop.count > 0) {
+        uint32_t average = profileCyclesToMicros(profileLoop.totalCycles / profileLoop.count);
+        LOG_I("loop: n=%u avg=%u min=%u max=%u", profileLoop.count, average,
+              profileCyclesToMicros(profileLoop.minCycles), profileCyclesToMicros(profileLoop.maxCycles));
+        LOG_I("  jitter=%u overruns=%u", profileCyclesToMicros(profileLoop.maxJitterCycles),
+              profileLoop.overruns);
+    }
+
+    LOG_I("--------------------");
+}
+
+const ProfileZoneStats& getProfileZoneStats(uint8_t zone) {
+    return profileZones[zone < PROFILE_ZONE_COUNT ? zone : 0];
+}
+
+const ProfileLoopStats& getProfileLoopStats() {
+    return profileLoop;
+}
@@ -0,0 +1,79 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <Arduino.h>
+
+// Compile-time switch (override with -DPROFILING_ENABLED=0); when disabled the
+// PROFILE_* macros compile to nothing
+#ifndef PROFILING_ENABLED
+#define PROFILING_ENABLED 1
+#endif
+
+// Profiling configuration
+#define PROFILE_HISTOGRAM_BUCKETS 8      // Fixed latency buckets per zone (see ProfileBucketLimits)
+#define PROFILE_LOOP_OVERRUN_US 20000    // Loop periods longer than this count as overruns
+
+// Profiled zones
+#define PROFILE_ZONE_DOOR 0              // runDoorControl()
+#define PROFILE_ZONE_LED 1               // runLEDControl()
+#define PROFILE_ZONE_WIFI 2              // runWiFiControl()
+#define PROFILE_ZONE_CHILD_LOCK 3        // runChildLockControl()
+#define PROFILE_ZONE_JSON_UPDATE 4       // BLEControl::checkJSONUpdate()
+#define PROFILE_ZONE_DEBUG_INFO 5        // printDebugInfo()
+#define PROFILE_ZONE_MEMORY 6            // runMemoryMonitor()
+#define PROFILE_ZONE_COMMANDS 7          // runCommandQueue()
+#define PROFILE_ZONE_BLE_LINK 8          // BLEControl::checkConnectionParameters()
+#define PROFILE_ZONE_COUNT 9
+
+// Per-zone accumulator
+struct ProfileZoneStats {
+    uint32_t count;                                  // Number of executions
+    uint64_t totalCycles;                            // Sum of CPU cycles
+    uint32_t maxCycles;                              // Longest execution in CPU cycles
+    uint32_t histogram[PROFILE_HISTOGRAM_BUCKETS];   // Executions per duration bucket
+};
+
+// Loop period statistics
+struct ProfileLoopStats {
+    uint32_t count;             // Number of measured periods
+    uint64_t totalCycles;       // Sum of all periods
+    uint32_t minCycles;         // Shortest period
+    uint32_t maxCycles;         // Longest period
+    uint32_t maxJitterCycles;   // Largest change between consecutive periods
+    uint32_t overruns;          // Periods longer than PROFILE_LOOP_OVERRUN_US
+};
+
+// Function prototypes
+void initProfiler();
+void profileRecord(uint8_t zone, uint32_t cycles);
+void profileLoopTick();
+void resetProfileStats();
+void printProfileReport();
+const ProfileZoneStats& getProfileZoneStats(uint8_t zone);
+const ProfileLoopStats& getProfileLoopStats();
+uint32_t profileCyclesToMicros(uint32_t cycles);
+
+// Scoped marker: reads the cycle counter on entry and exit
+class ProfileScope {
+public:
+    explicit ProfileScope(uint8_t zone) : zone(zone), start(ESP.getCycleCount()) {}
+    ~ProfileScope() { profileRecord(zone, ESP.getCycleCount() - start); }
+
+private:
+    uint8_t zone;
+    uint32_t start;
+};
+
+#if PROFILING_ENABLED
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(zone) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(zone)
+#define PROFILE_CALL(zone, call) do { PROFILE_SCOPE(zone); call; } while (0)
+#define PROFILE_LOOP_TICK() profileLoopTick()
+#else
+#define PROFILE_SCOPE(zone) do {} while (0)
+#define PROFILE_CALL(zone, call) do { call; } while (0)
+#define PROFILE_LOOP_TICK() do {} while (0)
+#endif
+
+#endif // PROFILER_H
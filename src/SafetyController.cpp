@@ -2,6 +2,7 @@
 #include "VoltageReader.h"
 #include "Sensors.h"
 #include "MotorControl.h" // Added for access to stopAllMotors()
+#include "Logger.h"
 
 // Current safety status
 uint8_t currentSafetyStatus = SAFETY_STATUS_OK;
@@ -14,14 +15,14 @@ void initSafetyController() {
     currentSafetyStatus = SAFETY_STATUS_OK;
     systemLocked = false;
     
-    Serial.println("Safety Controller Initialized!");
+    LOG_I("Safety Controller Initialized!");
 }
 
 bool isSafeToOperate() {
     // Check for system lockout - this is the "master kill switch"
     // Once locked, only a power cycle (restart) will reset it
     if (systemLocked) {
-        Serial.println("SYSTEM LOCKED: Power cycle required to reset");
+        LOG_E("SYSTEM LOCKED: Power cycle required to reset");
         stopAllMotors(); // Ensure motors are stopped
         return false;
     }
@@ -32,8 +33,8 @@ bool isSafeToOperate() {
         systemLocked = true;
         currentSafetyStatus = SAFETY_STATUS_MOTOR_STALL;
         
-        Serial.println("CRITICAL FAULT: Motor stall detected!");
-        Serial.println("System is now LOCKED - power cycle required to reset");
+        LOG_E("CRITICAL FAULT: Motor stall detected!");
+        LOG_E("System is now LOCKED - power cycle required to reset");
         
         // Immediately stop all motors when stall is detected
         stopAllMotors();
@@ -50,12 +51,8 @@ uint8_t getSafetyStatus() {
 }
 
 void logSafetyEvent(uint8_t eventType, const char* message) {
-    // Print safety event to serial
-    Serial.print("SAFETY EVENT: ");
-    Serial.print(message);
-    Serial.print(" (Code: ");
-    Serial.print(eventType);
-    Serial.println(")");
+    // Log safety event
+    LOG_W("SAFETY EVENT: %s (Code: %u)", message, eventType);
     
     // For motor stall events, automatically lock the system
     if (eventType == SAFETY_STATUS_MOTOR_STALL) {
@@ -69,6 +66,6 @@ void resetSafetyStatus() {
     // In production, this function would not be used - only kept for testing
     currentSafetyStatus = SAFETY_STATUS_OK;
     systemLocked = false;
-    Serial.println("Safety status manually reset - FOR TESTING ONLY");
-    Serial.println("In production, power cycle is required after a motor stall");
+    LOG_W("Safety status manually reset - FOR TESTING ONLY");
+    LOG_W("In production, power cycle is required after a motor stall");
 }
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include "Sensors.h"
+#include "Logger.h"
 
 // Array of switch pins for easy reference
 const uint8_t SwitchPins[4] = {
@@ -25,7 +26,7 @@ void initSwitches() {
     pinMode(SW_TRAY_CLOSED, INPUT_PULLUP);
     pinMode(SW_TRAY_OPENED, INPUT_PULLUP);
     
-    Serial.println("Sensors Initialized!");
+    LOG_I("Sensors Initialized!");
 }
 
 uint8_t readState() {
@@ -1,34 +1,93 @@
 #include "SystemSettings.h"
+#include "Logger.h"
 
 // Create a preferences object
 Preferences preferences;
 
+// Pending LED settings, written by runSettingsPersistence()
+#define PENDING_LED_COLOR 0x01
+#define PENDING_LED_BRIGHTNESS 0x02
+#define PENDING_LED_STATE 0x04
+
+uint8_t pendingSettings = 0;
+unsigned long lastSettingsChange = 0;
+String pendingLEDColor = "";
+uint8_t pendingLEDBrightness = 0;
+uint8_t pendingLEDState = 0;
+
+// Persistence statistics
+uint32_t settingsWriteCount = 0;      // NVS commits
+uint32_t settingsDeferredCount = 0;   // Save requests absorbed before the value settled
+
 void initSettings() {
     // Initialize the settings module
     preferences.begin(SETTINGS_NAMESPACE, false);
     preferences.end();
     
-    Serial.println("Settings module initialized");
+    LOG_I("Settings module initialized");
 }
 
-// Individual save functions
+// Write pending LED settings once they have been unchanged for SETTINGS_SETTLE_MS
+void runSettingsPersistence() {
+    if (pendingSettings == 0 || millis() - lastSettingsChange < SETTINGS_SETTLE_MS) {
+        return;
+    }
+    
+    flushSettings();
+}
 
-void saveLEDColor(String ledColor) {
+// Write all pending settings now
+void flushSettings() {
+    if (pendingSettings == 0) {
+        return;
+    }
+    
     preferences.begin(SETTINGS_NAMESPACE, false);
-    preferences.putString("ledColor", ledColor);
+    if (pendingSettings & PENDING_LED_COLOR) {
+        preferences.putString("ledColor", pendingLEDColor);
+        LOG_D("LED Color saved: %s", pendingLEDColor);
+    }
+    if (pendingSettings & PENDING_LED_BRIGHTNESS) {
+        preferences.putUChar("ledBright", pendingLEDBrightness);
+        LOG_D("LED Brightness saved: %u", pendingLEDBrightness);
+    }
+    if (pendingSettings & PENDING_LED_STATE) {
+        preferences.putUChar("ledState", pendingLEDState);
+        LOG_D("LED State saved: %s", pendingLEDState == 1 ? "ON" : "OFF");
+    }
     preferences.end();
     
-    Serial.print("LED Color saved: ");
-    Serial.println(ledColor);
+    pendingSettings = 0;
+    settingsWriteCount++;
+}
+
+uint32_t getSettingsWriteCount() {
+    return settingsWriteCount;
+}
+
+uint32_t getSettingsDeferredCount() {
+    return settingsDeferredCount;
+}
+
+// Record a pending LED setting and restart the settle window
+void markSettingPending(uint8_t setting) {
+    if (pendingSettings & setting) {
+        settingsDeferredCount++;
+    }
+    pendingSettings |= setting;
+    lastSettingsChange = millis();
+}
+
+// Individual save functions
+
+void saveLEDColor(String ledColor) {
+    pendingLEDColor = ledColor;
+    markSettingPending(PENDING_LED_COLOR);
 }
 
 void saveLEDBrightness(uint8_t ledBrightness) {
-    preferences.begin(SETTINGS_NAMESPACE, false);
-    preferences.putUChar("ledBright", ledBrightness);
-    preferences.end();
-    
-    Serial.print("LED Brightness saved: ");
-    Serial.println(ledBrightness);
+    pendingLEDBrightness = ledBrightness;
+    markSettingPending(PENDING_LED_BRIGHTNESS);
 }
 
 void saveDoorPosition(uint8_t doorPosition) {
@@ -36,17 +95,12 @@ void saveDoorPosition(uint8_t doorPosition) {
     preferences.putUChar("doorPos", doorPosition);
     preferences.end();
     
-    Serial.print("Door Position saved: ");
-    Serial.println(doorPosition);
+    LOG_D("Door Position saved: %u", doorPosition);
 }
 
 void saveLEDState(uint8_t ledState) {
-    preferences.begin(SETTINGS_NAMESPACE, false);
-    preferences.putUChar("ledState", ledState);
-    preferences.end();
-    
-    Serial.print("LED State saved: ");
-    Serial.println(ledState == 1 ? "ON" : "OFF");
+    pendingLEDState = ledState;
+    markSettingPending(PENDING_LED_STATE);
 }
 
 void saveDoorStatus(bool doorOpen) {
@@ -54,8 +108,7 @@ void saveDoorStatus(bool doorOpen) {
     preferences.putBool("doorStatus", doorOpen);
     preferences.end();
     
-    Serial.print("Door Status saved: ");
-    Serial.println(doorOpen ? "OPEN" : "CLOSED");
+    LOG_D("Door Status saved: %s", doorOpen ? "OPEN" : "CLOSED");
 }
 
 void saveChildLockState(bool childLock) {
@@ -63,8 +116,7 @@ void saveChildLockState(bool childLock) {
     preferences.putBool("childLock", childLock);
     preferences.end();
     
-    Serial.print("Child Lock State saved: ");
-    Serial.println(childLock ? "ENABLED" : "DISABLED");
+    LOG_D("Child Lock State saved: %s", childLock ? "ENABLED" : "DISABLED");
 }
 
 // Renamed getter functions to avoid naming conflicts
@@ -132,21 +184,13 @@ bool loadAllSettings(String &ledColor, uint8_t &ledBrightness,
     preferences.end();
     
     if (settingsExist) {
-        Serial.println("Settings loaded from flash memory:");
-        Serial.print("LED Color: ");
-        Serial.println(ledColor);
-        Serial.print("LED Brightness: ");
-        Serial.println(ledBrightness);
-        Serial.print("Door Position: ");
-        Serial.println(doorPosition);
-        Serial.print("LED State: ");
-        Serial.println(ledState == 1 ? "ON" : "OFF");
-        Serial.print("Door Status: ");
-        Serial.println(doorStatus ? "OPEN" : "CLOSED");
-        Serial.print("Child Lock: ");
-        Serial.println(childLock ? "ENABLED" : "DISABLED");
+        LOG_I("Settings loaded from flash memory:");
+        LOG_I("LED Color: %s, LED Brightness: %u, LED State: %s", ledColor, ledBrightness,
+              ledState == 1 ? "ON" : "OFF");
+        LOG_I("Door Position: %u, Door Status: %s, Child Lock: %s", doorPosition,
+              doorStatus ? "OPEN" : "CLOSED", childLock ? "ENABLED" : "DISABLED");
     } else {
-        Serial.println("No saved settings found, using defaults");
+        LOG_I("No saved settings found, using defaults");
     }
     
     return settingsExist;
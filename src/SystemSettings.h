@@ -7,10 +7,19 @@
 // Define settings namespace
 #define SETTINGS_NAMESPACE "solepod"
 
+// Deferred persistence
+#define SETTINGS_SETTLE_MS 1500    // LED settings are written once unchanged for this long
+
 // Function prototypes
 void initSettings();
+void runSettingsPersistence();
+void flushSettings();
+uint32_t getSettingsWriteCount();
+uint32_t getSettingsDeferredCount();
 
-// Individual save functions for each setting
+// Individual save functions for each setting. LED color, brightness and state
+// are only recorded here and written by runSettingsPersistence() once the
+// value settles, so a slider burst costs one flash write.
 void saveLEDColor(String ledColor);
 void saveLEDBrightness(uint8_t ledBrightness);
 void saveDoorPosition(uint8_t doorPosition);
@@ -0,0 +1,352 @@
+#include "TlsClient.h"
+#include "Logger.h"
+#include <esp_attr.h>
+#include <mbedtls/version.h>
+
+// Survives software resets; the magic and length tell a saved session from
+// power-on garbage, and mbedtls_ssl_session_load() checks the rest
+RTC_NOINIT_ATTR uint32_t rtcSessionMagic;
+RTC_NOINIT_ATTR uint32_t rtcSessionLength;
+RTC_NOINIT_ATTR uint8_t rtcSessionData[TLS_SESSION_RTC_SIZE];
+
+#if MBEDTLS_VERSION_NUMBER >= 0x03000000
+// Offer P-256 first; mbedTLS would otherwise list larger, slower curves first
+const uint16_t tlsGroups[] = { MBEDTLS_SSL_IANA_TLS_GROUP_SECP256R1, MBEDTLS_SSL_IANA_TLS_GROUP_SECP384R1,
+                               MBEDTLS_SSL_IANA_TLS_GROUP_NONE };
+#else
+const mbedtls_ecp_group_id tlsCurves[] = { MBEDTLS_ECP_DP_SECP256R1, MBEDTLS_ECP_DP_SECP384R1,
+                                           MBEDTLS_ECP_DP_NONE };
+#endif
+
+TlsClient::TlsClient() {
+    mbedtls_ssl_init(&ssl);
+    mbedtls_ssl_config_init(&conf);
+    mbedtls_ssl_session_init(&session);
+    mbedtls_entropy_init(&entropy);
+    mbedtls_ctr_drbg_init(&drbg);
+    mbedtls_x509_crt_init(&caCert);
+    mbedtls_x509_crt_init(&clientCert);
+    mbedtls_pk_init(&clientKey);
+}
+
+TlsClient::~TlsClient() {
+    stop();
+    mbedtls_ssl_free(&ssl);
+    mbedtls_ssl_config_free(&conf);
+    mbedtls_ssl_session_free(&session);
+    mbedtls_ctr_drbg_free(&drbg);
+    mbedtls_entropy_free(&entropy);
+    mbedtls_x509_crt_free(&caCert);
+    mbedtls_x509_crt_free(&clientCert);
+    mbedtls_pk_free(&clientKey);
+}
+
+void TlsClient::setCACert(const char* pem) {
+    caCertPem = pem;
+}
+
+void TlsClient::setCertificate(const char* pem) {
+    clientCertPem = pem;
+}
+
+void TlsClient::setPrivateKey(const char* pem) {
+    clientKeyPem = pem;
+}
+
+// Parses the credentials and sets up the configuration once; every connect reuses it
+bool TlsClient::configure() {
+    if (configured) {
+        return true;
+    }
+
+    const char* personalization = "solepod";
+    int result = mbedtls_ctr_drbg_seed(&drbg, mbedtls_entropy_func, &entropy,
+                                       (const unsigned char*)personalization, strlen(personalization));
+    if (result == 0) {
+        // Lengths include the terminating NUL, as PEM parsing requires
+        result = mbedtls_x509_crt_parse(&caCert, (const unsigned char*)caCertPem, strlen(caCertPem) + 1);
+    }
+    if (result == 0) {
+        result = mbedtls_x509_crt_parse(&clientCert, (const unsigned char*)clientCertPem, strlen(clientCertPem) + 1);
+    }
+    if (result == 0) {
+#if MBEDTLS_VERSION_NUMBER >= 0x03000000
+        result = mbedtls_pk_parse_key(&clientKey, (const unsigned char*)clientKeyPem, strlen(clientKeyPem) + 1,
+                                      nullptr, 0, mbedtls_ctr_drbg_random, &drbg);
+#else
+        result = mbedtls_pk_parse_key(&clientKey, (const unsigned char*)clientKeyPem, strlen(clientKeyPem) + 1,
+                                      nullptr, 0);
+#endif
+    }
+    if (result == 0) {
+        result = mbedtls_ssl_config_defaults(&conf, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM,
+                                             MBEDTLS_SSL_PRESET_DEFAULT);
+    }
+    if (result == 0) {
+        result = mbedtls_ssl_conf_own_cert(&conf, &clientCert, &clientKey);
+    }
+    if (result != 0) {
+        LOG_E("TLS setup failed: -0x%04x", -result);
+        return false;
+    }
+
+    mbedtls_ssl_conf_authmode(&conf, MBEDTLS_SSL_VERIFY_REQUIRED);
+    mbedtls_ssl_conf_ca_chain(&conf, &caCert, nullptr);
+    mbedtls_ssl_conf_rng(&conf, mbedtls_ctr_drbg_random, &drbg);
+    mbedtls_ssl_conf_session_tickets(&conf, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+    mbedtls_ssl_conf_verify(&conf, verifyCallback, this);
+#if MBEDTLS_VERSION_NUMBER >= 0x03000000
+    mbedtls_ssl_conf_groups(&conf, tlsGroups);
+#else
+    mbedtls_ssl_conf_curves(&conf, tlsCurves);
+#endif
+
+    result = mbedtls_ssl_setup(&ssl, &conf);
+    if (result != 0) {
+        LOG_E("TLS setup failed: -0x%04x", -result);
+        return false;
+    }
+
+    configured = true;
+    LOG_I("TLS configured (%s key, %u bits)", getKeyType(), (uint32_t)mbedtls_pk_get_bitlen(&clientKey));
+
+    loadRtcSession();
+    return true;
+}
+
+void TlsClient::loadRtcSession() {
+    if (rtcSessionMagic != TLS_SESSION_RTC_MAGIC || rtcSessionLength == 0 ||
+        rtcSessionLength > TLS_SESSION_RTC_SIZE) {
+        return;
+    }
+
+    if (mbedtls_ssl_session_load(&session, rtcSessionData, rtcSessionLength) == 0) {
+        sessionValid = true;
+        stats.sessionCached = true;
+        stats.sessionFromRtc = true;
+        LOG_I("TLS session restored from RTC memory (%u bytes)", rtcSessionLength);
+    } else {
+        rtcSessionMagic = 0;
+    }
+}
+
+// Keeps the session for the next connect, in RAM and, if it fits, in RTC memory
+void TlsClient::saveSession() {
+    mbedtls_ssl_session_free(&session);
+    mbedtls_ssl_session_init(&session);
+    if (mbedtls_ssl_get_session(&ssl, &session) != 0) {
+        sessionValid = false;
+        stats.sessionCached = false;
+        return;
+    }
+    sessionValid = true;
+    stats.sessionCached = true;
+
+    size_t length = 0;
+    rtcSessionMagic = 0;
+    if (mbedtls_ssl_session_save(&session, rtcSessionData, TLS_SESSION_RTC_SIZE, &length) == 0) {
+        rtcSessionLength = length;
+        rtcSessionMagic = TLS_SESSION_RTC_MAGIC;
+    } else {
+        LOG_D("TLS session too large for RTC memory, kept in RAM only");
+    }
+}
+
+void TlsClient::clearSession() {
+    mbedtls_ssl_session_free(&session);
+    mbedtls_ssl_session_init(&session);
+    sessionValid = false;
+    stats.sessionCached = false;
+    rtcSessionMagic = 0;
+}
+
+const TlsStats& TlsClient::getStats() const {
+    return stats;
+}
+
+const char* TlsClient::getKeyType() {
+    return mbedtls_pk_get_type(&clientKey) == MBEDTLS_PK_RSA ? "RSA" : "EC";
+}
+
+int TlsClient::sendCallback(void* context, const unsigned char* buffer, size_t length) {
+    WiFiClient* transport = (WiFiClient*)context;
+    if (!transport->connected()) {
+        return -1;
+    }
+
+    size_t written = transport->write(buffer, length);
+    return written > 0 ? (int)written : MBEDTLS_ERR_SSL_WANT_WRITE;
+}
+
+// Never blocks: available() and read() poll through here
+int TlsClient::receiveCallback(void* context, unsigned char* buffer, size_t length) {
+    WiFiClient* transport = (WiFiClient*)context;
+    if (transport->available() <= 0) {
+        return transport->connected() ? MBEDTLS_ERR_SSL_WANT_READ : -1;
+    }
+
+    int received = transport->read(buffer, length);
+    return received > 0 ? received : MBEDTLS_ERR_SSL_WANT_READ;
+}
+
+// Only called when the server sends its certificate, which a resumed handshake skips
+int TlsClient::verifyCallback(void* context, mbedtls_x509_crt* certificate, int depth, uint32_t* flags) {
+    ((TlsClient*)context)->peerVerified = true;
+    return 0;
+}
+
+int TlsClient::connect(IPAddress ip, uint16_t port) {
+    return connect(ip.toString().c_str(), port);
+}
+
+int TlsClient::connect(const char* host, uint16_t port) {
+    stop();
+
+    if (!configure() || !transport.connect(host, port)) {
+        return 0;
+    }
+    transport.setNoDelay(true);
+
+    mbedtls_ssl_set_hostname(&ssl, host);
+    mbedtls_ssl_set_bio(&ssl, &transport, sendCallback, receiveCallback, nullptr);
+    if (sessionValid) {
+        mbedtls_ssl_set_session(&ssl, &session);
+    }
+
+    peerVerified = false;
+    unsigned long handshakeStart = millis();
+    int result;
+    while ((result = mbedtls_ssl_handshake(&ssl)) != 0) {
+        if (result != MBEDTLS_ERR_SSL_WANT_READ && result != MBEDTLS_ERR_SSL_WANT_WRITE) {
+            break;
+        }
+        if (millis() - handshakeStart > TLS_HANDSHAKE_TIMEOUT) {
+            break;
+        }
+        delay(1);
+    }
+    uint32_t handshakeTime = millis() - handshakeStart;
+
+    if (result != 0) {
+        LOG_W("TLS handshake failed after %u ms: -0x%04x", handshakeTime, -result);
+        stats.failedHandshakes++;
+
+        // A stale session can make the server abort; start fresh next time
+        clearSession();
+        stop();
+        return 0;
+    }
+
+    // The server accepted the offered session if it skipped the certificate
+    bool resumed = sessionValid && !peerVerified;
+    if (resumed) {
+        stats.resumedHandshakes++;
+        stats.resumedTimeLast = handshakeTime;
+        stats.resumedTimeTotal += handshakeTime;
+    } else {
+        stats.fullHandshakes++;
+        stats.fullTimeLast = handshakeTime;
+        stats.fullTimeTotal += handshakeTime;
+    }
+    LOG_I("TLS %s handshake in %u ms (%s)", resumed ? "resumed" : "full", handshakeTime,
+          mbedtls_ssl_get_ciphersuite(&ssl));
+
+    saveSession();
+    tlsConnected = true;
+    return 1;
+}
+
+size_t TlsClient::write(uint8_t value) {
+    return write(&value, 1);
+}
+
+size_t TlsClient::write(const uint8_t* buffer, size_t size) {
+    if (!tlsConnected) {
+        return 0;
+    }
+
+    size_t written = 0;
+    unsigned long writeStart = millis();
+    while (written < size) {
+        int result = mbedtls_ssl_write(&ssl, buffer + written, size - written);
+        if (result > 0) {
+            written += result;
+        } else if ((result != MBEDTLS_ERR_SSL_WANT_READ && result != MBEDTLS_ERR_SSL_WANT_WRITE) ||
+                   millis() - writeStart > TLS_WRITE_TIMEOUT) {
+            LOG_W("TLS write failed: -0x%04x", -result);
+            stop();
+            break;
+        } else {
+            delay(1);
+        }
+    }
+    return written;
+}
+
+int TlsClient::available() {
+    if (!tlsConnected) {
+        return 0;
+    }
+
+    // A zero-length read decrypts the next record if one has arrived
+    if (mbedtls_ssl_get_bytes_avail(&ssl) == 0) {
+        int result = mbedtls_ssl_read(&ssl, nullptr, 0);
+        if (result < 0 && result != MBEDTLS_ERR_SSL_WANT_READ && result != MBEDTLS_ERR_SSL_WANT_WRITE) {
+            stop();
+            return 0;
+        }
+    }
+    return mbedtls_ssl_get_bytes_avail(&ssl);
+}
+
+int TlsClient::read() {
+    uint8_t value;
+    return read(&value, 1) == 1 ? value : -1;
+}
+
+int TlsClient::read(uint8_t* buffer, size_t size) {
+    if (!tlsConnected) {
+        return -1;
+    }
+
+    int result = mbedtls_ssl_read(&ssl, buffer, size);
+    if (result > 0) {
+        return result;
+    }
+    if (result != MBEDTLS_ERR_SSL_WANT_READ && result != MBEDTLS_ERR_SSL_WANT_WRITE) {
+        stop();
+    }
+    return -1;
+}
+
+// PubSubClient does not peek; decrypted data cannot be looked at without consuming it
+int TlsClient::peek() {
+    return -1;
+}
+
+void TlsClient::flush() {
+}
+
+void TlsClient::stop() {
+    if (tlsConnected) {
+        mbedtls_ssl_close_notify(&ssl);
+        tlsConnected = false;
+    }
+    transport.stop();
+
+    // Ready for the next handshake; the cached session is kept
+    if (configured) {
+        mbedtls_ssl_session_reset(&ssl);
+    }
+}
+
+uint8_t TlsClient::connected() {
+    if (tlsConnected && !transport.connected() && mbedtls_ssl_get_bytes_avail(&ssl) == 0) {
+        stop();
+    }
+    return tlsConnected;
+}
+
+TlsClient::operator bool() {
+    return connected();
+}
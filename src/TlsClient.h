@@ -0,0 +1,100 @@
+#ifndef TLS_CLIENT_H
+#define TLS_CLIENT_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <mbedtls/ssl.h>
+#include <mbedtls/ctr_drbg.h>
+#include <mbedtls/entropy.h>
+#include <mbedtls/x509_crt.h>
+#include <mbedtls/pk.h>
+
+// TLS client for the MQTT connection. Unlike WiFiClientSecure it keeps the
+// session (or session ticket) from the last handshake and offers it on the
+// next connect, so a reconnect skips the certificate exchange and the
+// public-key operations. The session is also kept in RTC memory, which
+// survives software resets.
+//
+// The device key may be RSA or EC; with an ECDSA P-256 certificate and the
+// ECC root (Amazon Root CA 3) the handshake signs and verifies with P-256
+// instead of RSA-2048. The ESP32-S3 accelerates the SHA and big number
+// arithmetic these use.
+#define TLS_HANDSHAKE_TIMEOUT 10000       // ms
+#define TLS_WRITE_TIMEOUT 5000            // ms
+#define TLS_SESSION_RTC_SIZE 2048         // Serialized session kept across resets (bytes)
+#define TLS_SESSION_RTC_MAGIC 0x544C5331  // "TLS1"
+
+struct TlsStats {
+    uint32_t fullHandshakes;
+    uint32_t resumedHandshakes;
+    uint32_t failedHandshakes;
+    uint32_t fullTimeLast;            // ms
+    uint32_t fullTimeTotal;
+    uint32_t resumedTimeLast;
+    uint32_t resumedTimeTotal;
+    bool sessionCached;
+    bool sessionFromRtc;              // Restored at boot
+};
+
+class TlsClient : public Client {
+private:
+    WiFiClient transport;
+
+    mbedtls_ssl_context ssl;
+    mbedtls_ssl_config conf;
+    mbedtls_ssl_session session;      // From the last handshake
+    mbedtls_entropy_context entropy;
+    mbedtls_ctr_drbg_context drbg;
+    mbedtls_x509_crt caCert;
+    mbedtls_x509_crt clientCert;
+    mbedtls_pk_context clientKey;
+
+    const char* caCertPem = nullptr;
+    const char* clientCertPem = nullptr;
+    const char* clientKeyPem = nullptr;
+
+    bool configured = false;
+    bool sessionValid = false;
+    bool tlsConnected = false;
+    bool peerVerified = false;        // Set when the server sent its certificate (full handshake)
+
+    TlsStats stats = {};
+
+    bool configure();
+    void saveSession();
+    void loadRtcSession();
+
+    static int sendCallback(void* context, const unsigned char* buffer, size_t length);
+    static int receiveCallback(void* context, unsigned char* buffer, size_t length);
+    static int verifyCallback(void* context, mbedtls_x509_crt* certificate, int depth, uint32_t* flags);
+
+public:
+    TlsClient();
+    ~TlsClient();
+
+    // PEM strings, which must stay valid
+    void setCACert(const char* pem);
+    void setCertificate(const char* pem);
+    void setPrivateKey(const char* pem);
+
+    // Forget the cached session so the next connect is a full handshake
+    void clearSession();
+    const TlsStats& getStats() const;
+    const char* getKeyType();
+
+    // Client
+    int connect(IPAddress ip, uint16_t port) override;
+    int connect(const char* host, uint16_t port) override;
+    size_t write(uint8_t value) override;
+    size_t write(const uint8_t* buffer, size_t size) override;
+    int available() override;
+    int read() override;
+    int read(uint8_t* buffer, size_t size) override;
+    int peek() override;
+    void flush() override;
+    void stop() override;
+    uint8_t connected() override;
+    operator bool() override;
+};
+
+#endif // TLS_CLIENT_H
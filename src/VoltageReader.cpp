@@ -1,9 +1,10 @@
 #include "VoltageReader.h"
+#include "Logger.h"
 
 void initVoltageReader() {
     // Initialize GPIO pin as an input
     pinMode(VOLTAGE_PIN, INPUT);
-    Serial.println("Voltage Reading Initialized!");
+    LOG_I("Voltage Reading Initialized!");
 }
 
 float readAverageVoltage() {
@@ -29,8 +30,7 @@ bool isStallDetected() {
     float voltage = readAverageVoltage();
     
     // Log voltage for debugging
-    //Serial.print("Average Voltage: ");
-    //Serial.println(voltage);
+    //LOG_D("Average Voltage: %.3f", voltage);
     
     // Check if voltage exceeds the stall threshold
     return (voltage > STALL_VOLTAGE_THRESHOLD);
@@ -0,0 +1,702 @@
+#include "WiFiControl.h"
+#include <esp_system.h>
+#include <esp_netif.h>
+#include <esp_netif_net_stack.h>
+#include <lwip/dhcp.h>
+#include <lwip/tcpip.h>
+
+WiFiControl::WiFiControl()
+    : ssid(""), password(""), previousSSID(""), previousPassword(""), targetChannel(0), state(WIFI_STATE_IDLE),
+      stateVersion(0), attemptStart(0), disconnectedAt(0), nextReconnectAt(0), lastProbeTime(0), reconnectAttempts(0),
+      provisioning(false), failedSSID(""), scanStart(0), lastRoamCheck(0), roamScanPending(false), roamCount(0),
+      scanResultCount(0), scanResultsVersion(0), scanResultsTime(0), scanRequested(false), cacheValid(false), fastAttempt(false), rebootAddress(0), fastPathFailed(false),
+      bootToIpTime(0), bootFastPath(false), totalReconnectAttempts(0), reconnectCount(0), lastReconnectTime(0),
+      maxReconnectTime(0), pendingEvents(0), lastDisconnectReason(0), credentialsPending(false),
+      pendingPriority(WIFI_DEFAULT_PRIORITY), provisionPriority(WIFI_DEFAULT_PRIORITY) {
+    credentialsLock = portMUX_INITIALIZER_UNLOCKED;
+    pendingSSID[0] = '\0';
+    pendingPassword[0] = '\0';
+    memset(&cache, 0, sizeof(cache));
+}
+
+void WiFiControl::begin() {
+    WiFi.mode(WIFI_STA);
+    WiFi.persistent(false);
+
+    // Reconnects are scheduled by run(), not by the driver
+    WiFi.setAutoReconnect(false);
+
+    WiFi.onEvent([this](arduino_event_id_t event, arduino_event_info_t info) { onEvent(event, info); });
+
+    initNetworkStore();
+    loadCache();
+}
+
+void WiFiControl::loadCache() {
+    wifiPreferences.begin(WIFI_CACHE_NAMESPACE, true);
+    if (wifiPreferences.getUChar("version", 0) == WIFI_CACHE_VERSION &&
+        wifiPreferences.getBytesLength("cache") == sizeof(cache)) {
+        wifiPreferences.getBytes("cache", &cache, sizeof(cache));
+        cache.ssid[WIFI_SSID_MAX_LENGTH] = '\0';
+        cacheValid = cache.channel != 0;
+    }
+    wifiPreferences.end();
+
+    if (cacheValid) {
+        LOG_I("WiFi cache: %s on channel %u", cache.ssid, cache.channel);
+    }
+}
+
+// Written only when the AP or lease changed, so a normal boot costs no flash write
+void WiFiControl::saveCache() {
+    WiFiConnectCache current;
+    memset(&current, 0, sizeof(current));
+    strncpy(current.ssid, ssid.c_str(), WIFI_SSID_MAX_LENGTH);
+    uint8_t* bssid = WiFi.BSSID();
+    if (bssid) {
+        memcpy(current.bssid, bssid, sizeof(current.bssid));
+    }
+    current.channel = WiFi.channel();
+#ifndef WIFI_STATIC_IP
+    current.ip = WiFi.localIP();
+#endif
+
+    if (cacheValid && memcmp(&current, &cache, sizeof(cache)) == 0) {
+        return;
+    }
+
+    cache = current;
+    cacheValid = cache.channel != 0;
+    wifiPreferences.begin(WIFI_CACHE_NAMESPACE, false);
+    wifiPreferences.putUChar("version", WIFI_CACHE_VERSION);
+    wifiPreferences.putBytes("cache", &cache, sizeof(cache));
+    wifiPreferences.end();
+    LOG_D("WiFi cache saved (channel %u)", cache.channel);
+}
+
+// Static address from the build, otherwise DHCP. A fast attempt asks for the
+// cached address when the link comes up, so the server still confirms the lease.
+void WiFiControl::configureAddress() {
+#ifdef WIFI_STATIC_IP
+    IPAddress ip, gateway, subnet, dns;
+    ip.fromString(WIFI_STATIC_IP);
+    gateway.fromString(WIFI_STATIC_GATEWAY);
+    subnet.fromString(WIFI_STATIC_SUBNET);
+    dns.fromString(WIFI_STATIC_DNS);
+    WiFi.config(ip, gateway, subnet, dns);
+#else
+    WiFi.config((uint32_t)0, (uint32_t)0, (uint32_t)0);
+    rebootAddress = (fastAttempt && WIFI_REUSE_LEASE) ? cache.ip : 0;
+#endif
+}
+
+// Runs in the lwIP thread just after the DHCP client started and broadcast
+// its DISCOVER. Turns it into the REQUEST a rebooting client sends for its
+// previous address (RFC 2131 INIT-REBOOT): the server ACKs if the lease is
+// still ours, or NAKs and lwIP goes back to discovery. The OFFER for the
+// discarded DISCOVER is ignored.
+void WiFiControl::requestPreviousAddress(void* context) {
+    esp_netif_t* stationNetif = esp_netif_get_handle_from_ifkey("WIFI_STA_DEF");
+    struct netif* netif = stationNetif ? (struct netif*)esp_netif_get_netif_impl(stationNetif) : nullptr;
+    struct dhcp* dhcp = netif ? netif_dhcp_data(netif) : nullptr;
+    if (dhcp == nullptr || dhcp->state != DHCP_STATE_SELECTING) {
+        return;
+    }
+
+    ip4_addr_set_u32(&dhcp->offered_ip_addr, (uint32_t)(uintptr_t)context);
+    dhcp->state = DHCP_STATE_BOUND;
+    dhcp_network_changed(netif);
+}
+
+// Runs in the WiFi event task: record the event for run()
+void WiFiControl::onEvent(arduino_event_id_t event, arduino_event_info_t info) {
+    switch (event) {
+        case ARDUINO_EVENT_WIFI_STA_CONNECTED: {
+            // The DHCP client was started by the same event
+            uint32_t address = rebootAddress.exchange(0);
+            if (address != 0) {
+                tcpip_callback(requestPreviousAddress, (void*)(uintptr_t)address);
+            }
+            break;
+        }
+
+        case ARDUINO_EVENT_WIFI_STA_GOT_IP:
+            pendingEvents.fetch_or(WIFI_EVENT_GOT_IP);
+            break;
+
+        case ARDUINO_EVENT_WIFI_STA_DISCONNECTED:
+            lastDisconnectReason = info.wifi_sta_disconnected.reason;
+            pendingEvents.fetch_or(WIFI_EVENT_DISCONNECTED);
+            break;
+
+        case ARDUINO_EVENT_WIFI_SCAN_DONE:
+            pendingEvents.fetch_or(WIFI_EVENT_SCAN_DONE);
+            break;
+
+        default:
+            break;
+    }
+}
+
+// Reasons that will not go away by waiting: wrong password or no such network
+bool WiFiControl::isFatalReason(uint8_t reason) {
+    return reason == WIFI_REASON_NO_AP_FOUND || reason == WIFI_REASON_AUTH_FAIL ||
+           reason == WIFI_REASON_HANDSHAKE_TIMEOUT || reason == WIFI_REASON_4WAY_HANDSHAKE_TIMEOUT;
+}
+
+void WiFiControl::setState(uint8_t newState) {
+    if (state != newState) {
+        state = newState;
+        stateVersion++;
+    }
+}
+
+// Associates with ssid: at the cached AP on a fast attempt, at the AP picked
+// from a scan when there is one, otherwise wherever the driver finds it
+void WiFiControl::startAttempt() {
+    pendingEvents.fetch_and(WIFI_EVENT_SCAN_DONE);
+    attemptStart = millis();
+    configureAddress();
+
+    if (fastAttempt) {
+        LOG_I("Starting fast WiFi connection to: %s (channel %u)", ssid, cache.channel);
+        WiFi.begin(ssid.c_str(), password.c_str(), cache.channel, cache.bssid);
+    } else if (targetChannel != 0) {
+        LOG_I("Starting WiFi connection to: %s (channel %u)", ssid, targetChannel);
+        WiFi.begin(ssid.c_str(), password.c_str(), targetChannel, targetBssid);
+    } else {
+        LOG_I("Starting WiFi connection to: %s", ssid);
+        WiFi.begin(ssid.c_str(), password.c_str());
+    }
+}
+
+// The cached AP when it belongs to a known network (no scan or DHCP discovery),
+// otherwise a scan for the best known network
+void WiFiControl::startConnection() {
+    int8_t known = -1;
+    if (WIFI_FAST_CONNECT_ENABLED && cacheValid && !fastPathFailed) {
+        known = findNetwork(cache.ssid);
+    }
+
+    if (known < 0) {
+        startSelection();
+        return;
+    }
+
+    ssid = cache.ssid;
+    password = getNetwork(known).password;
+    fastAttempt = true;
+    targetChannel = 0;
+    startAttempt();
+    setState(WIFI_STATE_CONNECTING);
+}
+
+void WiFiControl::startSelection() {
+    fastAttempt = false;
+    if (getNetworkCount() == 0) {
+        setState(WIFI_STATE_IDLE);
+        return;
+    }
+
+    // A probe scan already running serves just as well
+    if (WiFi.scanComplete() != WIFI_SCAN_RUNNING) {
+        pendingEvents.fetch_and((uint8_t)~WIFI_EVENT_SCAN_DONE);
+        WiFi.scanNetworks(true);
+    }
+    scanStart = millis();
+    setState(WIFI_STATE_SCANNING);
+}
+
+// Index of the best known network in the scan results, or -1. Ranked by RSSI
+// plus WIFI_PRIORITY_WEIGHT per priority level.
+int16_t WiFiControl::rankScanResults(const uint8_t* excludeBssid, int32_t& bestScore) {
+    int16_t count = WiFi.scanComplete();
+    int16_t best = -1;
+
+    for (int16_t i = 0; i < count; i++) {
+        int8_t known = findNetwork(WiFi.SSID(i).c_str());
+        int32_t rssi = WiFi.RSSI(i);
+        if (known < 0 || rssi < WIFI_MIN_RSSI) {
+            continue;
+        }
+        if (excludeBssid && memcmp(WiFi.BSSID(i), excludeBssid, 6) == 0) {
+            continue;
+        }
+
+        int32_t score = rssi + getNetwork(known).priority * WIFI_PRIORITY_WEIGHT;
+        if (best < 0 || score > bestScore) {
+            best = i;
+            bestScore = score;
+        }
+    }
+    return best;
+}
+
+void WiFiControl::connectToScanResult(int16_t result) {
+    const WiFiNetwork& network = getNetwork(findNetwork(WiFi.SSID(result).c_str()));
+    ssid = network.ssid;
+    password = network.password;
+    memcpy(targetBssid, WiFi.BSSID(result), sizeof(targetBssid));
+    targetChannel = WiFi.channel(result);
+    LOG_I("Selected WiFi network %s (%d dBm, priority %u)", ssid, WiFi.RSSI(result), network.priority);
+    WiFi.scanDelete();
+
+    fastAttempt = false;
+    startAttempt();
+    setState(WIFI_STATE_CONNECTING);
+}
+
+// Begins the WiFi connection process without waiting for it to complete
+void WiFiControl::beginConnection(const String& defaultSSID, const String& defaultPassword) {
+    // The built-in network is only a fallback to the provisioned ones
+    if (!defaultSSID.isEmpty() && findNetwork(defaultSSID.c_str()) < 0) {
+        saveNetwork(defaultSSID.c_str(), defaultPassword.c_str(), 0);
+    }
+
+    provisioning = false;
+    startConnection();
+}
+
+bool WiFiControl::updateWiFiCredentials(const String& newSSID, const String& newPassword, uint8_t priority) {
+    if (newSSID.isEmpty() || newSSID.length() > WIFI_SSID_MAX_LENGTH ||
+        newPassword.length() > WIFI_PASSWORD_MAX_LENGTH) {
+        LOG_W("Invalid WiFi credentials rejected");
+        return false;
+    }
+
+    portENTER_CRITICAL(&credentialsLock);
+    memcpy(pendingSSID, newSSID.c_str(), newSSID.length() + 1);
+    memcpy(pendingPassword, newPassword.c_str(), newPassword.length() + 1);
+    pendingPriority = priority;
+    credentialsPending = true;
+    portEXIT_CRITICAL(&credentialsLock);
+
+    return true;
+}
+
+void WiFiControl::handleAttemptFailed(const char* reason) {
+    LOG_W("WiFi connection to %s failed (%s)", ssid, reason);
+
+    if (state == WIFI_STATE_CONNECTING && provisioning) {
+        failedSSID = ssid;
+        provisioning = false;
+
+        // Go back to the network that was connected before the new credentials
+        ssid = previousSSID;
+        password = previousPassword;
+        if (!ssid.isEmpty()) {
+            LOG_W("Failed to connect with new credentials. Reverting to previous network...");
+            startAttempt();
+            setState(WIFI_STATE_REVERTING);
+        } else {
+            // Known networks are tried again after the usual wait
+            WiFi.disconnect();
+            scheduleReconnect();
+            setState(WIFI_STATE_FAILED);
+        }
+        return;
+    }
+
+    WiFi.disconnect();
+    waitForReconnect();
+}
+
+// No known network reachable: retry later
+void WiFiControl::waitForReconnect() {
+    if (disconnectedAt == 0) {
+        disconnectedAt = millis();
+    }
+    scheduleReconnect();
+    setState(WIFI_STATE_DISCONNECTED);
+}
+
+// Quick retries first, then exponential backoff with jitter up to the cap
+void WiFiControl::scheduleReconnect() {
+    unsigned long delayTime;
+    if (reconnectAttempts < WIFI_RECONNECT_FAST_RETRIES) {
+        delayTime = WIFI_RECONNECT_FAST_DELAY;
+    } else {
+        uint8_t doublings = reconnectAttempts - WIFI_RECONNECT_FAST_RETRIES;
+        delayTime = WIFI_RECONNECT_MAX_DELAY;
+        if (doublings < 16 && ((unsigned long)WIFI_RECONNECT_BASE_DELAY << doublings) < WIFI_RECONNECT_MAX_DELAY) {
+            delayTime = (unsigned long)WIFI_RECONNECT_BASE_DELAY << doublings;
+        }
+
+        unsigned long jitterRange = delayTime * WIFI_RECONNECT_JITTER_PERCENT / 100;
+        delayTime = delayTime - jitterRange + esp_random() % (2 * jitterRange + 1);
+    }
+
+    nextReconnectAt = millis() + delayTime;
+    lastProbeTime = millis();
+    LOG_D("WiFi reconnect attempt %u in %lu ms", reconnectAttempts + 1, delayTime);
+}
+
+// A short scan costs far less air time than a full association attempt,
+// so a long wait is broken up with scans that can end it early
+void WiFiControl::probeForNetwork() {
+    if (WiFi.scanComplete() == WIFI_SCAN_RUNNING) {
+        return;
+    }
+
+    lastProbeTime = millis();
+    WiFi.scanNetworks(true, false, false, 120);
+}
+
+// Keeps one entry per SSID, at its strongest access point, sorted by RSSI.
+// Hidden networks are left out; they cannot be picked from a list.
+void WiFiControl::captureScanResults() {
+    int16_t count = WiFi.scanComplete();
+    if (count < 0) {
+        return;
+    }
+
+    scanResultCount = 0;
+    for (int16_t i = 0; i < count; i++) {
+        String resultSSID = WiFi.SSID(i);
+        if (resultSSID.isEmpty() || resultSSID.length() > WIFI_SSID_MAX_LENGTH) {
+            continue;
+        }
+
+        int8_t rssi = WiFi.RSSI(i);
+        int8_t slot = -1;
+        for (uint8_t j = 0; j < scanResultCount; j++) {
+            if (resultSSID == scanResults[j].ssid) {
+                slot = j;
+                break;
+            }
+        }
+        if (slot >= 0 && scanResults[slot].rssi >= rssi) {
+            continue;
+        }
+
+        // Full: replace the weakest entry if this one is stronger
+        if (slot < 0) {
+            if (scanResultCount < WIFI_SCAN_CACHE_SIZE) {
+                slot = scanResultCount++;
+            } else {
+                slot = WIFI_SCAN_CACHE_SIZE - 1;
+                if (scanResults[slot].rssi >= rssi) {
+                    continue;
+                }
+            }
+        }
+
+        WiFiScanResult& result = scanResults[slot];
+        strncpy(result.ssid, resultSSID.c_str(), sizeof(result.ssid) - 1);
+        result.ssid[sizeof(result.ssid) - 1] = '\0';
+        result.rssi = rssi;
+        result.channel = WiFi.channel(i);
+        result.flags = 0;
+        if (WiFi.encryptionType(i) != WIFI_AUTH_OPEN) result.flags |= WIFI_SCAN_FLAG_SECURED;
+        if (findNetwork(result.ssid) >= 0) result.flags |= WIFI_SCAN_FLAG_KNOWN;
+
+        // Move up to keep the list sorted, strongest first
+        while (slot > 0 && scanResults[slot - 1].rssi < scanResults[slot].rssi) {
+            WiFiScanResult swap = scanResults[slot - 1];
+            scanResults[slot - 1] = scanResults[slot];
+            scanResults[slot] = swap;
+            slot--;
+        }
+    }
+
+    scanResultsTime = millis();
+    scanResultsVersion++;
+    LOG_D("WiFi scan: %d access points, %u networks", count, scanResultCount);
+}
+
+// While the signal is weak, scan now and then and move to an access point
+// of a known network that ranks better by WIFI_ROAM_HYSTERESIS
+void WiFiControl::checkRoaming(uint8_t events, unsigned long currentTime) {
+    if (roamScanPending) {
+        if (!(events & WIFI_EVENT_SCAN_DONE)) {
+            return;
+        }
+        roamScanPending = false;
+
+        int8_t current = findNetwork(ssid.c_str());
+        int32_t currentScore = WiFi.RSSI() + (current >= 0 ? getNetwork(current).priority : 0) * WIFI_PRIORITY_WEIGHT;
+        int32_t bestScore = 0;
+        int16_t best = rankScanResults(WiFi.BSSID(), bestScore);
+        if (best >= 0 && bestScore >= currentScore + WIFI_ROAM_HYSTERESIS) {
+            LOG_I("Roaming from %s (%d dBm) to %s (%d dBm)", ssid, WiFi.RSSI(), WiFi.SSID(best), WiFi.RSSI(best));
+            roamCount++;
+            WiFi.disconnect();
+            connectToScanResult(best);
+        } else {
+            WiFi.scanDelete();
+        }
+        return;
+    }
+
+    if (currentTime - lastRoamCheck < WIFI_ROAM_CHECK_INTERVAL) {
+        return;
+    }
+    lastRoamCheck = currentTime;
+
+    int8_t rssi = WiFi.RSSI();
+    if (rssi < WIFI_ROAM_RSSI_THRESHOLD && WiFi.scanComplete() != WIFI_SCAN_RUNNING) {
+        LOG_D("Weak WiFi signal (%d dBm), scanning for a better access point", rssi);
+        roamScanPending = true;
+        WiFi.scanNetworks(true);
+    }
+}
+
+void WiFiControl::run() {
+    unsigned long currentTime = millis();
+
+    // New credentials from BLE
+    if (credentialsPending) {
+        char newSSID[WIFI_SSID_MAX_LENGTH + 1];
+        char newPassword[WIFI_PASSWORD_MAX_LENGTH + 1];
+        portENTER_CRITICAL(&credentialsLock);
+        memcpy(newSSID, pendingSSID, sizeof(newSSID));
+        memcpy(newPassword, pendingPassword, sizeof(newPassword));
+        provisionPriority = pendingPriority;
+        credentialsPending = false;
+        portEXIT_CRITICAL(&credentialsLock);
+
+        // Remember the network to revert to, only if it is actually connected
+        if (state == WIFI_STATE_CONNECTED) {
+            previousSSID = ssid;
+            previousPassword = password;
+        } else {
+            previousSSID = "";
+            previousPassword = "";
+        }
+
+        ssid = newSSID;
+        password = newPassword;
+        provisioning = true;
+        fastAttempt = false;
+        targetChannel = 0;
+        roamScanPending = false;
+        disconnectedAt = 0;
+        reconnectAttempts = 0;
+        WiFi.disconnect();
+        startAttempt();
+        setState(WIFI_STATE_CONNECTING);
+        return;
+    }
+
+    uint8_t events = pendingEvents.exchange(0);
+    if (events & WIFI_EVENT_SCAN_DONE) {
+        captureScanResults();
+    }
+
+    // Background scan for provisioning, skipped while an attempt needs the radio
+    if (scanRequested.load() && state != WIFI_STATE_CONNECTING && state != WIFI_STATE_REVERTING &&
+        state != WIFI_STATE_SCANNING && WiFi.scanComplete() != WIFI_SCAN_RUNNING) {
+        scanRequested.store(false);
+        if (scanResultsTime == 0 || currentTime - scanResultsTime > WIFI_SCAN_MAX_AGE) {
+            LOG_D("Starting background WiFi scan");
+            WiFi.scanNetworks(true);
+        }
+    }
+
+    switch (state) {
+        case WIFI_STATE_CONNECTING:
+        case WIFI_STATE_REVERTING:
+            if (events & WIFI_EVENT_GOT_IP) {
+                LOG_I("Connected to WiFi! Network: %s, IP address: %s (%lu ms)", ssid,
+                      WiFi.localIP().toString(), currentTime - attemptStart);
+                if (disconnectedAt != 0) {
+                    lastReconnectTime = currentTime - disconnectedAt;
+                    if (lastReconnectTime > maxReconnectTime) {
+                        maxReconnectTime = lastReconnectTime;
+                    }
+                    reconnectCount++;
+                    LOG_I("WiFi reconnected after %lu ms and %u attempts", lastReconnectTime, reconnectAttempts);
+                }
+                if (bootToIpTime == 0) {
+                    bootToIpTime = currentTime;
+                    bootFastPath = fastAttempt;
+                    LOG_I("Boot to IP: %lu ms (%s)", bootToIpTime, fastAttempt ? "fast" : "full");
+                }
+                fastPathFailed = false;
+                saveCache();
+
+                // Provisioned credentials are kept once they have worked
+                if (provisioning) {
+                    saveNetwork(ssid.c_str(), password.c_str(), provisionPriority);
+                } else {
+                    touchNetwork(ssid.c_str());
+                }
+                disconnectedAt = 0;
+                reconnectAttempts = 0;
+                provisioning = false;
+                lastRoamCheck = currentTime;
+                setState(WIFI_STATE_CONNECTED);
+            } else if (fastAttempt && (((events & WIFI_EVENT_DISCONNECTED) &&
+                                        lastDisconnectReason != WIFI_REASON_ASSOC_LEAVE) ||
+                                       currentTime - attemptStart > WIFI_FAST_CONNECT_TIMEOUT)) {
+                // The AP may have moved channel or been replaced: scan and use DHCP
+                LOG_W("Fast WiFi connection failed, falling back to full connect");
+                fastPathFailed = true;
+                WiFi.disconnect();
+                startSelection();
+            } else if ((events & WIFI_EVENT_DISCONNECTED) && isFatalReason(lastDisconnectReason)) {
+                // Fail at once rather than waiting out the timeout
+                handleAttemptFailed(lastDisconnectReason == WIFI_REASON_NO_AP_FOUND ? "network not found"
+                                                                                   : "authentication failed");
+            } else if (currentTime - attemptStart > WIFI_CONNECT_TIMEOUT) {
+                handleAttemptFailed("timed out");
+            }
+            break;
+
+        case WIFI_STATE_CONNECTED:
+            if (events & WIFI_EVENT_DISCONNECTED) {
+                LOG_W("WiFi connection lost (reason %u)", lastDisconnectReason);
+                disconnectedAt = currentTime;
+                reconnectAttempts = 0;
+                roamScanPending = false;
+                scheduleReconnect();
+                setState(WIFI_STATE_DISCONNECTED);
+            } else {
+                checkRoaming(events, currentTime);
+            }
+            break;
+
+        case WIFI_STATE_SCANNING:
+            if (events & WIFI_EVENT_SCAN_DONE) {
+                int32_t bestScore = 0;
+                int16_t best = rankScanResults(nullptr, bestScore);
+                if (best >= 0) {
+                    connectToScanResult(best);
+                } else {
+                    LOG_W("No known WiFi network in range");
+                    WiFi.scanDelete();
+                    waitForReconnect();
+                }
+            } else if (currentTime - scanStart > WIFI_SCAN_TIMEOUT) {
+                LOG_W("WiFi scan timed out");
+                waitForReconnect();
+            }
+            break;
+
+        case WIFI_STATE_FAILED:
+            if (getNetworkCount() > 0 && (long)(currentTime - nextReconnectAt) >= 0) {
+                startConnection();
+            }
+            break;
+
+        case WIFI_STATE_DISCONNECTED:
+            if (getNetworkCount() == 0) {
+                break;
+            }
+
+            // A known network is back: skip the rest of the wait
+            if (events & WIFI_EVENT_SCAN_DONE) {
+                int32_t bestScore = 0;
+                int16_t best = rankScanResults(nullptr, bestScore);
+                if (best >= 0) {
+                    LOG_I("Known WiFi network %s seen again, reconnecting now", WiFi.SSID(best));
+                    reconnectAttempts = 0;
+                    totalReconnectAttempts++;
+                    connectToScanResult(best);
+                    break;
+                }
+                WiFi.scanDelete();
+            }
+
+            if ((long)(currentTime - nextReconnectAt) >= 0) {
+                reconnectAttempts++;
+                totalReconnectAttempts++;
+                LOG_W("WiFi reconnect attempt %u...", reconnectAttempts);
+                startConnection();
+            } else if (nextReconnectAt - currentTime > WIFI_PROBE_INTERVAL &&
+                       currentTime - lastProbeTime >= WIFI_PROBE_INTERVAL) {
+                probeForNetwork();
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    // Results nobody else consumed
+    if (events & WIFI_EVENT_SCAN_DONE) {
+        WiFi.scanDelete();
+    }
+}
+
+// Disconnects from WiFi
+void WiFiControl::disconnectWiFi() {
+    ssid = "";
+    password = "";
+    provisioning = false;
+    disconnectedAt = 0;
+    reconnectAttempts = 0;
+
+    if (WiFi.status() == WL_CONNECTED) {
+        WiFi.disconnect();
+        LOG_I("Disconnected from WiFi");
+    } else {
+        LOG_I("Not connected to WiFi");
+    }
+    setState(WIFI_STATE_IDLE);
+}
+
+String WiFiControl::getStatusString() {
+    switch (state) {
+        case WIFI_STATE_CONNECTING:
+            return "CONNECTING:" + ssid;
+        case WIFI_STATE_CONNECTED:
+            return "CONNECTED:" + ssid + ":" + WiFi.localIP().toString();
+        case WIFI_STATE_FAILED:
+            return "FAILED:" + failedSSID;
+        case WIFI_STATE_REVERTING:
+            return "REVERTING:" + failedSSID;
+        case WIFI_STATE_SCANNING:
+            return "SCANNING";
+        default:
+            return "DISCONNECTED";
+    }
+}
+
+void WiFiControl::printConnectionInfo() {
+    LOG_I("WiFi: %s", getStatusString());
+    if (state == WIFI_STATE_CONNECTED) {
+        LOG_I("  Signal: %d dBm, channel %d", WiFi.RSSI(), WiFi.channel());
+    }
+    if (state == WIFI_STATE_DISCONNECTED && getNetworkCount() > 0) {
+        LOG_I("  Outage: %lu ms, attempts: %u, next attempt in %lu ms", millis() - disconnectedAt,
+              reconnectAttempts, (long)(nextReconnectAt - millis()) > 0 ? nextReconnectAt - millis() : 0);
+    }
+    LOG_I("  Reconnects: %u, attempts: %u, last: %lu ms, max: %lu ms, roams: %u", reconnectCount,
+          totalReconnectAttempts, lastReconnectTime, maxReconnectTime, roamCount);
+    if (bootToIpTime != 0) {
+        LOG_I("  Boot to IP: %lu ms (%s path)", bootToIpTime, bootFastPath ? "fast" : "full");
+    }
+    if (cacheValid) {
+        LOG_I("  Cached AP: %s, channel %u, %s", cache.ssid, cache.channel,
+              fastPathFailed ? "fast path failed" : "fast path ready");
+    }
+    if (scanResultsTime != 0) {
+        LOG_I("  Scan results: %u networks, %lu ms old", scanResultCount, millis() - scanResultsTime);
+    }
+    for (uint8_t i = 0; i < getNetworkCount(); i++) {
+        LOG_I("  Known network %u: %s (priority %u)", i + 1, getNetwork(i).ssid, getNetwork(i).priority);
+    }
+}
+
+// Returns a readable string representation of the WiFi status
+String WiFiControl::getWiFiStatusString() {
+    switch (WiFi.status()) {
+        case WL_CONNECTED:
+            return "Connected";
+        case WL_IDLE_STATUS:
+            return "Idle";
+        case WL_NO_SSID_AVAIL:
+            return "SSID not available";
+        case WL_SCAN_COMPLETED:
+            return "Scan completed";
+        case WL_CONNECT_FAILED:
+            return "Connection failed";
+        case WL_CONNECTION_LOST:
+            return "Connection lost";
+        case WL_DISCONNECTED:
+            return "Disconnected";
+        default:
+            return "Unknown status";
+    }
+}
@@ -2,139 +2,234 @@
 #define WIFI_CONTROL_H
 
 #include <WiFi.h>
+#include <Preferences.h>
+#include <atomic>
+#include "Logger.h"
+#include "WiFiNetworkStore.h"
 
+// Connection states
+#define WIFI_STATE_IDLE 0                 // No credentials
+#define WIFI_STATE_CONNECTING 1
+#define WIFI_STATE_CONNECTED 2
+#define WIFI_STATE_FAILED 3               // Provisioned credentials did not connect
+#define WIFI_STATE_REVERTING 4            // Provisioned credentials failed, reconnecting to the previous network
+#define WIFI_STATE_DISCONNECTED 5         // Link lost, waiting to reconnect
+#define WIFI_STATE_SCANNING 6             // Looking for the best known network
+
+// Timing (milliseconds)
+#define WIFI_CONNECT_TIMEOUT 15000        // Give up on an attempt that neither connects nor fails
+#define WIFI_SCAN_TIMEOUT 10000
+
+// Network selection: known networks in a scan are ranked by RSSI plus a
+// bonus per priority level
+#define WIFI_PRIORITY_WEIGHT 10           // dB per priority level
+#define WIFI_MIN_RSSI -88                 // Weaker access points are ignored
+
+// Roaming: while the signal is weak, scan now and then and move to an
+// access point that ranks clearly better
+#define WIFI_ROAM_RSSI_THRESHOLD -75      // dBm
+#define WIFI_ROAM_CHECK_INTERVAL 30000    // A scan stalls traffic briefly, so not too often
+#define WIFI_ROAM_HYSTERESIS 8            // dB the new access point must win by
+
+// Reconnect backoff (milliseconds): the first retries are quick, then the
+// wait doubles up to a cap, with random jitter so pods behind the same
+// router do not retry in step
+#define WIFI_RECONNECT_FAST_RETRIES 2     // Attempts made after the fast delay
+#define WIFI_RECONNECT_FAST_DELAY 1000
+#define WIFI_RECONNECT_BASE_DELAY 4000    // First backed-off delay, doubled per attempt
+#define WIFI_RECONNECT_MAX_DELAY 120000
+#define WIFI_RECONNECT_JITTER_PERCENT 25  // Delay varies by up to +/- this much
+#define WIFI_PROBE_INTERVAL 15000         // Scan for known networks while a long wait is pending
+
+// Scan results kept for provisioning: one entry per SSID, strongest first
+#define WIFI_SCAN_CACHE_SIZE 20
+#define WIFI_SCAN_MAX_AGE 30000           // Results this recent are reused instead of scanning again
+#define WIFI_SCAN_FLAG_SECURED 0x01
+#define WIFI_SCAN_FLAG_KNOWN 0x02         // In the known networks
+
+struct WiFiScanResult {
+    char ssid[33];
+    int8_t rssi;               // Strongest access point of this SSID (dBm)
+    uint8_t channel;
+    uint8_t flags;             // WIFI_SCAN_FLAG_*
+};
+
+// Events recorded by the WiFi event task, handled by run()
+#define WIFI_EVENT_GOT_IP 0x01
+#define WIFI_EVENT_DISCONNECTED 0x02
+#define WIFI_EVENT_SCAN_DONE 0x04
+
+#define WIFI_SSID_MAX_LENGTH 32
+#define WIFI_PASSWORD_MAX_LENGTH 64
+
+// Fast connect: the AP and address of the last successful connection are
+// kept in NVS so the next attempt can skip the scan and DHCP discovery
+#define WIFI_CACHE_NAMESPACE "solewifi"
+#define WIFI_CACHE_VERSION 2
+#define WIFI_FAST_CONNECT_ENABLED 1
+#define WIFI_FAST_CONNECT_TIMEOUT 4000    // Fall back to a full connect after this long
+#ifndef WIFI_REUSE_LEASE
+#define WIFI_REUSE_LEASE 1                // Ask DHCP for the cached address on fast attempts, like a rebooting client
+#endif
+
+// A fixed address can be set at build time instead, e.g.
+// -DWIFI_STATIC_IP=\"192.168.1.50\" -DWIFI_STATIC_GATEWAY=\"192.168.1.1\"
+// -DWIFI_STATIC_SUBNET=\"255.255.255.0\" -DWIFI_STATIC_DNS=\"192.168.1.1\"
+
+struct WiFiConnectCache {
+    char ssid[WIFI_SSID_MAX_LENGTH + 1];
+    uint8_t bssid[6];
+    uint8_t channel;
+    uint32_t ip;               // Address of the last DHCP lease (0 with a static address)
+};
+
+// Non-blocking WiFi connection manager. WiFi events only record what
+// happened; run(), called from the main loop, moves the state machine and
+// starts attempts, so no caller ever waits for the radio.
 class WiFiControl {
 private:
     String ssid;
     String password;
     String previousSSID;
     String previousPassword;
-    const unsigned long connectionTimeout = 30000; // Timeout in milliseconds (30 seconds)
+    uint8_t targetBssid[6];            // Access point picked from a scan
+    uint8_t targetChannel;             // 0 = let the driver find the network
+
+    uint8_t state;
+    uint32_t stateVersion;             // Incremented on every state change
+    unsigned long attemptStart;
+    unsigned long disconnectedAt;      // Start of the current outage, 0 when connected
+    unsigned long nextReconnectAt;
+    unsigned long lastProbeTime;
+    uint16_t reconnectAttempts;        // Attempts in the current outage
+    bool provisioning;                 // Current attempt uses credentials just received
+    String failedSSID;                 // Provisioned network that failed, for status reports
+    unsigned long scanStart;
+    unsigned long lastRoamCheck;
+    bool roamScanPending;
+    uint32_t roamCount;
+
+    // Scan results, refreshed by every completed scan
+    WiFiScanResult scanResults[WIFI_SCAN_CACHE_SIZE];
+    uint8_t scanResultCount;
+    uint32_t scanResultsVersion;
+    unsigned long scanResultsTime;
+    std::atomic<bool> scanRequested;   // Set from any task by requestScan()
+
+    // Fast connect
+    Preferences wifiPreferences;
+    WiFiConnectCache cache;
+    bool cacheValid;
+    bool fastAttempt;                  // Current attempt is directed at the cached AP
+    std::atomic<uint32_t> rebootAddress; // Address to request when the link comes up (0 = discover)
+    bool fastPathFailed;               // Skip the cache until a full connect refreshes it
+    unsigned long bootToIpTime;        // 0 until the first IP after boot
+    bool bootFastPath;
+
+    // Reconnect statistics
+    uint32_t totalReconnectAttempts;
+    uint32_t reconnectCount;
+    unsigned long lastReconnectTime;   // Outage length, link lost to IP
+    unsigned long maxReconnectTime;
+
+    // Written by the WiFi event task
+    std::atomic<uint8_t> pendingEvents;
+    volatile uint8_t lastDisconnectReason;
+
+    // Credentials received over BLE, picked up by run()
+    portMUX_TYPE credentialsLock;
+    volatile bool credentialsPending;
+    char pendingSSID[WIFI_SSID_MAX_LENGTH + 1];
+    char pendingPassword[WIFI_PASSWORD_MAX_LENGTH + 1];
+    uint8_t pendingPriority;
+    uint8_t provisionPriority;         // Priority the provisioned network is stored with
+
+    void setState(uint8_t newState);
+    void startAttempt();
+    void startConnection();
+    void startSelection();
+    int16_t rankScanResults(const uint8_t* excludeBssid, int32_t& bestScore);
+    void connectToScanResult(int16_t result);
+    void checkRoaming(uint8_t events, unsigned long currentTime);
+    void captureScanResults();
+    void handleAttemptFailed(const char* reason);
+    void waitForReconnect();
+    void configureAddress();
+    static void requestPreviousAddress(void* context);
+    void loadCache();
+    void saveCache();
+    void scheduleReconnect();
+    void probeForNetwork();
+    void onEvent(arduino_event_id_t event, arduino_event_info_t info);
+    static bool isFatalReason(uint8_t reason);
 
 public:
-    WiFiControl() : ssid(""), password(""), previousSSID(""), previousPassword("") {}
-    
+    WiFiControl();
+
+    // Registers for WiFi events; call once from setup()
+    void begin();
+
+    // Call from main loop - handles events, timeouts and reconnects
+    void run();
+
+    // Begins connecting to the best known network without waiting for it to
+    // complete. A non-empty default network is added to the known networks.
+    void beginConnection(const String& defaultSSID, const String& defaultPassword);
+
+    // Queues new credentials from any task. run() tries them; on success they
+    // are stored, on failure it goes back to the network connected before.
+    bool updateWiFiCredentials(const String& newSSID, const String& newPassword,
+                               uint8_t priority = WIFI_DEFAULT_PRIORITY);
+
+    // Disconnects from WiFi
+    void disconnectWiFi();
+
+    // Connection state
+    uint8_t getState() const { return state; }
+    uint32_t getStateVersion() const { return stateVersion; }
+    String getStatusString();  // Reported over BLE, e.g. "CONNECTED:<ssid>:<ip>"
+
+    // Asks for fresh scan results from any task. The scan runs in the
+    // background once the radio is not busy connecting.
+    void requestScan() { scanRequested.store(true); }
+    uint8_t getScanResultCount() const { return scanResultCount; }
+    const WiFiScanResult& getScanResult(uint8_t index) const { return scanResults[index]; }
+    uint32_t getScanResultsVersion() const { return scanResultsVersion; }
+
+    // Reconnect statistics
+    uint32_t getReconnectAttempts() const { return totalReconnectAttempts; }
+    uint32_t getReconnectCount() const { return reconnectCount; }
+    uint32_t getRoamCount() const { return roamCount; }
+    unsigned long getBootToIpTime() const { return bootToIpTime; }
+    void printConnectionInfo();
+
     // Returns the current WiFi status as defined by the WiFi.h library
     int getWiFiStatus() {
         return WiFi.status();
     }
-    
+
     // Returns a readable string representation of the WiFi status
-    String getWiFiStatusString() {
-        switch (WiFi.status()) {
-            case WL_CONNECTED:
-                return "Connected";
-            case WL_IDLE_STATUS:
-                return "Idle";
-            case WL_NO_SSID_AVAIL:
-                return "SSID not available";
-            case WL_SCAN_COMPLETED:
-                return "Scan completed";
-            case WL_CONNECT_FAILED:
-                return "Connection failed";
-            case WL_CONNECTION_LOST:
-                return "Connection lost";
-            case WL_DISCONNECTED:
-                return "Disconnected";
-            default:
-                return "Unknown status";
-        }
-    }
+    String getWiFiStatusString();
 
-    // Begins the WiFi connection process without waiting for it to complete
-    void beginConnection(const String& newSSID, const String& newPassword) {
-        // Update stored credentials
-        ssid = newSSID;
-        password = newPassword;
-        
-        // Start connection attempt without waiting
-        Serial.printf("Starting WiFi connection to: %s\n", ssid.c_str());
-        WiFi.begin(ssid.c_str(), password.c_str());
-    }
-    
-    // Attempts to connect to WiFi with the provided credentials
-    // Returns true if connection was successful, false otherwise
-    bool connectWiFi(const String& newSSID, const String& newPassword) {
-        // Update stored credentials
-        ssid = newSSID;
-        password = newPassword;
-        
-        // Attempt to connect
-        Serial.printf("Connecting to WiFi network: %s\n", ssid.c_str());
-        WiFi.begin(ssid.c_str(), password.c_str());
-        
-        // Wait for connection with timeout
-        unsigned long startTime = millis();
-        while (WiFi.status() != WL_CONNECTED) {
-            if (millis() - startTime > connectionTimeout) {
-                Serial.println("Connection timed out!");
-                return false;
-            }
-            delay(500);
-            Serial.print(".");
-        }
-        
-        Serial.println("\nConnected to WiFi!");
-        Serial.printf("IP address: %s\n", WiFi.localIP().toString().c_str());
-        return true;
-    }
-    
-    // Updates WiFi credentials and attempts to connect
-    // If connection fails, reverts to previous network if it was connected
-    bool updateWiFiCredentials(const String& newSSID, const String& newPassword) {
-        // Store current credentials as previous credentials
-        previousSSID = ssid;
-        previousPassword = password;
-        
-        // If currently connected, remember this
-        bool wasConnected = (WiFi.status() == WL_CONNECTED);
-        
-        // Attempt to connect with new credentials
-        if (connectWiFi(newSSID, newPassword)) {
-            return true;
-        }
-        
-        // If connection failed and was previously connected, try to reconnect to previous network
-        if (wasConnected && !previousSSID.isEmpty() && !previousPassword.isEmpty()) {
-            Serial.println("Failed to connect with new credentials. Reverting to previous network...");
-            // Restore original credentials
-            ssid = previousSSID;
-            password = previousPassword;
-            return connectWiFi(ssid, password);
-        }
-        
-        return false;
-    }
-    
-    // Disconnects from WiFi
-    void disconnectWiFi() {
-        if (WiFi.status() == WL_CONNECTED) {
-            WiFi.disconnect();
-            Serial.println("Disconnected from WiFi");
-        } else {
-            Serial.println("Not connected to WiFi");
-        }
-    }
-    
     // Get the current SSID
     String getCurrentSSID() const {
         return ssid;
     }
-    
+
     // Get the current password
     String getCurrentPassword() const {
         return password;
     }
-    
+
     // Get the local IP address if connected
     IPAddress getLocalIP() {
         return WiFi.localIP();
     }
-    
+
     // Get signal strength if connected
     int getSignalStrength() {
         return WiFi.RSSI();
     }
 };
 
-#endif // WIFI_CONTROL_H
\ No newline at end of file
+#endif // WIFI_CONTROL_H
@@ -0,0 +1,103 @@
+#include "WiFiNetworkStore.h"
+#include "Logger.h"
+
+Preferences networkPreferences;
+
+WiFiNetwork networks[WIFI_MAX_NETWORKS];
+uint8_t networkCount = 0;
+
+void writeNetworkStore() {
+    networkPreferences.begin(NETWORK_NAMESPACE, false);
+    networkPreferences.putUChar("version", NETWORK_STORE_VERSION);
+    networkPreferences.putBytes("networks", networks, networkCount * sizeof(WiFiNetwork));
+    networkPreferences.end();
+
+    LOG_D("Network store saved (%u networks)", networkCount);
+}
+
+void initNetworkStore() {
+    networkPreferences.begin(NETWORK_NAMESPACE, true);
+    uint8_t version = networkPreferences.getUChar("version", 0);
+    size_t length = networkPreferences.getBytesLength("networks");
+    if (version == NETWORK_STORE_VERSION && length <= sizeof(networks) && length % sizeof(WiFiNetwork) == 0) {
+        networkPreferences.getBytes("networks", networks, length);
+        networkCount = length / sizeof(WiFiNetwork);
+    }
+    networkPreferences.end();
+
+    LOG_I("Network store initialized (%u/%u networks)", networkCount, WIFI_MAX_NETWORKS);
+}
+
+int8_t findNetwork(const char* ssid) {
+    for (uint8_t i = 0; i < networkCount; i++) {
+        if (strcmp(networks[i].ssid, ssid) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void saveNetwork(const char* ssid, const char* password, uint8_t priority) {
+    int8_t index = findNetwork(ssid);
+    if (index == 0 && strcmp(networks[0].password, password) == 0 && networks[0].priority == priority) {
+        return;
+    }
+
+    WiFiNetwork network;
+    memset(&network, 0, sizeof(network));
+    strncpy(network.ssid, ssid, sizeof(network.ssid) - 1);
+    strncpy(network.password, password, sizeof(network.password) - 1);
+    network.priority = priority > WIFI_MAX_PRIORITY ? WIFI_MAX_PRIORITY : priority;
+
+    if (index < 0) {
+        // Full: drop the lowest priority network, the least recently connected on a tie
+        if (networkCount == WIFI_MAX_NETWORKS) {
+            uint8_t victim = networkCount - 1;
+            for (int8_t i = networkCount - 2; i >= 0; i--) {
+                if (networks[i].priority < networks[victim].priority) {
+                    victim = i;
+                }
+            }
+            LOG_I("Network store full, forgetting %s", networks[victim].ssid);
+            memmove(&networks[victim], &networks[victim + 1], (networkCount - victim - 1) * sizeof(WiFiNetwork));
+            networkCount--;
+        }
+        index = networkCount++;
+    }
+
+    memmove(&networks[1], &networks[0], index * sizeof(WiFiNetwork));
+    networks[0] = network;
+    writeNetworkStore();
+}
+
+void touchNetwork(const char* ssid) {
+    int8_t index = findNetwork(ssid);
+    if (index <= 0) {
+        return;
+    }
+
+    WiFiNetwork network = networks[index];
+    memmove(&networks[1], &networks[0], index * sizeof(WiFiNetwork));
+    networks[0] = network;
+    writeNetworkStore();
+}
+
+bool removeNetwork(const char* ssid) {
+    int8_t index = findNetwork(ssid);
+    if (index < 0) {
+        return false;
+    }
+
+    memmove(&networks[index], &networks[index + 1], (networkCount - index - 1) * sizeof(WiFiNetwork));
+    networkCount--;
+    writeNetworkStore();
+    return true;
+}
+
+const WiFiNetwork& getNetwork(uint8_t index) {
+    return networks[index];
+}
+
+uint8_t getNetworkCount() {
+    return networkCount;
+}
@@ -0,0 +1,38 @@
+#ifndef WIFI_NETWORK_STORE_H
+#define WIFI_NETWORK_STORE_H
+
+#include <Arduino.h>
+#include <Preferences.h>
+
+// Known WiFi networks, most recently connected first. Only the main loop
+// uses the list, and it is written to flash whenever it changes.
+#define NETWORK_NAMESPACE "solenets"
+#define WIFI_MAX_NETWORKS 5
+#define NETWORK_STORE_VERSION 1
+#define WIFI_DEFAULT_PRIORITY 1           // Priority of networks provisioned without one
+#define WIFI_MAX_PRIORITY 9
+
+struct WiFiNetwork {
+    char ssid[33];
+    char password[65];
+    uint8_t priority;          // Higher is preferred, 0 = fallback only
+};
+
+// Function prototypes
+void initNetworkStore();
+
+// Adds or updates a network and moves it to the front. When the list is full
+// the lowest priority, least recently connected network is dropped.
+void saveNetwork(const char* ssid, const char* password, uint8_t priority);
+
+// Moves a network to the front after connecting to it
+void touchNetwork(const char* ssid);
+
+bool removeNetwork(const char* ssid);
+
+// Returns the index of a network, or -1
+int8_t findNetwork(const char* ssid);
+const WiFiNetwork& getNetwork(uint8_t index);
+uint8_t getNetworkCount();
+
+#endif // WIFI_NETWORK_STORE_H
@@ -18,10 +18,19 @@ tray motors, LED lighting, safety sensors, and BLE connectivity.
 #include "BLEControl.h" 
 #include "SystemSettings.h"
 #include "WiFiControl.h"
+#include "MemoryMonitor.h"
+#include "Logger.h"
+#include "Profiler.h"
+#include "CommandTrace.h"
+#include "CommandQueue.h"
+#include "SafetyController.h"
+#include "CloudTask.h"
+#include "CommandDispatch.h"
 
 // Configuration settings
 #define DEBUG_MODE true       // Enable/disable debug messages
 #define LOOP_DELAY_MS 10      // Main loop delay in milliseconds
+#define CONSOLE_BUFFER_SIZE 32 // Maximum serial console command length
 
 // System state flags
 bool childLockOn = false;     // Child lock status (true = locked)
@@ -34,8 +43,12 @@ const char* defaultPassword = "";
 // Create WiFi controller instance
 WiFiControl wifiControl;
 
+// Commands written over BLE or received as shadow deltas, applied by the control loop
+CommandQueue bleCommandQueue;
+CommandQueue mqttCommandQueue;
+
 // Update BLEControl instantiation to include child lock reference
-BLEControl bleControl(&podOpenFlag, &wifiControl, &childLockOn);
+BLEControl bleControl(&podOpenFlag, &wifiControl, &childLockOn, &bleCommandQueue);
 
 // Function prototypes
 void setupSystem();
@@ -44,14 +57,16 @@ void runLEDControl();
 void runWiFiControl();  // New function for WiFi monitoring
 void runChildLockControl(); // New function for child lock state monitoring
 void printDebugInfo();
+void runConsole();
 
 void setup() {
-    // Initialize serial communication
+    // Initialize serial communication and the deferred logger that drains to it
     Serial.begin(115200);
+    initLogger();
     // Wait for serial connection when in debug mode
     if (DEBUG_MODE) {
         delay(1000);  // Give time for serial monitor to connect
-        Serial.println("Sole Pod System Starting...");
+        LOG_I("Sole Pod System Starting...");
     }
     
     // Initialize all subsystems
@@ -59,111 +74,131 @@ void setup() {
     
     // Start WiFi connection process without waiting
     if (DEBUG_MODE) {
-        Serial.println("Starting WiFi connection in background...");
+        LOG_I("Starting WiFi connection in background...");
     }
     
     // Use the non-blocking connection method
+    wifiControl.begin();
     wifiControl.beginConnection(defaultSSID, defaultPassword);
     
     if (DEBUG_MODE) {
-        Serial.println("System initialization complete!");
-        Serial.print("Motor stall detection threshold set to: ");
-        Serial.println(STALL_VOLTAGE_THRESHOLD);
+        LOG_I("System initialization complete!");
+        LOG_I("Motor stall detection threshold set to: %.2f", STALL_VOLTAGE_THRESHOLD);
     }
 }
 
 void loop() {
+    // Measure loop period, jitter and overruns
+    PROFILE_LOOP_TICK();
+    
+    // Apply commands queued by the BLE stack
+    PROFILE_CALL(PROFILE_ZONE_COMMANDS, runCommandQueue());
+    
     // Run safety checks
     //runSafetyChecks();
     
     // Handle door control functionality
-    runDoorControl();
+    PROFILE_CALL(PROFILE_ZONE_DOOR, runDoorControl());
     
     // Handle LED control functionality
-    runLEDControl();
+    PROFILE_CALL(PROFILE_ZONE_LED, runLEDControl());
     
     // Handle WiFi connection monitoring
-    runWiFiControl();
+    PROFILE_CALL(PROFILE_ZONE_WIFI, runWiFiControl());
     
     // Handle child lock state monitoring
-    runChildLockControl();
+    PROFILE_CALL(PROFILE_ZONE_CHILD_LOCK, runChildLockControl());
     
     // Check and update JSON status characteristic (NEW)
-    bleControl.checkJSONUpdate();
+    PROFILE_CALL(PROFILE_ZONE_JSON_UPDATE, bleControl.checkJSONUpdate());
+    
+    // Switch BLE connections between the fast and low-power parameter profiles
+    PROFILE_CALL(PROFILE_ZONE_BLE_LINK, bleControl.checkConnectionParameters());
+    
+    // Write settings to flash once they stop changing
+    runSettingsPersistence();
+    runBondPersistence();
+    
+    // Sample heap and stack usage
+    PROFILE_CALL(PROFILE_ZONE_MEMORY, runMemoryMonitor());
     
     // Print debug information if enabled
     if (DEBUG_MODE) {
-        printDebugInfo();
+        PROFILE_CALL(PROFILE_ZONE_DEBUG_INFO, printDebugInfo());
     }
     
+    // Handle serial console commands
+    runConsole();
+    
     // Small delay to stabilize loop timing
     delay(LOOP_DELAY_MS);
 }
 
-void runWiFiControl() {
-    static unsigned long lastWiFiCheckTime = 0;
-    static String lastWiFiStatus = "";
-    static bool initialConnectionAttempt = true;
-    static unsigned long connectionStartTime = 0;
-    const unsigned long WIFI_CHECK_INTERVAL = 5000; // Check more frequently during initial connection
-    const unsigned long CONNECTION_TIMEOUT = 30000; // 30 second timeout
-    
-    unsigned long currentTime = millis();
-    
-    // Handle initial connection attempt
-    if (initialConnectionAttempt) {
-        if (connectionStartTime == 0) {
-            connectionStartTime = currentTime;
-        }
-        
-        // Check if connected
-        if (wifiControl.getWiFiStatus() == WL_CONNECTED) {
-            initialConnectionAttempt = false;
-            if (DEBUG_MODE) {
-                Serial.println("WiFi connected successfully in background!");
-                Serial.printf("Network: %s\n", wifiControl.getCurrentSSID().c_str());
-                Serial.printf("IP Address: %s\n", wifiControl.getLocalIP().toString().c_str());
-            }
-        }
-        // Check for timeout
-        else if (currentTime - connectionStartTime > CONNECTION_TIMEOUT) {
-            initialConnectionAttempt = false;
-            if (DEBUG_MODE) {
-                Serial.println("Initial WiFi connection attempt timed out.");
-            }
-        }
-    }
+// Handle single-line commands typed on the serial console
+void runConsole() {
+    static char commandBuffer[CONSOLE_BUFFER_SIZE];
+    static uint8_t commandLength = 0;
     
-    // Regular WiFi status check (less frequent after initial setup)
-    if (currentTime - lastWiFiCheckTime >= WIFI_CHECK_INTERVAL) {
-        String currentStatus;
+    while (Serial.available() > 0) {
+        char c = Serial.read();
         
-        if (wifiControl.getWiFiStatus() == WL_CONNECTED) {
-            currentStatus = "CONNECTED:" + wifiControl.getCurrentSSID() + ":" + 
-                           wifiControl.getLocalIP().toString();
-        } else {
-            currentStatus = "DISCONNECTED";
-            
-            // Only try to reconnect if not in initial connection phase
-            if (!initialConnectionAttempt && wifiControl.getCurrentSSID().length() > 0) {
-                // Try to reconnect if we have credentials
-                if (DEBUG_MODE) {
-                    Serial.println("WiFi connection lost! Attempting to reconnect...");
-                }
-                wifiControl.beginConnection(wifiControl.getCurrentSSID(), wifiControl.getCurrentPassword());
+        if (c != '\n' && c != '\r') {
+            if (commandLength < CONSOLE_BUFFER_SIZE - 1) {
+                commandBuffer[commandLength++] = c;
             }
+            continue;
         }
         
-        // Only update BLE characteristic if status changed
-        if (lastWiFiStatus != currentStatus) {
-            bleControl.updateWiFiStatus(currentStatus);
-            lastWiFiStatus = currentStatus;
+        if (commandLength == 0) {
+            continue;
         }
+        commandBuffer[commandLength] = '\0';
+        commandLength = 0;
         
-        lastWiFiCheckTime = currentTime;
+        if (strcmp(commandBuffer, "prof") == 0) {
+            printProfileReport();
+        } else if (strcmp(commandBuffer, "prof reset") == 0) {
+            resetProfileStats();
+            LOG_I("Profile statistics reset");
+        } else if (strcmp(commandBuffer, "mem") == 0) {
+            printMemoryInfo();
+        } else if (strcmp(commandBuffer, "mem reset") == 0) {
+            resetMemoryPeaks();
+            LOG_I("Allocation peak reset");
+        } else if (strcmp(commandBuffer, "trace") == 0) {
+            printTraceReport();
+        } else if (strcmp(commandBuffer, "trace reset") == 0) {
+            resetTraceStats();
+            LOG_I("Command latency statistics reset");
+        } else if (strcmp(commandBuffer, "cmd") == 0) {
+            printCommandStats();
+        } else if (strcmp(commandBuffer, "ble") == 0) {
+            bleControl.printConnectionInfo();
+        } else if (strcmp(commandBuffer, "wifi") == 0) {
+            wifiControl.printConnectionInfo();
+        } else if (strcmp(commandBuffer, "cloud") == 0) {
+            printCloudStats();
+        } else {
+            LOG_W("Unknown command: %s (try: prof, mem, trace, cmd, ble, wifi, cloud)", commandBuffer);
+        }
     }
 }
 
+void runWiFiControl() {
+    static uint32_t lastStateVersion = 0;
+
+    wifiControl.run();
+
+    // Report every state change over BLE
+    if (wifiControl.getStateVersion() != lastStateVersion) {
+        lastStateVersion = wifiControl.getStateVersion();
+        bleControl.updateWiFiStatus(wifiControl.getStatusString());
+    }
+    
+    // Scan results for the provisioning picker
+    bleControl.checkWiFiScan();
+}
+
 void runChildLockControl() {
     static bool prevChildLockState = false; // Track previous child lock state
     static bool firstRun = true; // Flag to force first update
@@ -183,6 +218,13 @@ void runChildLockControl() {
 }
 
 void setupSystem() {
+    // Initialize memory telemetry first so it sees every later allocation
+    initMemoryMonitor();
+    registerMemoryTask(getLogDrainTask(), "logDrain");
+    
+    // Initialize loop profiling
+    initProfiler();
+    
     // Initialize sensors
     initSwitches();
     
@@ -222,6 +264,25 @@ void setupSystem() {
     
     // Initialize BLE control
     bleControl.begin();
+    
+    // Commands from both queues are applied by runCommandQueue() in loop()
+    initCommandDispatch(&podOpenFlag, &childLockOn, &bleControl, &bleCommandQueue, &mqttCommandQueue);
+    
+    // Monitor the task stacks created by BLE init (the loopback backend has none)
+#if BLE_BACKEND == BLE_BACKEND_BLUEDROID
+    registerMemoryTaskByName("BTC_TASK");
+    registerMemoryTaskByName("BTU_TASK");
+    registerMemoryTaskByName("btController");
+#elif BLE_BACKEND == BLE_BACKEND_NIMBLE
+    registerMemoryTaskByName("nimble_host");
+    registerMemoryTaskByName("btController");
+#endif
+    
+    // Start the cloud client; it waits for WiFi on its own
+    initCloudTask(&mqttCommandQueue);
+    if (getCloudTask()) {
+        registerMemoryTask(getCloudTask(), "cloud");
+    }
 }
 
 // Handle door related functionality
@@ -232,6 +293,7 @@ void runDoorControl() {
     
     // Process door button input
     handleDoorButton(podOpenFlag, childLockOn);
+    
     manageMotors(podOpenFlag);
     
     // Read current door state
@@ -261,6 +323,11 @@ void runDoorControl() {
         
         // Update BLE status
         bleControl.updateDoorStatus(doorIsOpenForBLE);
+        bleControl.updatePodState(currentState, podOpenFlag);
+        
+        // The shadow compares is_open with the desired state, so it gets the
+        // target; an intermediate position would raise the delta again
+        postCloudPodStatus(podOpenFlag);
         
         // Save door status if the flag has changed
         if (prevOpenFlag != podOpenFlag) {
@@ -277,6 +344,9 @@ void runDoorControl() {
         bleControl.updateDoorPosition(currentDoorPosition);
         prevDoorPosition = currentDoorPosition;
     }
+    
+    // Publish safety status (BLE only notifies on change)
+    bleControl.updateSafetyStatus(getSafetyStatus());
 }
 
 void runLEDControl() {
@@ -296,6 +366,7 @@ void runLEDControl() {
     if (prevLEDState != currentLEDState) {
         // Update BLE
         bleControl.updateLEDStatus(currentLEDState);
+        postCloudLedStatus(currentLEDState == LED_STATE_ON);
         
         // Update previous state for next iteration
         prevLEDState = currentLEDState;
@@ -305,6 +376,7 @@ void runLEDControl() {
     if (prevLEDBrightness != currentLEDBrightness) {
         // Brightness is already in 0-100 range, no scaling needed
         bleControl.updateLEDBrightness(currentLEDBrightness);
+        postCloudLedBrightness(currentLEDBrightness);
         
         // Update previous brightness for next iteration
         prevLEDBrightness = currentLEDBrightness;
@@ -314,6 +386,7 @@ void runLEDControl() {
     if (prevLEDColor != currentLEDColor) {
         // Update BLE
         bleControl.updateLEDColor(currentLEDColor);
+        postCloudLedColor(currentLEDColor);
         
         // Update previous color for next iteration
         prevLEDColor = currentLEDColor;
@@ -326,72 +399,46 @@ void printDebugInfo() {
     static bool lastBLEConnectionStatus = false;
     bool currentBLEStatus = bleControl.getConnectionStatus(); // Get BLE status
     
-    // Only update debug info every 500ms to avoid flooding serial
+    // Only update debug info every 5 s to avoid flooding the log
     if (millis() - lastDebugTime > 5000) {
         uint8_t currentState = readState();
         float voltage = readAverageVoltage();
         
         
-        Serial.println("--- System Status ---");
-        
-        Serial.print("Pod State: ");
-        Serial.print(getStateDescription(currentState));
-        Serial.print(" (");
-        Serial.print(currentState);
-        Serial.println(")");
-        Serial.print("LED State: ");
-        Serial.print(getLEDState() == LED_STATE_ON ? "ON" : "OFF");
-        Serial.print("LED Brightness: ");
-        Serial.println(getLEDBrightness());
-        Serial.println(")");
-        Serial.print("LED Color: ");
-        Serial.println(getLEDColor());
-        Serial.print("Target: ");
-        Serial.println(podOpenFlag ? "OPENING/OPEN" : "CLOSING/CLOSED");
-        Serial.print("Child Lock: ");
-        Serial.println(childLockOn ? "ENABLED" : "DISABLED");
-        Serial.print("Door Position: ");
-        Serial.println(getDoorPosition());
-        Serial.print("LED State: ");
-        Serial.println(getLEDState() == LED_STATE_ON ? "ON" : "OFF");
-        Serial.print("LED Brightness: ");
-        Serial.println(getLEDBrightness());
+        LOG_I("--- System Status ---");
+        LOG_I("Pod State: %s (%u), Target: %s", getStateDescription(currentState), currentState,
+              podOpenFlag ? "OPENING/OPEN" : "CLOSING/CLOSED");
+        LOG_I("LED State: %s, Brightness: %u, Color: %s", getLEDState() == LED_STATE_ON ? "ON" : "OFF",
+              getLEDBrightness(), getLEDColor());
+        LOG_I("Child Lock: %s, Door Position: %u", childLockOn ? "ENABLED" : "DISABLED", getDoorPosition());
         
         // Print individual sensor states
-        Serial.println("Sensors:");
-        Serial.print("  Door Closed: ");
-        Serial.println(isDoorClosed() ? "ACTIVE" : "INACTIVE");
-        Serial.print("  Door Open: ");
-        Serial.println(isDoorOpen() ? "ACTIVE" : "INACTIVE");
-        Serial.print("  Tray Closed: ");
-        Serial.println(isTrayClose() ? "ACTIVE" : "INACTIVE");
-        Serial.print("  Tray Open: ");
-        Serial.println(isTrayOpen() ? "ACTIVE" : "INACTIVE");
+        LOG_I("Sensors: Door Closed %d, Door Open %d, Tray Closed %d, Tray Open %d",
+              isDoorClosed(), isDoorOpen(), isTrayClose(), isTrayOpen());
+        LOG_I("Motor Voltage: %.3f V", voltage);
         
         // Add WiFi status to debug info
-        Serial.print("WiFi Status: ");
-        Serial.println(wifiControl.getWiFiStatusString());
+        LOG_I("WiFi Status: %s", wifiControl.getWiFiStatusString());
         if (wifiControl.getWiFiStatus() == WL_CONNECTED) {
-            Serial.print("Network: ");
-            Serial.println(wifiControl.getCurrentSSID());
-            Serial.print("IP Address: ");
-            Serial.println(wifiControl.getLocalIP().toString());
-            Serial.print("Signal Strength: ");
-            Serial.print(wifiControl.getSignalStrength());
-            Serial.println(" dBm");
+            LOG_I("Network: %s, IP Address: %s, Signal Strength: %d dBm", wifiControl.getCurrentSSID(),
+                  wifiControl.getLocalIP().toString(), wifiControl.getSignalStrength());
         }
+        
+        // Heap and stack usage
+        printMemoryInfo();
+        LOG_I("Log records: %u, dropped: %u", getLogRecordCount(), getLogDropCount());
 
         // Detect BLE connection changes
         if (lastBLEConnectionStatus != currentBLEStatus) {
             if (currentBLEStatus) {
-                Serial.println("*** BLE CLIENT CONNECTED ***");
+                LOG_I("*** BLE CLIENT CONNECTED ***");
             } else {
-                Serial.println("*** BLE CLIENT DISCONNECTED - ADVERTISING RESUMED ***");
+                LOG_I("*** BLE CLIENT DISCONNECTED - ADVERTISING RESUMED ***");
             }
             lastBLEConnectionStatus = currentBLEStatus;
         }
         
-        Serial.println("-------------------");
+        LOG_I("-------------------");
         
         lastDebugTime = millis();
     }
@@ -0,0 +1,77 @@
+#ifndef BLE_FIXTURE_H
+#define BLE_FIXTURE_H
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <unity.h>
+#include "BLEControl.h"
+#include "LoopbackTransport.h"
+
+// BLEControl over the loopback transport, shared by the tests that drive it
+// as a central would. Each test file calls setUpBle() and tearDownBle() from
+// its own setUp() and tearDown().
+
+inline bool podOpen = false;
+inline bool childLock = false;
+inline WiFiControl* wifiControl;
+inline CommandQueue* commandQueue;
+inline BLEControl* ble;
+inline LoopbackTransport* loopback;
+
+inline void setUpBle() {
+    mockNvs.clear();
+    mockMillis = 1000;
+    podOpen = false;
+    childLock = false;
+
+    wifiControl = new WiFiControl();
+    commandQueue = new CommandQueue();
+    ble = new BLEControl(&podOpen, wifiControl, &childLock, commandQueue);
+    ble->begin();
+    loopback = (LoopbackTransport*)ble->getTransport();
+}
+
+inline void tearDownBle() {
+    delete loopback;
+    delete ble;
+    delete commandQueue;
+    delete wifiControl;
+}
+
+// Runs the main loop's notification pass once the per-field interval has passed
+inline void runNotifications() {
+    mockMillis += STATUS_NOTIFY_MIN_INTERVAL;
+    ble->checkJSONUpdate();
+}
+
+// Most recent notification of a characteristic to a connection, or nullptr
+inline const LoopbackNotification* lastNotification(uint8_t characteristicId, uint16_t connId) {
+    const LoopbackNotification* found = nullptr;
+    for (uint32_t i = 0; loopback->getNotification(i); i++) {
+        const LoopbackNotification* notification = loopback->getNotification(i);
+        if (notification->characteristicId == characteristicId && notification->connId == connId) {
+            found = notification;
+        }
+    }
+    return found;
+}
+
+// Notifications of a characteristic to a connection still in the log
+inline uint32_t countNotifications(uint8_t characteristicId, uint16_t connId) {
+    uint32_t count = 0;
+    for (uint32_t i = 0; loopback->getNotification(i); i++) {
+        const LoopbackNotification* notification = loopback->getNotification(i);
+        if (notification->characteristicId == characteristicId && notification->connId == connId) {
+            count++;
+        }
+    }
+    return count;
+}
+
+inline BLEConnection connection(uint16_t connId) {
+    BLEConnection state = {};
+    TEST_ASSERT_TRUE(ble->getConnection(connId, state));
+    return state;
+}
+
+#endif // BLE_FIXTURE_H
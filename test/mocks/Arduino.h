@@ -0,0 +1,263 @@
+#ifndef MOCK_ARDUINO_H
+#define MOCK_ARDUINO_H
+
+// Host build of the parts of the Arduino core the firmware uses, for the
+// native test environment. Time only moves when a test sets mockMillis, and
+// GPIO reads return mockPinLevels, so tests are deterministic. Built with
+// -DMOCK_NETWORK, millis() and delay() use the host's clock instead.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdarg.h>
+#include <string>
+#include <algorithm>
+#ifdef MOCK_NETWORK
+#include <chrono>
+#include <thread>
+#endif
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_system.h"
+#include "esp_attr.h"
+
+typedef uint8_t byte;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 1
+#define OUTPUT 3
+#define INPUT_PULLUP 5
+#define DEC 10
+#define HEX 16
+
+// GPIO, driven by the tests (the clock, mockMillis, is in freertos/FreeRTOS.h)
+inline uint8_t mockPinLevels[64] = {};
+inline uint16_t mockAnalogLevels[64] = {};
+
+#ifdef MOCK_NETWORK
+// Tests against real servers (see WiFiClient) run on the host's clock
+inline unsigned long millis() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+inline unsigned long micros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+inline void delay(unsigned long ms) { std::this_thread::sleep_for(std::chrono::milliseconds(ms)); }
+#else
+inline unsigned long millis() { return mockMillis; }
+inline unsigned long micros() { return mockMillis * 1000; }
+inline void delay(unsigned long ms) { mockMillis += ms; }
+#endif
+inline void delayMicroseconds(unsigned int) {}
+inline void pinMode(uint8_t, uint8_t) {}
+inline void digitalWrite(uint8_t pin, uint8_t value) { mockPinLevels[pin & 63] = value; }
+inline int digitalRead(uint8_t pin) { return mockPinLevels[pin & 63]; }
+inline uint16_t analogRead(uint8_t pin) { return mockAnalogLevels[pin & 63]; }
+inline uint32_t analogReadMilliVolts(uint8_t pin) { return mockAnalogLevels[pin & 63]; }
+inline void analogReadResolution(uint8_t) {}
+inline void analogSetAttenuation(int) {}
+
+inline long map(long x, long inMin, long inMax, long outMin, long outMax) {
+    return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+inline long random(long max) { return max > 0 ? rand() % max : 0; }
+inline long random(long min, long max) { return max > min ? min + rand() % (max - min) : min; }
+template <class T> T constrain(T x, T low, T high) { return x < low ? low : (x > high ? high : x); }
+
+class String {
+private:
+    std::string text;
+
+    static std::string fromNumber(unsigned long value, int base, bool negative) {
+        char buffer[34];
+        char* p = &buffer[sizeof(buffer) - 1];
+        *p = '\0';
+        do {
+            unsigned digit = value % base;
+            *--p = digit < 10 ? '0' + digit : 'A' + digit - 10;
+            value /= base;
+        } while (value);
+        if (negative) {
+            *--p = '-';
+        }
+        return p;
+    }
+
+public:
+    String(const char* value = "") : text(value ? value : "") {}
+    String(const std::string& value) : text(value) {}
+    String(char value) : text(1, value) {}
+    String(unsigned char value, int base = DEC) : text(fromNumber(value, base, false)) {}
+    String(int value, int base = DEC) : text(base == DEC && value < 0 ? fromNumber(-(long)value, base, true)
+                                                                     : fromNumber((unsigned)value, base, false)) {}
+    String(unsigned int value, int base = DEC) : text(fromNumber(value, base, false)) {}
+    String(long value, int base = DEC) : text(base == DEC && value < 0 ? fromNumber(-value, base, true)
+                                                                       : fromNumber((unsigned long)value, base, false)) {}
+    String(unsigned long value, int base = DEC) : text(fromNumber(value, base, false)) {}
+    String(double value, unsigned int decimals = 2) {
+        char buffer[32];
+        snprintf(buffer, sizeof(buffer), "%.*f", decimals, value);
+        text = buffer;
+    }
+
+    const char* c_str() const { return text.c_str(); }
+    unsigned int length() const { return text.length(); }
+    bool isEmpty() const { return text.empty(); }
+    char charAt(unsigned int index) const { return index < text.length() ? text[index] : 0; }
+    char operator[](unsigned int index) const { return charAt(index); }
+
+    int indexOf(char c, unsigned int from = 0) const {
+        size_t index = text.find(c, from);
+        return index == std::string::npos ? -1 : (int)index;
+    }
+    int indexOf(const String& value, unsigned int from = 0) const {
+        size_t index = text.find(value.text, from);
+        return index == std::string::npos ? -1 : (int)index;
+    }
+    String substring(unsigned int from) const { return from < text.length() ? text.substr(from) : std::string(); }
+    String substring(unsigned int from, unsigned int to) const {
+        if (from > to) {
+            std::swap(from, to);
+        }
+        return from < text.length() ? text.substr(from, to - from) : std::string();
+    }
+    bool startsWith(const String& prefix) const { return text.compare(0, prefix.text.length(), prefix.text) == 0; }
+    bool equals(const String& other) const { return text == other.text; }
+    long toInt() const { return strtol(text.c_str(), nullptr, 10); }
+    float toFloat() const { return strtof(text.c_str(), nullptr); }
+    void toUpperCase() { for (char& c : text) c = toupper(c); }
+    void toLowerCase() { for (char& c : text) c = tolower(c); }
+    void trim() {
+        size_t start = text.find_first_not_of(" \t\r\n");
+        size_t end = text.find_last_not_of(" \t\r\n");
+        text = start == std::string::npos ? std::string() : text.substr(start, end - start + 1);
+    }
+    void remove(unsigned int index) { if (index < text.length()) text.erase(index); }
+    void remove(unsigned int index, unsigned int count) { if (index < text.length()) text.erase(index, count); }
+    bool reserve(unsigned int size) { text.reserve(size); return true; }
+    void toCharArray(char* buffer, unsigned int size) const { getBytes((unsigned char*)buffer, size); }
+    void getBytes(unsigned char* buffer, unsigned int size) const {
+        if (size == 0) return;
+        size_t length = std::min((size_t)size - 1, text.length());
+        memcpy(buffer, text.data(), length);
+        buffer[length] = '\0';
+    }
+
+    String& operator+=(const String& other) { text += other.text; return *this; }
+    String& operator+=(const char* other) { text += other; return *this; }
+    String& operator+=(char other) { text += other; return *this; }
+    bool operator==(const String& other) const { return text == other.text; }
+    bool operator!=(const String& other) const { return text != other.text; }
+    bool operator==(const char* other) const { return text == other; }
+    bool operator!=(const char* other) const { return text != other; }
+    bool operator<(const String& other) const { return text < other.text; }
+};
+
+inline String operator+(const String& a, const String& b) { String result(a); result += b; return result; }
+inline String operator+(const String& a, const char* b) { String result(a); result += b; return result; }
+inline String operator+(const char* a, const String& b) { String result(a); result += b; return result; }
+
+// Serial output is discarded unless a test turns on mockSerialEcho
+inline bool mockSerialEcho = false;
+
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t value) { return write(&value, 1); }
+    virtual size_t write(const uint8_t* buffer, size_t size) {
+        if (mockSerialEcho) fwrite(buffer, 1, size, stdout);
+        return size;
+    }
+    size_t print(const char* value) { return write((const uint8_t*)value, strlen(value)); }
+    size_t print(const String& value) { return print(value.c_str()); }
+    template <typename T> size_t print(T value, int base = DEC) { return print(String(value, base)); }
+    size_t println() { return print("\n"); }
+    template <typename T> size_t println(const T& value) { return print(value) + println(); }
+    size_t printf(const char* format, ...) {
+        char buffer[256];
+        va_list args;
+        va_start(args, format);
+        int length = vsnprintf(buffer, sizeof(buffer), format, args);
+        va_end(args);
+        return write((const uint8_t*)buffer, std::min((size_t)std::max(length, 0), sizeof(buffer) - 1));
+    }
+};
+
+class Stream : public Print {
+public:
+    virtual int available() { return 0; }
+    virtual int read() { return -1; }
+    virtual int peek() { return -1; }
+    virtual void flush() {}
+};
+
+class HWCDC : public Stream {
+public:
+    void begin(unsigned long) {}
+    int availableForWrite() { return 256; }
+    operator bool() const { return true; }
+};
+inline HWCDC Serial;
+
+class IPAddress {
+private:
+    uint32_t address;
+
+public:
+    IPAddress() : address(0) {}
+    IPAddress(uint32_t value) : address(value) {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : address(a | b << 8 | c << 16 | (uint32_t)d << 24) {}
+    operator uint32_t() const { return address; }
+    uint8_t operator[](int index) const { return address >> (index * 8); }
+    bool fromString(const char* text) {
+        unsigned a, b, c, d;
+        if (sscanf(text, "%u.%u.%u.%u", &a, &b, &c, &d) != 4) return false;
+        *this = IPAddress(a, b, c, d);
+        return true;
+    }
+    String toString() const {
+        char buffer[16];
+        snprintf(buffer, sizeof(buffer), "%u.%u.%u.%u", (*this)[0], (*this)[1], (*this)[2], (*this)[3]);
+        return String(buffer);
+    }
+};
+
+class Client : public Stream {
+public:
+    virtual int connect(IPAddress ip, uint16_t port) = 0;
+    virtual int connect(const char* host, uint16_t port) = 0;
+    virtual size_t write(uint8_t value) = 0;
+    virtual size_t write(const uint8_t* buffer, size_t size) = 0;
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int read(uint8_t* buffer, size_t size) = 0;
+    virtual int peek() = 0;
+    virtual void flush() = 0;
+    virtual void stop() = 0;
+    virtual uint8_t connected() = 0;
+    virtual operator bool() = 0;
+};
+
+inline uint32_t mockFreeHeap = 200000;
+
+class EspClass {
+public:
+    uint32_t getFreeHeap() { return mockFreeHeap; }
+    uint32_t getMinFreeHeap() { return mockFreeHeap; }
+    uint32_t getMaxAllocHeap() { return mockFreeHeap; }
+    uint32_t getHeapSize() { return 320000; }
+    uint32_t getCycleCount() { return (uint32_t)(mockMillis * 240000); }
+    uint32_t getCpuFreqMHz() { return 240; }
+    uint32_t getSketchSize() { return 0; }
+    uint32_t getFreeSketchSpace() { return 0; }
+    void restart() {}
+};
+inline EspClass ESP;
+
+#endif // MOCK_ARDUINO_H
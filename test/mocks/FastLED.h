@@ -0,0 +1,38 @@
+#ifndef MOCK_FASTLED_H
+#define MOCK_FASTLED_H
+
+#include <Arduino.h>
+
+struct CRGB {
+    uint8_t r, g, b;
+
+    enum HTMLColorCode { Black = 0x000000 };
+
+    CRGB() : r(0), g(0), b(0) {}
+    CRGB(uint8_t r, uint8_t g, uint8_t b) : r(r), g(g), b(b) {}
+    CRGB(HTMLColorCode code) : r(code >> 16), g(code >> 8), b(code) {}
+};
+
+enum EOrder { RGB, GRB };
+enum ESPIChipsets { WS2812 };
+
+// Counts show() calls so tests can see when the strip was refreshed
+class CFastLED {
+private:
+    uint8_t brightness = 255;
+
+public:
+    uint32_t shows = 0;
+
+    template <ESPIChipsets chipset, int pin, EOrder order> void addLeds(CRGB*, int) {}
+    void setBrightness(uint8_t value) { brightness = value; }
+    uint8_t getBrightness() { return brightness; }
+    void show() { shows++; }
+};
+inline CFastLED FastLED;
+
+inline void fill_solid(CRGB* leds, int count, const CRGB& color) {
+    for (int i = 0; i < count; i++) leds[i] = color;
+}
+
+#endif // MOCK_FASTLED_H
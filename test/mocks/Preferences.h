@@ -0,0 +1,82 @@
+#ifndef MOCK_PREFERENCES_H
+#define MOCK_PREFERENCES_H
+
+#include <Arduino.h>
+#include <map>
+#include <string>
+
+// NVS in memory. Every put or remove counts as one write, which on the device
+// is one commit of the namespace.
+inline std::map<std::string, std::map<std::string, std::string>> mockNvs;
+inline uint32_t mockNvsWrites = 0;
+
+class Preferences {
+private:
+    std::map<std::string, std::string>* space = nullptr;
+    bool readOnly = false;
+
+    size_t put(const char* key, const void* value, size_t length) {
+        if (!space || readOnly) return 0;
+        (*space)[key] = std::string((const char*)value, length);
+        mockNvsWrites++;
+        return length;
+    }
+    template <typename T> T get(const char* key, T defaultValue) {
+        if (!space) return defaultValue;
+        auto entry = space->find(key);
+        if (entry == space->end() || entry->second.size() != sizeof(T)) return defaultValue;
+        T value;
+        memcpy(&value, entry->second.data(), sizeof(T));
+        return value;
+    }
+
+public:
+    bool begin(const char* name, bool readOnly = false) {
+        space = &mockNvs[name];
+        this->readOnly = readOnly;
+        return true;
+    }
+    void end() { space = nullptr; }
+
+    size_t putBytes(const char* key, const void* value, size_t length) { return put(key, value, length); }
+    size_t putString(const char* key, const String& value) { return put(key, value.c_str(), value.length()); }
+    size_t putBool(const char* key, bool value) { return put(key, &value, sizeof(value)); }
+    size_t putUChar(const char* key, uint8_t value) { return put(key, &value, sizeof(value)); }
+    size_t putUShort(const char* key, uint16_t value) { return put(key, &value, sizeof(value)); }
+    size_t putInt(const char* key, int32_t value) { return put(key, &value, sizeof(value)); }
+    size_t putUInt(const char* key, uint32_t value) { return put(key, &value, sizeof(value)); }
+    size_t putULong(const char* key, uint32_t value) { return put(key, &value, sizeof(value)); }
+
+    bool getBool(const char* key, bool defaultValue = false) { return get(key, defaultValue); }
+    uint8_t getUChar(const char* key, uint8_t defaultValue = 0) { return get(key, defaultValue); }
+    uint16_t getUShort(const char* key, uint16_t defaultValue = 0) { return get(key, defaultValue); }
+    int32_t getInt(const char* key, int32_t defaultValue = 0) { return get(key, defaultValue); }
+    uint32_t getUInt(const char* key, uint32_t defaultValue = 0) { return get(key, defaultValue); }
+    uint32_t getULong(const char* key, uint32_t defaultValue = 0) { return get(key, defaultValue); }
+    String getString(const char* key, const String& defaultValue = String()) {
+        if (!space || !space->count(key)) return defaultValue;
+        return String((*space)[key]);
+    }
+    size_t getBytesLength(const char* key) { return space && space->count(key) ? (*space)[key].size() : 0; }
+    size_t getBytes(const char* key, void* buffer, size_t length) {
+        size_t stored = getBytesLength(key);
+        if (stored == 0 || stored > length) return 0;
+        memcpy(buffer, (*space)[key].data(), stored);
+        return stored;
+    }
+
+    bool isKey(const char* key) { return space && space->count(key); }
+    bool remove(const char* key) {
+        if (!space || readOnly) return false;
+        mockNvsWrites++;
+        return space->erase(key) > 0;
+    }
+    bool clear() {
+        if (!space || readOnly) return false;
+        mockNvsWrites++;
+        space->clear();
+        return true;
+    }
+};
+
+#endif // MOCK_PREFERENCES_H
@@ -0,0 +1,112 @@
+#ifndef MOCK_PUBSUBCLIENT_H
+#define MOCK_PUBSUBCLIENT_H
+
+#include <Arduino.h>
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+
+#define MQTT_CALLBACK_SIGNATURE std::function<void(char*, uint8_t*, unsigned int)> callback
+
+#define MQTT_CONNECTION_TIMEOUT -4
+#define MQTT_DISCONNECTED -1
+#define MQTT_CONNECTED 0
+
+// A message as it went through the broker
+struct MockMqttMessage {
+    std::string topic;
+    std::string payload;
+};
+
+// In-process broker stand-in. Clients connect at once unless connections are
+// refused, published messages are recorded, and deliver() queues a message
+// that the client hands to its callback from its next loop(), as PubSubClient
+// does. Only topics the client subscribed to are delivered.
+struct MockBroker {
+    bool refuseConnections = false;
+    uint32_t connects = 0;
+    std::vector<std::string> subscriptions;
+    std::vector<MockMqttMessage> published;
+    std::deque<MockMqttMessage> inbound;
+
+    void deliver(const char* topic, const std::string& payload) { inbound.push_back({ topic, payload }); }
+    bool isSubscribed(const std::string& topic) const {
+        for (const std::string& subscription : subscriptions) {
+            if (subscription == topic) return true;
+        }
+        return false;
+    }
+    void reset() { *this = MockBroker(); }
+};
+
+inline MockBroker mockBroker;
+
+class PubSubClient {
+private:
+    MQTT_CALLBACK_SIGNATURE;
+    bool isConnected = false;
+
+public:
+    PubSubClient() {}
+    PubSubClient(Client&) {}
+    PubSubClient& setServer(const char*, uint16_t) { return *this; }
+    PubSubClient& setCallback(MQTT_CALLBACK_SIGNATURE) { this->callback = callback; return *this; }
+    PubSubClient& setClient(Client&) { return *this; }
+    PubSubClient& setKeepAlive(uint16_t) { return *this; }
+    PubSubClient& setSocketTimeout(uint16_t) { return *this; }
+    bool setBufferSize(uint16_t) { return true; }
+    uint16_t getBufferSize() { return 1024; }
+
+    // A new session starts without subscriptions
+    bool connect(const char*) {
+        if (mockBroker.refuseConnections) {
+            return false;
+        }
+        isConnected = true;
+        mockBroker.connects++;
+        mockBroker.subscriptions.clear();
+        return true;
+    }
+    bool connect(const char* id, const char*, const char*) { return connect(id); }
+    void disconnect() { isConnected = false; }
+
+    bool publish(const char* topic, const char* payload) {
+        if (!isConnected) return false;
+        mockBroker.published.push_back({ topic, payload });
+        return true;
+    }
+    bool publish(const char* topic, const char* payload, bool) { return publish(topic, payload); }
+    bool publish(const char* topic, const uint8_t* payload, unsigned int length) {
+        if (!isConnected) return false;
+        mockBroker.published.push_back({ topic, std::string((const char*)payload, length) });
+        return true;
+    }
+    bool subscribe(const char* topic, uint8_t = 0) {
+        if (!isConnected) return false;
+        mockBroker.subscriptions.push_back(topic);
+        return true;
+    }
+    bool unsubscribe(const char*) { return isConnected; }
+
+    // Delivers the queued messages; the payload buffer is the client's own, as
+    // with the real receive buffer
+    bool loop() {
+        if (!isConnected) return false;
+        while (!mockBroker.inbound.empty()) {
+            MockMqttMessage message = mockBroker.inbound.front();
+            mockBroker.inbound.pop_front();
+            if (!callback || !mockBroker.isSubscribed(message.topic)) continue;
+
+            std::vector<char> topic(message.topic.begin(), message.topic.end());
+            topic.push_back('\0');
+            std::vector<uint8_t> payload(message.payload.begin(), message.payload.end());
+            callback(topic.data(), payload.data(), payload.size());
+        }
+        return true;
+    }
+    bool connected() { return isConnected; }
+    int state() { return isConnected ? MQTT_CONNECTED : MQTT_DISCONNECTED; }
+};
+
+#endif // MOCK_PUBSUBCLIENT_H
@@ -0,0 +1,247 @@
+#ifndef MOCK_WIFI_H
+#define MOCK_WIFI_H
+
+#include <Arduino.h>
+#include <functional>
+#include <vector>
+#ifdef MOCK_NETWORK
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+enum wl_status_t {
+    WL_IDLE_STATUS = 0,
+    WL_NO_SSID_AVAIL,
+    WL_SCAN_COMPLETED,
+    WL_CONNECTED,
+    WL_CONNECT_FAILED,
+    WL_CONNECTION_LOST,
+    WL_DISCONNECTED,
+    WL_NO_SHIELD = 255
+};
+
+#define WIFI_REASON_ASSOC_LEAVE 8
+#define WIFI_REASON_4WAY_HANDSHAKE_TIMEOUT 15
+#define WIFI_REASON_NO_AP_FOUND 201
+#define WIFI_REASON_AUTH_FAIL 202
+#define WIFI_REASON_HANDSHAKE_TIMEOUT 204
+
+#define WIFI_SCAN_RUNNING (-1)
+#define WIFI_SCAN_FAILED (-2)
+
+typedef enum {
+    ARDUINO_EVENT_WIFI_READY = 0,
+    ARDUINO_EVENT_WIFI_SCAN_DONE,
+    ARDUINO_EVENT_WIFI_STA_START,
+    ARDUINO_EVENT_WIFI_STA_STOP,
+    ARDUINO_EVENT_WIFI_STA_CONNECTED,
+    ARDUINO_EVENT_WIFI_STA_DISCONNECTED,
+    ARDUINO_EVENT_WIFI_STA_AUTHMODE_CHANGE,
+    ARDUINO_EVENT_WIFI_STA_GOT_IP,
+    ARDUINO_EVENT_WIFI_STA_LOST_IP
+} arduino_event_id_t;
+
+typedef struct {
+    uint8_t ssid[32];
+    uint8_t ssid_len;
+    uint8_t bssid[6];
+    uint8_t channel;
+    uint8_t authmode;
+} wifi_event_sta_connected_t;
+
+typedef struct {
+    uint8_t ssid[32];
+    uint8_t ssid_len;
+    uint8_t bssid[6];
+    uint8_t reason;
+} wifi_event_sta_disconnected_t;
+
+typedef struct {
+    uint32_t addr;
+} esp_ip4_addr_t;
+
+typedef struct {
+    esp_ip4_addr_t ip, netmask, gw;
+} esp_netif_ip_info_t;
+
+typedef struct {
+    int if_index;
+    void* esp_netif;
+    esp_netif_ip_info_t ip_info;
+    bool ip_changed;
+} ip_event_got_ip_t;
+
+typedef union {
+    wifi_event_sta_connected_t wifi_sta_connected;
+    wifi_event_sta_disconnected_t wifi_sta_disconnected;
+    ip_event_got_ip_t got_ip;
+} arduino_event_info_t;
+
+typedef std::function<void(arduino_event_id_t, arduino_event_info_t)> WiFiEventFuncCb;
+typedef size_t wifi_event_id_t;
+
+enum wifi_auth_mode_t { WIFI_AUTH_OPEN = 0, WIFI_AUTH_WEP, WIFI_AUTH_WPA_PSK, WIFI_AUTH_WPA2_PSK };
+enum wifi_mode_t { WIFI_MODE_NULL = 0, WIFI_STA, WIFI_AP, WIFI_AP_STA };
+
+struct MockNetwork {
+    String ssid;
+    int32_t rssi;
+    int32_t channel;
+    uint8_t bssid[6];
+    wifi_auth_mode_t encryption;
+};
+
+// Station that never associates unless a test sets mockStatus and raises the
+// events itself through raise()
+class WiFiClass {
+private:
+    std::vector<WiFiEventFuncCb> handlers;
+
+public:
+    wl_status_t mockStatus = WL_DISCONNECTED;
+    IPAddress mockAddress;
+    std::vector<MockNetwork> mockNetworks;
+    int16_t mockScanState = WIFI_SCAN_FAILED;
+
+    void raise(arduino_event_id_t event, arduino_event_info_t info = {}) {
+        for (auto& handler : handlers) handler(event, info);
+    }
+
+    wifi_event_id_t onEvent(WiFiEventFuncCb handler, arduino_event_id_t = ARDUINO_EVENT_WIFI_READY) {
+        handlers.push_back(handler);
+        return handlers.size();
+    }
+    wl_status_t begin(const char*, const char* = nullptr, int32_t = 0, const uint8_t* = nullptr, bool = true) {
+        return mockStatus;
+    }
+    bool config(IPAddress, IPAddress, IPAddress, IPAddress = (uint32_t)0, IPAddress = (uint32_t)0) { return true; }
+    bool disconnect(bool = false, bool = false) {
+        mockStatus = WL_DISCONNECTED;
+        return true;
+    }
+    wl_status_t status() { return mockStatus; }
+    bool mode(wifi_mode_t) { return true; }
+    bool setAutoReconnect(bool) { return true; }
+    bool persistent(bool) { return true; }
+    bool setSleep(bool) { return true; }
+
+    IPAddress localIP() { return mockAddress; }
+    String SSID() { return mockNetworks.empty() ? String() : mockNetworks[0].ssid; }
+    int8_t RSSI() { return mockNetworks.empty() ? 0 : mockNetworks[0].rssi; }
+    uint8_t* BSSID() { return mockNetworks.empty() ? nullptr : mockNetworks[0].bssid; }
+    int32_t channel() { return mockNetworks.empty() ? 0 : mockNetworks[0].channel; }
+
+    int16_t scanNetworks(bool = false, bool = false, bool = false, uint32_t = 300, uint8_t = 0,
+                         const char* = nullptr, const uint8_t* = nullptr) {
+        mockScanState = mockNetworks.size();
+        return mockScanState;
+    }
+    int16_t scanComplete() { return mockScanState; }
+    void scanDelete() { mockScanState = WIFI_SCAN_FAILED; }
+    String SSID(uint8_t i) { return mockNetworks[i].ssid; }
+    int32_t RSSI(uint8_t i) { return mockNetworks[i].rssi; }
+    uint8_t* BSSID(uint8_t i) { return mockNetworks[i].bssid; }
+    int32_t channel(uint8_t i) { return mockNetworks[i].channel; }
+    wifi_auth_mode_t encryptionType(uint8_t i) { return mockNetworks[i].encryption; }
+    String macAddress() { return "00:00:00:00:00:00"; }
+};
+inline WiFiClass WiFi;
+
+// Never connects
+#ifdef MOCK_NETWORK
+// TCP client over a host socket, for tests against real servers (e.g. the
+// TLS client against openssl s_server). Reads never block, as on the device.
+class WiFiClient : public Client {
+private:
+    int fd = -1;
+
+public:
+    ~WiFiClient() { stop(); }
+
+    int connect(IPAddress ip, uint16_t port) override { return connect(ip.toString().c_str(), port); }
+    int connect(const char* host, uint16_t port) override {
+        stop();
+        addrinfo hints = {};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* addresses = nullptr;
+        if (getaddrinfo(host, std::to_string(port).c_str(), &hints, &addresses) != 0) {
+            return 0;
+        }
+        for (addrinfo* address = addresses; address && fd < 0; address = address->ai_next) {
+            fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+            if (fd >= 0 && ::connect(fd, address->ai_addr, address->ai_addrlen) != 0) {
+                ::close(fd);
+                fd = -1;
+            }
+        }
+        freeaddrinfo(addresses);
+        return fd >= 0;
+    }
+    size_t write(uint8_t value) override { return write(&value, 1); }
+    size_t write(const uint8_t* buffer, size_t size) override {
+        if (fd < 0) return 0;
+        ssize_t sent = ::send(fd, buffer, size, MSG_NOSIGNAL);
+        return sent > 0 ? sent : 0;
+    }
+    int available() override {
+        int count = 0;
+        return fd >= 0 && ioctl(fd, FIONREAD, &count) == 0 ? count : 0;
+    }
+    int read() override {
+        uint8_t value;
+        return read(&value, 1) == 1 ? value : -1;
+    }
+    int read(uint8_t* buffer, size_t size) override {
+        if (fd < 0) return -1;
+        ssize_t received = ::recv(fd, buffer, size, MSG_DONTWAIT);
+        return received > 0 ? received : -1;
+    }
+    int peek() override { return -1; }
+    void flush() override {}
+    void stop() override {
+        if (fd >= 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+    // Open until the peer closes; a zero-length peek means it has
+    uint8_t connected() override {
+        if (fd < 0) return 0;
+        uint8_t value;
+        ssize_t received = ::recv(fd, &value, 1, MSG_PEEK | MSG_DONTWAIT);
+        return received > 0 || (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK));
+    }
+    operator bool() override { return connected(); }
+    void setNoDelay(bool noDelay) {
+        int value = noDelay;
+        if (fd >= 0) setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &value, sizeof(value));
+    }
+    int setTimeout(uint32_t) { return 0; }
+};
+#else
+class WiFiClient : public Client {
+public:
+    int connect(IPAddress, uint16_t) override { return 0; }
+    int connect(const char*, uint16_t) override { return 0; }
+    size_t write(uint8_t) override { return 0; }
+    size_t write(const uint8_t*, size_t) override { return 0; }
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int read(uint8_t*, size_t) override { return -1; }
+    int peek() override { return -1; }
+    void flush() override {}
+    void stop() override {}
+    uint8_t connected() override { return 0; }
+    operator bool() override { return false; }
+    void setNoDelay(bool) {}
+    int setTimeout(uint32_t) { return 0; }
+};
+#endif
+
+#endif // MOCK_WIFI_H
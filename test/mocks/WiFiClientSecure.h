@@ -0,0 +1,14 @@
+#ifndef MOCK_WIFI_CLIENT_SECURE_H
+#define MOCK_WIFI_CLIENT_SECURE_H
+
+#include <WiFi.h>
+
+class WiFiClientSecure : public WiFiClient {
+public:
+    void setCACert(const char*) {}
+    void setCertificate(const char*) {}
+    void setPrivateKey(const char*) {}
+    void setHandshakeTimeout(unsigned long) {}
+};
+
+#endif // MOCK_WIFI_CLIENT_SECURE_H
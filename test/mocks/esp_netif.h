@@ -0,0 +1,8 @@
+#ifndef MOCK_ESP_NETIF_H
+#define MOCK_ESP_NETIF_H
+
+typedef struct esp_netif_obj esp_netif_t;
+
+inline esp_netif_t* esp_netif_get_handle_from_ifkey(const char*) { return nullptr; }
+
+#endif // MOCK_ESP_NETIF_H
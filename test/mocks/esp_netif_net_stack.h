@@ -0,0 +1,8 @@
+#ifndef MOCK_ESP_NETIF_NET_STACK_H
+#define MOCK_ESP_NETIF_NET_STACK_H
+
+#include "esp_netif.h"
+
+inline void* esp_netif_get_netif_impl(esp_netif_t*) { return nullptr; }
+
+#endif // MOCK_ESP_NETIF_NET_STACK_H
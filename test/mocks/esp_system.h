@@ -0,0 +1,16 @@
+#ifndef MOCK_ESP_SYSTEM_H
+#define MOCK_ESP_SYSTEM_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+
+inline uint32_t esp_random() { return ((uint32_t)rand() << 16) ^ (uint32_t)rand(); }
+inline uint32_t esp_get_free_heap_size() { return 200000; }
+inline uint32_t esp_get_minimum_free_heap_size() { return 200000; }
+inline void esp_restart() {}
+
+#endif // MOCK_ESP_SYSTEM_H
@@ -0,0 +1,8 @@
+#ifndef MOCK_ESP_TIMER_H
+#define MOCK_ESP_TIMER_H
+
+#include "freertos/FreeRTOS.h"
+
+inline int64_t esp_timer_get_time() { return (int64_t)mockMillis * 1000; }
+
+#endif // MOCK_ESP_TIMER_H
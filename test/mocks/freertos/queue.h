@@ -0,0 +1,40 @@
+#ifndef MOCK_FREERTOS_QUEUE_H
+#define MOCK_FREERTOS_QUEUE_H
+
+#include "FreeRTOS.h"
+#include <deque>
+#include <string>
+
+// Bounded copy-in/copy-out queue; receives never wait
+struct MockQueue {
+    UBaseType_t length;
+    UBaseType_t itemSize;
+    std::deque<std::string> items;
+};
+typedef MockQueue* QueueHandle_t;
+
+inline QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+    return new MockQueue{ length, itemSize, {} };
+}
+inline BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t) {
+    if (queue->items.size() >= queue->length) {
+        return pdFALSE;
+    }
+    queue->items.emplace_back((const char*)item, queue->itemSize);
+    return pdTRUE;
+}
+inline BaseType_t xQueueSendToBack(QueueHandle_t queue, const void* item, TickType_t wait) {
+    return xQueueSend(queue, item, wait);
+}
+inline BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t) {
+    if (queue->items.empty()) {
+        return pdFALSE;
+    }
+    queue->items.front().copy((char*)item, queue->itemSize);
+    queue->items.pop_front();
+    return pdTRUE;
+}
+inline UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) { return queue->items.size(); }
+inline UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue) { return queue->length - queue->items.size(); }
+
+#endif // MOCK_FREERTOS_QUEUE_H
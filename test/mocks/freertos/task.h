@@ -0,0 +1,31 @@
+#ifndef MOCK_FREERTOS_TASK_H
+#define MOCK_FREERTOS_TASK_H
+
+#include "FreeRTOS.h"
+
+typedef void (*TaskFunction_t)(void*);
+
+// Handles only need to be distinct and non-null
+inline uint8_t mockTaskHandles[16];
+inline uint8_t mockTaskCount = 0;
+
+inline BaseType_t xTaskCreatePinnedToCore(TaskFunction_t, const char*, uint32_t, void*, UBaseType_t,
+                                          TaskHandle_t* handle, BaseType_t) {
+    if (handle) {
+        *handle = &mockTaskHandles[mockTaskCount++ % 16];
+    }
+    return pdPASS;
+}
+inline BaseType_t xTaskCreate(TaskFunction_t function, const char* name, uint32_t stack, void* parameter,
+                              UBaseType_t priority, TaskHandle_t* handle) {
+    return xTaskCreatePinnedToCore(function, name, stack, parameter, priority, handle, tskNO_AFFINITY);
+}
+inline void vTaskDelay(TickType_t) {}
+inline void vTaskDelete(TaskHandle_t) {}
+inline TickType_t xTaskGetTickCount() { return (TickType_t)mockMillis; }
+inline UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t) { return 4096; }
+inline TaskHandle_t xTaskGetCurrentTaskHandle() { return &mockTaskHandles[15]; }
+inline TaskHandle_t xTaskGetHandle(const char*) { return nullptr; }
+inline const char* pcTaskGetName(TaskHandle_t) { return "test"; }
+
+#endif // MOCK_FREERTOS_TASK_H
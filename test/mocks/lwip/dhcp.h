@@ -0,0 +1,24 @@
+#ifndef MOCK_LWIP_DHCP_H
+#define MOCK_LWIP_DHCP_H
+
+#include <stdint.h>
+
+typedef struct {
+    uint32_t addr;
+} ip4_addr_t;
+#define ip4_addr_set_u32(address, value) ((address)->addr = (value))
+
+#define DHCP_STATE_OFF 0
+#define DHCP_STATE_SELECTING 6
+#define DHCP_STATE_BOUND 10
+
+struct netif;
+struct dhcp {
+    uint8_t state;
+    ip4_addr_t offered_ip_addr;
+};
+
+inline struct dhcp* netif_dhcp_data(struct netif*) { return nullptr; }
+inline void dhcp_network_changed(struct netif*) {}
+
+#endif // MOCK_LWIP_DHCP_H
@@ -0,0 +1,12 @@
+#ifndef MOCK_LWIP_TCPIP_H
+#define MOCK_LWIP_TCPIP_H
+
+typedef void (*tcpip_callback_fn)(void* context);
+
+// Runs the callback at once: the host has no lwIP thread
+inline int tcpip_callback(tcpip_callback_fn function, void* context) {
+    function(context);
+    return 0;
+}
+
+#endif // MOCK_LWIP_TCPIP_H
@@ -0,0 +1,240 @@
+#include "../ble_fixture.h"
+#include "Sensors.h"
+
+// Several centrals at once: notification fan-out, its cost and order, and
+// the connection parameter profiles
+
+// Connects centrals 1 to BLE_MAX_CONNECTIONS, each subscribed to the door status
+void connectAll() {
+    for (uint16_t connId = 1; connId <= BLE_MAX_CONNECTIONS; connId++) {
+        loopback->simulateConnect(connId);
+        loopback->simulateSubscribe(connId, CHAR_ID_DOOR_STATUS, BLE_CCCD_NOTIFY);
+    }
+    loopback->clearNotifications();
+}
+
+void setUp() {
+    setUpBle();
+}
+
+void tearDown() {
+    tearDownBle();
+}
+
+void test_connection_limit() {
+    connectAll();
+    TEST_ASSERT_EQUAL(BLE_MAX_CONNECTIONS, ble->getConnectionCount());
+    TEST_ASSERT_FALSE(loopback->isAdvertising());
+
+    // One more is turned away
+    BLEConnection state;
+    loopback->simulateConnect(BLE_MAX_CONNECTIONS + 1);
+    TEST_ASSERT_EQUAL(BLE_MAX_CONNECTIONS, ble->getConnectionCount());
+    TEST_ASSERT_FALSE(ble->getConnection(BLE_MAX_CONNECTIONS + 1, state));
+
+    // A free slot is advertised again
+    loopback->simulateDisconnect(2);
+    TEST_ASSERT_EQUAL(BLE_MAX_CONNECTIONS - 1, ble->getConnectionCount());
+    TEST_ASSERT_TRUE(loopback->isAdvertising());
+}
+
+void test_every_central_is_notified() {
+    connectAll();
+
+    const uint8_t changes = 4;
+    for (uint8_t i = 0; i < changes; i++) {
+        ble->updateDoorStatus(i % 2 == 0);
+        runNotifications();
+    }
+
+    for (uint16_t connId = 1; connId <= BLE_MAX_CONNECTIONS; connId++) {
+        TEST_ASSERT_EQUAL(changes, countNotifications(CHAR_ID_DOOR_STATUS, connId));
+        TEST_ASSERT_EQUAL(changes, connection(connId).notifications);
+        TEST_ASSERT_EQUAL(0, connection(connId).notifyFailures);
+        TEST_ASSERT_EQUAL(STATUS_NOTIFY_MIN_INTERVAL, connection(connId).firstNotifyTime);
+    }
+}
+
+void test_notify_skips_disconnected_central() {
+    connectAll();
+    loopback->simulateDisconnect(3);
+
+    ble->updateDoorStatus(true);
+    runNotifications();
+
+    TEST_ASSERT_EQUAL(1, countNotifications(CHAR_ID_DOOR_STATUS, 1));
+    TEST_ASSERT_EQUAL(1, countNotifications(CHAR_ID_DOOR_STATUS, 2));
+    TEST_ASSERT_EQUAL(0, countNotifications(CHAR_ID_DOOR_STATUS, 3));
+}
+
+void test_fan_out_cost() {
+    connectAll();
+    uint32_t readsBefore = loopback->getValueReads(CHAR_ID_DOOR_STATUS);
+
+    ble->updateDoorStatus(true);
+    runNotifications();
+
+    // One status change is one read of the value and one notify call per
+    // subscriber, all sent from the same buffer
+    TEST_ASSERT_EQUAL(1, loopback->getValueReads(CHAR_ID_DOOR_STATUS) - readsBefore);
+    TEST_ASSERT_EQUAL(BLE_MAX_CONNECTIONS, loopback->getNotificationCount());
+    TEST_ASSERT_EQUAL(BLE_MAX_CONNECTIONS * strlen("1"), loopback->getNotifiedBytes());
+    const uint8_t* buffer = loopback->getNotification(0)->buffer;
+    for (uint32_t i = 0; i < BLE_MAX_CONNECTIONS; i++) {
+        TEST_ASSERT_EQUAL(CHAR_ID_DOOR_STATUS, loopback->getNotification(i)->characteristicId);
+        TEST_ASSERT_TRUE(loopback->getNotification(i)->buffer == buffer);
+    }
+}
+
+void test_delivery_order_rotates() {
+    connectAll();
+
+    // Over BLE_MAX_CONNECTIONS changes each central is served first once, and
+    // every change serves the centrals in the same cyclic order
+    bool servedFirst[BLE_MAX_CONNECTIONS + 1] = {};
+    for (uint8_t change = 0; change < BLE_MAX_CONNECTIONS; change++) {
+        loopback->clearNotifications();
+        ble->updateDoorStatus(change % 2 == 0);
+        runNotifications();
+        TEST_ASSERT_EQUAL(BLE_MAX_CONNECTIONS, loopback->getNotificationCount());
+
+        uint16_t first = loopback->getNotification(0)->connId;
+        TEST_ASSERT_FALSE(servedFirst[first]);
+        servedFirst[first] = true;
+        for (uint32_t i = 1; i < BLE_MAX_CONNECTIONS; i++) {
+            TEST_ASSERT_EQUAL((first - 1 + i) % BLE_MAX_CONNECTIONS + 1, loopback->getNotification(i)->connId);
+        }
+    }
+}
+
+void test_fast_profile_until_idle_timeout() {
+    connectAll();
+    unsigned long connectedAt = mockMillis;
+
+    // Connecting counts as activity
+    ble->checkConnectionParameters();
+    for (uint16_t connId = 1; connId <= BLE_MAX_CONNECTIONS; connId++) {
+        TEST_ASSERT_EQUAL(CONN_PROFILE_FAST, connection(connId).requestedProfile);
+        TEST_ASSERT_EQUAL(CONN_FAST_MAX_INTERVAL, connection(connId).interval);
+        TEST_ASSERT_EQUAL(CONN_FAST_LATENCY, connection(connId).latency);
+    }
+
+    mockMillis = connectedAt + BLE_IDLE_TIMEOUT - 1;
+    ble->checkConnectionParameters();
+    TEST_ASSERT_EQUAL(CONN_PROFILE_FAST, connection(1).requestedProfile);
+
+    mockMillis = connectedAt + BLE_IDLE_TIMEOUT;
+    ble->checkConnectionParameters();
+    for (uint16_t connId = 1; connId <= BLE_MAX_CONNECTIONS; connId++) {
+        TEST_ASSERT_EQUAL(CONN_PROFILE_IDLE, connection(connId).requestedProfile);
+        TEST_ASSERT_EQUAL(CONN_IDLE_MAX_INTERVAL, connection(connId).interval);
+        TEST_ASSERT_EQUAL(CONN_IDLE_LATENCY, connection(connId).latency);
+        TEST_ASSERT_EQUAL(CONN_IDLE_TIMEOUT, connection(connId).timeout);
+    }
+}
+
+void test_command_returns_to_fast_profile() {
+    connectAll();
+    mockMillis += BLE_IDLE_TIMEOUT;
+    ble->checkConnectionParameters();
+    TEST_ASSERT_EQUAL(CONN_PROFILE_IDLE, connection(1).requestedProfile);
+
+    // Requests are repeated no more often than BLE_PARAM_RETRY_INTERVAL
+    loopback->simulateWrite(CHAR_ID_LIGHTS, "1");
+    ble->checkConnectionParameters();
+    TEST_ASSERT_EQUAL(CONN_PROFILE_IDLE, connection(1).requestedProfile);
+
+    mockMillis += BLE_PARAM_RETRY_INTERVAL;
+    ble->checkConnectionParameters();
+    for (uint16_t connId = 1; connId <= BLE_MAX_CONNECTIONS; connId++) {
+        TEST_ASSERT_EQUAL(CONN_PROFILE_FAST, connection(connId).requestedProfile);
+        TEST_ASSERT_EQUAL(CONN_FAST_MAX_INTERVAL, connection(connId).interval);
+    }
+}
+
+void test_motion_keeps_fast_profile() {
+    connectAll();
+    ble->updatePodState(POD_STATE_DOOR_MIDWAY, true);
+    mockMillis += BLE_IDLE_TIMEOUT;
+    ble->checkConnectionParameters();
+    TEST_ASSERT_EQUAL(CONN_PROFILE_FAST, connection(1).requestedProfile);
+
+    ble->updatePodState(POD_STATE_DOOR_OPEN, true);
+    mockMillis += BLE_PARAM_RETRY_INTERVAL;
+    ble->checkConnectionParameters();
+    TEST_ASSERT_EQUAL(CONN_PROFILE_IDLE, connection(1).requestedProfile);
+}
+
+void test_overridden_parameters_are_requested_again() {
+    // The central answers every request with a 30 ms interval. The door
+    // keeps moving, so the fast profile stays wanted throughout.
+    loopback->setConnParamsResponse(true, 24, 0);
+    connectAll();
+    ble->updatePodState(POD_STATE_DOOR_MIDWAY, true);
+    ble->checkConnectionParameters();
+    TEST_ASSERT_EQUAL(BLE_MAX_CONNECTIONS, loopback->getConnParamRequests());
+    TEST_ASSERT_EQUAL(24, connection(1).interval);
+
+    mockMillis += BLE_PARAM_RETRY_INTERVAL - 1;
+    ble->checkConnectionParameters();
+    TEST_ASSERT_EQUAL(BLE_MAX_CONNECTIONS, loopback->getConnParamRequests());
+
+    // Requested again each retry interval, until BLE_PARAM_MAX_RETRIES
+    for (uint8_t retry = 1; retry <= BLE_PARAM_MAX_RETRIES + 1; retry++) {
+        mockMillis += 1;
+        ble->checkConnectionParameters();
+        mockMillis += BLE_PARAM_RETRY_INTERVAL - 1;
+        uint8_t retries = retry <= BLE_PARAM_MAX_RETRIES ? retry : BLE_PARAM_MAX_RETRIES;
+        TEST_ASSERT_EQUAL(BLE_MAX_CONNECTIONS * (1 + retries), loopback->getConnParamRequests());
+        TEST_ASSERT_EQUAL(retries, connection(1).paramRetries);
+    }
+    TEST_ASSERT_EQUAL(CONN_PROFILE_FAST, connection(1).requestedProfile);
+
+    // A new profile starts over; once granted it is not requested again
+    loopback->setConnParamsResponse(true);
+    uint32_t requestsBefore = loopback->getConnParamRequests();
+    ble->updatePodState(POD_STATE_DOOR_OPEN, true);
+    mockMillis += BLE_IDLE_TIMEOUT;
+    ble->checkConnectionParameters();
+    mockMillis += BLE_PARAM_RETRY_INTERVAL;
+    ble->checkConnectionParameters();
+    TEST_ASSERT_EQUAL(requestsBefore + BLE_MAX_CONNECTIONS, loopback->getConnParamRequests());
+    TEST_ASSERT_EQUAL(CONN_PROFILE_IDLE, connection(1).requestedProfile);
+    TEST_ASSERT_EQUAL(0, connection(1).paramRetries);
+    TEST_ASSERT_EQUAL(CONN_IDLE_MAX_INTERVAL, connection(1).interval);
+}
+
+void test_refused_request_is_retried() {
+    loopback->setConnParamsResponse(false);
+    connectAll();
+    ble->checkConnectionParameters();
+    TEST_ASSERT_TRUE(connection(1).paramRequestFailed);
+    TEST_ASSERT_EQUAL(0, connection(1).interval);
+
+    // Accepted on the retry
+    loopback->setConnParamsResponse(true);
+    mockMillis += BLE_PARAM_RETRY_INTERVAL;
+    ble->checkConnectionParameters();
+    TEST_ASSERT_EQUAL(2 * BLE_MAX_CONNECTIONS, loopback->getConnParamRequests());
+    TEST_ASSERT_FALSE(connection(1).paramRequestFailed);
+    TEST_ASSERT_EQUAL(CONN_FAST_MAX_INTERVAL, connection(1).interval);
+
+    mockMillis += BLE_PARAM_RETRY_INTERVAL;
+    ble->checkConnectionParameters();
+    TEST_ASSERT_EQUAL(2 * BLE_MAX_CONNECTIONS, loopback->getConnParamRequests());
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_connection_limit);
+    RUN_TEST(test_every_central_is_notified);
+    RUN_TEST(test_notify_skips_disconnected_central);
+    RUN_TEST(test_fan_out_cost);
+    RUN_TEST(test_delivery_order_rotates);
+    RUN_TEST(test_fast_profile_until_idle_timeout);
+    RUN_TEST(test_command_returns_to_fast_profile);
+    RUN_TEST(test_motion_keeps_fast_profile);
+    RUN_TEST(test_overridden_parameters_are_requested_again);
+    RUN_TEST(test_refused_request_is_retried);
+    return UNITY_END();
+}
@@ -0,0 +1,270 @@
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <PubSubClient.h>
+#include <WiFi.h>
+#include <unity.h>
+#include "CloudTask.h"
+#include "CloudOutbox.h"
+#include "CommandTrace.h"
+#include "LEDControl.h"
+
+// The cloud task against the in-process broker in the PubSubClient mock. The
+// tests run the task's passes themselves and move mockMillis between them.
+
+extern AwsMqttHandler awsMqtt;
+
+CommandQueue commandQueue;
+CloudStats before;
+size_t publishedBefore;
+
+// One pass of the cloud task, ms after the previous one
+void pass(uint32_t ms) {
+    mockMillis += ms;
+    runCloudTask();
+}
+
+// Parses a message the broker received from the pod
+void parsePublished(size_t index, JsonDocument& doc) {
+    TEST_ASSERT_TRUE(index < mockBroker.published.size());
+    const MockMqttMessage& message = mockBroker.published[index];
+    TEST_ASSERT_EQUAL_STRING(AWS_IOT_PUBLISH_TOPIC, message.topic.c_str());
+    TEST_ASSERT_FALSE(deserializeJson(doc, message.payload.c_str()));
+}
+
+// Accepts every update published since setUp(), as the shadow would
+void acceptPublished() {
+    for (size_t i = publishedBefore; i < mockBroker.published.size(); i++) {
+        StaticJsonDocument<512> doc;
+        parsePublished(i, doc);
+        std::string token = doc["clientToken"] | "";
+        mockBroker.deliver(AWS_IOT_ACCEPTED_TOPIC, "{\"clientToken\":\"" + token + "\"}");
+    }
+    pass(0);
+}
+
+void setUp() {
+    // Online and connected, with nothing waiting
+    WiFi.mockStatus = WL_CONNECTED;
+    while (!awsMqtt.isConnected()) {
+        pass(CLOUD_TASK_INTERVAL);
+    }
+    pass(CLOUD_COALESCE_WINDOW);
+    publishedBefore = mockBroker.published.size();
+    getCloudStats(before);
+}
+
+void tearDown() {
+    acceptPublished();
+}
+
+void test_connects_and_subscribes() {
+    TEST_ASSERT_EQUAL(1, mockBroker.connects);
+    TEST_ASSERT_TRUE(mockBroker.isSubscribed(AWS_IOT_DELTA_TOPIC));
+    TEST_ASSERT_TRUE(mockBroker.isSubscribed(AWS_IOT_ACCEPTED_TOPIC));
+    TEST_ASSERT_TRUE(mockBroker.isSubscribed(AWS_IOT_REJECTED_TOPIC));
+    TEST_ASSERT_TRUE(before.connected);
+    TEST_ASSERT_EQUAL(1, before.connects);
+}
+
+void test_update_is_published_as_reported_state() {
+    TEST_ASSERT_TRUE(postCloudPodStatus(true));
+    pass(0);
+
+    // Nothing goes out before the coalescing window closes
+    pass(CLOUD_COALESCE_WINDOW - 1);
+    TEST_ASSERT_EQUAL(publishedBefore, mockBroker.published.size());
+    pass(1);
+    TEST_ASSERT_EQUAL(publishedBefore + 1, mockBroker.published.size());
+
+    StaticJsonDocument<512> doc;
+    parsePublished(publishedBefore, doc);
+    JsonObject reported = doc["state"]["reported"];
+    TEST_ASSERT_TRUE(reported["is_open"].as<bool>());
+    TEST_ASSERT_FALSE(reported.containsKey("nightlight"));
+    TEST_ASSERT_FALSE(reported.containsKey("nightlight_brightness"));
+    TEST_ASSERT_FALSE(reported.containsKey("color"));
+    TEST_ASSERT_EQUAL(8, strlen(doc["clientToken"] | ""));
+
+    CloudStats stats;
+    getCloudStats(stats);
+    TEST_ASSERT_EQUAL(before.reports + 1, stats.reports);
+    TEST_ASSERT_EQUAL(0, stats.depth);
+    OutboxStats outbox;
+    getOutboxStats(outbox);
+    TEST_ASSERT_EQUAL(1, outbox.inFlight);
+}
+
+void test_window_coalesces_updates() {
+    // Three changes within CLOUD_COALESCE_WINDOW of the first
+    TEST_ASSERT_TRUE(postCloudPodStatus(false));
+    pass(0);
+    TEST_ASSERT_TRUE(postCloudLedBrightness(25));
+    pass(30);
+    TEST_ASSERT_TRUE(postCloudLedColor("00FF00"));
+    pass(30);
+    pass(CLOUD_COALESCE_WINDOW - 60);
+    TEST_ASSERT_EQUAL(publishedBefore + 1, mockBroker.published.size());
+
+    // One document with only the changed keys
+    StaticJsonDocument<512> doc;
+    parsePublished(publishedBefore, doc);
+    JsonObject reported = doc["state"]["reported"];
+    TEST_ASSERT_FALSE(reported["is_open"].as<bool>());
+    TEST_ASSERT_EQUAL(25, reported["nightlight_brightness"].as<int>());
+    TEST_ASSERT_EQUAL_STRING("00FF00", reported["color"] | "");
+    TEST_ASSERT_FALSE(reported.containsKey("nightlight"));
+
+    CloudStats stats;
+    getCloudStats(stats);
+    TEST_ASSERT_EQUAL(before.reports + 1, stats.reports);
+    TEST_ASSERT_EQUAL(before.coalesced + 2, stats.coalesced);
+
+    // A change after the window closed is the next update
+    TEST_ASSERT_TRUE(postCloudLedBrightness(26));
+    pass(0);
+    pass(CLOUD_COALESCE_WINDOW);
+    TEST_ASSERT_EQUAL(publishedBefore + 2, mockBroker.published.size());
+    getCloudStats(stats);
+    TEST_ASSERT_EQUAL(before.reports + 2, stats.reports);
+    TEST_ASSERT_EQUAL(before.coalesced + 2, stats.coalesced);
+}
+
+// Publishes one brightness update and returns its clientToken
+std::string publishBrightness(uint8_t brightness) {
+    size_t published = mockBroker.published.size();
+    TEST_ASSERT_TRUE(postCloudLedBrightness(brightness));
+    pass(0);
+    pass(CLOUD_COALESCE_WINDOW);
+    TEST_ASSERT_EQUAL(published + 1, mockBroker.published.size());
+
+    StaticJsonDocument<512> doc;
+    parsePublished(published, doc);
+    return doc["clientToken"] | "";
+}
+
+void test_accepted_token_acknowledges_update() {
+    std::string token = publishBrightness(60);
+
+    // Other clients' updates and unknown tokens are ignored
+    mockBroker.deliver(AWS_IOT_ACCEPTED_TOPIC, "{\"clientToken\":\"app-1234\"}");
+    mockBroker.deliver(AWS_IOT_ACCEPTED_TOPIC, "{\"clientToken\":\"ffffffff\"}");
+    pass(20);
+    OutboxStats outbox;
+    getOutboxStats(outbox);
+    TEST_ASSERT_EQUAL(1, outbox.inFlight);
+
+    // Latency runs from posting to the acknowledgement
+    mockBroker.deliver(AWS_IOT_ACCEPTED_TOPIC, "{\"clientToken\":\"" + token + "\"}");
+    pass(20);
+    getOutboxStats(outbox);
+    TEST_ASSERT_EQUAL(0, outbox.depth);
+
+    CloudStats stats;
+    getCloudStats(stats);
+    TEST_ASSERT_EQUAL(before.acked + 1, stats.acked);
+    TEST_ASSERT_EQUAL(CLOUD_COALESCE_WINDOW + 40, stats.latencyLast);
+}
+
+void test_unacknowledged_update_is_resent() {
+    std::string token = publishBrightness(61);
+
+    pass(CLOUD_ACK_TIMEOUT - 1);
+    TEST_ASSERT_EQUAL(publishedBefore + 1, mockBroker.published.size());
+    pass(1);
+    TEST_ASSERT_EQUAL(publishedBefore + 2, mockBroker.published.size());
+
+    // Sent again with the same token, so either acknowledgement completes it
+    StaticJsonDocument<512> doc;
+    parsePublished(publishedBefore + 1, doc);
+    TEST_ASSERT_EQUAL_STRING(token.c_str(), doc["clientToken"] | "");
+    OutboxStats outbox;
+    getOutboxStats(outbox);
+    TEST_ASSERT_EQUAL(1, outbox.depth);
+}
+
+void test_rejected_update_is_not_resent() {
+    std::string token = publishBrightness(62);
+    OutboxStats outboxBefore;
+    getOutboxStats(outboxBefore);
+
+    mockBroker.deliver(AWS_IOT_REJECTED_TOPIC, "{\"code\":400,\"clientToken\":\"" + token + "\"}");
+    pass(0);
+    pass(CLOUD_ACK_TIMEOUT);
+    TEST_ASSERT_EQUAL(publishedBefore + 1, mockBroker.published.size());
+
+    OutboxStats outbox;
+    getOutboxStats(outbox);
+    TEST_ASSERT_EQUAL(outboxBefore.rejected + 1, outbox.rejected);
+    TEST_ASSERT_EQUAL(0, outbox.depth);
+}
+
+void test_nothing_is_published_offline() {
+    WiFi.mockStatus = WL_DISCONNECTED;
+    TEST_ASSERT_TRUE(postCloudLedStatus(true));
+    pass(0);
+    pass(CLOUD_COALESCE_WINDOW);
+    TEST_ASSERT_EQUAL(publishedBefore, mockBroker.published.size());
+
+    CloudStats stats;
+    getCloudStats(stats);
+    TEST_ASSERT_FALSE(stats.connected);
+    TEST_ASSERT_EQUAL(before.reports + 1, stats.reports);
+
+    // Sent once WiFi is back; the MQTT session survived
+    WiFi.mockStatus = WL_CONNECTED;
+    pass(CLOUD_TASK_INTERVAL);
+    TEST_ASSERT_EQUAL(publishedBefore + 1, mockBroker.published.size());
+    TEST_ASSERT_EQUAL(1, mockBroker.connects);
+}
+
+void test_delta_queues_commands() {
+    mockBroker.deliver(AWS_IOT_DELTA_TOPIC,
+                       "{\"version\":10,\"state\":{\"nightlight_brightness\":30,\"nightlight\":true}}");
+    pass(0);
+
+    // Desired fields in order, then the acknowledgement that reports them back
+    PodCommand command;
+    TEST_ASSERT_TRUE(commandQueue.pop(command));
+    TEST_ASSERT_EQUAL(CMD_SET_LED_BRIGHTNESS, command.type);
+    TEST_ASSERT_EQUAL(TRACE_SOURCE_MQTT, command.source);
+    TEST_ASSERT_EQUAL(30, command.value);
+    TEST_ASSERT_TRUE(commandQueue.pop(command));
+    TEST_ASSERT_EQUAL(CMD_SET_LED_STATE, command.type);
+    TEST_ASSERT_EQUAL(LED_STATE_ON, command.value);
+    TEST_ASSERT_TRUE(commandQueue.pop(command));
+    TEST_ASSERT_EQUAL(CMD_SHADOW_ACK, command.type);
+    TEST_ASSERT_FALSE(commandQueue.pop(command));
+
+    // Redelivered and older versions are dropped
+    mockBroker.deliver(AWS_IOT_DELTA_TOPIC, "{\"version\":10,\"state\":{\"is_open\":true}}");
+    mockBroker.deliver(AWS_IOT_DELTA_TOPIC, "{\"version\":9,\"state\":{\"is_open\":true}}");
+    pass(0);
+    TEST_ASSERT_FALSE(commandQueue.pop(command));
+
+    mockBroker.deliver(AWS_IOT_DELTA_TOPIC, "{\"version\":11,\"state\":{\"is_open\":true}}");
+    pass(0);
+    TEST_ASSERT_TRUE(commandQueue.pop(command));
+    TEST_ASSERT_EQUAL(CMD_SET_POD_OPEN, command.type);
+    TEST_ASSERT_EQUAL(1, command.value);
+    TEST_ASSERT_TRUE(commandQueue.pop(command));
+    TEST_ASSERT_EQUAL(CMD_SHADOW_ACK, command.type);
+}
+
+int main(int argc, char** argv) {
+    initCloudTask(&commandQueue);
+    awsMqtt.begin();
+
+    // Past the first reconnect interval
+    mockMillis = 10000;
+
+    UNITY_BEGIN();
+    RUN_TEST(test_connects_and_subscribes);
+    RUN_TEST(test_update_is_published_as_reported_state);
+    RUN_TEST(test_window_coalesces_updates);
+    RUN_TEST(test_accepted_token_acknowledges_update);
+    RUN_TEST(test_unacknowledged_update_is_resent);
+    RUN_TEST(test_rejected_update_is_not_resent);
+    RUN_TEST(test_nothing_is_published_offline);
+    RUN_TEST(test_delta_queues_commands);
+    return UNITY_END();
+}
@@ -0,0 +1,145 @@
+#include <Arduino.h>
+#include <PubSubClient.h>
+#include <unity.h>
+#include "CloudTask.h"
+#include "CloudOutbox.h"
+
+// The control loop side of the cloud task: posting never blocks, a full
+// queue drops, and unchanged values are not posted again. These tests do not
+// run the cloud task, so they drain its queue themselves.
+
+extern QueueHandle_t cloudQueue;
+extern AwsMqttHandler awsMqtt;
+
+CommandQueue commandQueue;
+CloudStats before;
+
+// Takes every queued message, as the cloud task would
+uint32_t drainCloudQueue() {
+    CloudMessage message;
+    uint32_t count = 0;
+    while (xQueueReceive(cloudQueue, &message, 0) == pdTRUE) {
+        count++;
+    }
+    return count;
+}
+
+void setUp() {
+    mockMillis += 1000;
+    initCloudTask(&commandQueue);
+
+    // Known last posted values
+    postCloudDeviceStatus(false, false, 0, "000000");
+    drainCloudQueue();
+    getCloudStats(before);
+}
+
+void tearDown() {}
+
+void test_full_queue_drops() {
+    const uint32_t extra = 4;
+    for (uint32_t i = 0; i < CLOUD_QUEUE_SIZE + extra; i++) {
+        TEST_ASSERT_EQUAL(i < CLOUD_QUEUE_SIZE, postCloudLedBrightness(i + 1));
+    }
+
+    CloudStats stats;
+    getCloudStats(stats);
+    TEST_ASSERT_EQUAL(before.posted + CLOUD_QUEUE_SIZE, stats.posted);
+    TEST_ASSERT_EQUAL(before.drops + extra, stats.drops);
+    TEST_ASSERT_EQUAL(CLOUD_QUEUE_SIZE, stats.depth);
+    TEST_ASSERT_EQUAL(CLOUD_QUEUE_SIZE, stats.maxDepth);
+    TEST_ASSERT_EQUAL(CLOUD_QUEUE_SIZE, drainCloudQueue());
+}
+
+void test_dropped_value_is_posted_again() {
+    for (uint32_t i = 0; i < CLOUD_QUEUE_SIZE; i++) {
+        postCloudLedBrightness(i + 1);
+    }
+    TEST_ASSERT_FALSE(postCloudLedColor("00FF00"));
+    drainCloudQueue();
+
+    TEST_ASSERT_TRUE(postCloudLedColor("00FF00"));
+    CloudStats stats;
+    getCloudStats(stats);
+    TEST_ASSERT_EQUAL(before.posted + CLOUD_QUEUE_SIZE + 1, stats.posted);
+    TEST_ASSERT_EQUAL(before.drops + 1, stats.drops);
+    TEST_ASSERT_EQUAL(1, drainCloudQueue());
+}
+
+void test_unchanged_values_are_skipped() {
+    TEST_ASSERT_TRUE(postCloudPodStatus(true));
+    TEST_ASSERT_TRUE(postCloudPodStatus(true));
+    TEST_ASSERT_TRUE(postCloudLedStatus(true));
+    TEST_ASSERT_TRUE(postCloudLedStatus(true));
+    TEST_ASSERT_TRUE(postCloudLedColor("FF8000"));
+    TEST_ASSERT_TRUE(postCloudLedColor("FF8000"));
+
+    // Already reported by the device status in setUp()
+    TEST_ASSERT_TRUE(postCloudLedBrightness(0));
+
+    // Not a color; rejected without posting
+    TEST_ASSERT_FALSE(postCloudLedColor("FF80"));
+
+    CloudStats stats;
+    getCloudStats(stats);
+    TEST_ASSERT_EQUAL(before.posted + 3, stats.posted);
+    TEST_ASSERT_EQUAL(before.drops, stats.drops);
+    TEST_ASSERT_EQUAL(3, drainCloudQueue());
+}
+
+void test_device_status_is_always_posted() {
+    TEST_ASSERT_TRUE(postCloudDeviceStatus(false, false, 0, "000000"));
+    TEST_ASSERT_TRUE(postCloudDeviceStatus(false, false, 0, "000000"));
+
+    CloudStats stats;
+    getCloudStats(stats);
+    TEST_ASSERT_EQUAL(before.posted + 2, stats.posted);
+    TEST_ASSERT_EQUAL(2, drainCloudQueue());
+}
+
+void test_undelivered_value_is_posted_again() {
+    TEST_ASSERT_TRUE(postCloudLedBrightness(40));
+    TEST_ASSERT_TRUE(postCloudPodStatus(true));
+    TEST_ASSERT_EQUAL(2, drainCloudQueue());
+
+    // The brightness update is sent and never acknowledged until the outbox
+    // gives it up
+    OutboxStats outboxBefore;
+    getOutboxStats(outboxBefore);
+    CloudDeviceStatus status = {};
+    status.brightness = 40;
+    TEST_ASSERT_TRUE(awsMqtt.connect());
+    setOutboxOnline(true);
+    addOutboxEntry(status, REPORTED_BRIGHTNESS, millis());
+    runOutbox(awsMqtt);
+    for (uint8_t i = 0; i < CLOUD_MAX_RETRIES; i++) {
+        mockMillis += CLOUD_ACK_TIMEOUT;
+        runOutbox(awsMqtt);
+    }
+    setOutboxOnline(false);
+    TEST_ASSERT_EQUAL(CLOUD_MAX_RETRIES, mockBroker.published.size());
+
+    OutboxStats outboxStats;
+    getOutboxStats(outboxStats);
+    TEST_ASSERT_EQUAL(outboxBefore.expired + 1, outboxStats.expired);
+    TEST_ASSERT_EQUAL(0, outboxStats.depth);
+
+    // The shadow may still hold the old brightness, so it is posted again;
+    // the door status was not given up and is still skipped
+    TEST_ASSERT_TRUE(postCloudLedBrightness(40));
+    TEST_ASSERT_TRUE(postCloudPodStatus(true));
+    CloudStats stats;
+    getCloudStats(stats);
+    TEST_ASSERT_EQUAL(before.posted + 3, stats.posted);
+    TEST_ASSERT_EQUAL(1, drainCloudQueue());
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_full_queue_drops);
+    RUN_TEST(test_dropped_value_is_posted_again);
+    RUN_TEST(test_unchanged_values_are_skipped);
+    RUN_TEST(test_device_status_is_always_posted);
+    RUN_TEST(test_undelivered_value_is_posted_again);
+    return UNITY_END();
+}
@@ -0,0 +1,145 @@
+#include "../ble_fixture.h"
+#include "LEDControl.h"
+
+// Drives BLEControl as a central would, through the loopback transport
+
+void setUp() {
+    setUpBle();
+}
+
+void tearDown() {
+    tearDownBle();
+}
+
+void test_begin_advertises() {
+    TEST_ASSERT_TRUE(loopback->isStarted());
+    TEST_ASSERT_TRUE(loopback->isAdvertising());
+    TEST_ASSERT_EQUAL(sizeof(AdvertisedStatus), loopback->getAdvertisedData().length());
+}
+
+void test_connect_and_disconnect() {
+    loopback->simulateConnect(1);
+
+    BLEConnection connection;
+    TEST_ASSERT_EQUAL(1, ble->getConnectionCount());
+    TEST_ASSERT_TRUE(ble->getConnection(1, connection));
+    TEST_ASSERT_EQUAL(BLE_DEFAULT_MTU, connection.mtu);
+    TEST_ASSERT_EQUAL(0, connection.subscriptions);
+
+    // Advertising continues while there is room for more centrals
+    TEST_ASSERT_TRUE(loopback->isAdvertising());
+
+    loopback->simulateDisconnect(1);
+    TEST_ASSERT_EQUAL(0, ble->getConnectionCount());
+    TEST_ASSERT_FALSE(ble->getConnection(1, connection));
+}
+
+void test_cccd_write_subscribes() {
+    loopback->simulateConnect(1);
+    mockMillis += 30;
+    loopback->simulateSubscribe(1, CHAR_ID_DOOR_STATUS, BLE_CCCD_NOTIFY);
+
+    BLEConnection connection;
+    TEST_ASSERT_TRUE(ble->getConnection(1, connection));
+    TEST_ASSERT_EQUAL(1 << CHAR_ID_DOOR_STATUS, connection.subscriptions);
+    TEST_ASSERT_EQUAL(0, connection.indications);
+    TEST_ASSERT_EQUAL(30, connection.readyTime);
+
+    loopback->simulateSubscribe(1, CHAR_ID_DOOR_STATUS, 0);
+    TEST_ASSERT_TRUE(ble->getConnection(1, connection));
+    TEST_ASSERT_EQUAL(0, connection.subscriptions);
+}
+
+void test_notify_reaches_subscribers_only() {
+    loopback->simulateConnect(1);
+    loopback->simulateConnect(2);
+    loopback->simulateSubscribe(1, CHAR_ID_DOOR_STATUS, BLE_CCCD_NOTIFY);
+    loopback->clearNotifications();
+
+    ble->updateDoorStatus(true);
+    runNotifications();
+
+    const LoopbackNotification* notification = lastNotification(CHAR_ID_DOOR_STATUS, 1);
+    TEST_ASSERT_NOT_NULL(notification);
+    TEST_ASSERT_FALSE(notification->indicate);
+    TEST_ASSERT_EQUAL_STRING("1", notification->value.c_str());
+    TEST_ASSERT_NULL(lastNotification(CHAR_ID_DOOR_STATUS, 2));
+
+    BLEConnection connection;
+    TEST_ASSERT_TRUE(ble->getConnection(1, connection));
+    TEST_ASSERT_EQUAL(1, connection.notifications);
+    TEST_ASSERT_EQUAL(0, connection.notifyFailures);
+    TEST_ASSERT_EQUAL(STATUS_NOTIFY_MIN_INTERVAL, connection.firstNotifyTime);
+
+    // Unchanged values are not sent again
+    runNotifications();
+    TEST_ASSERT_TRUE(ble->getConnection(1, connection));
+    TEST_ASSERT_EQUAL(1, connection.notifications);
+}
+
+void test_mtu_change_lengthens_notifications() {
+    const char* status = "Connected to a network with a rather long name";
+    loopback->simulateConnect(1);
+    loopback->simulateSubscribe(1, CHAR_ID_WIFI_STATUS, BLE_CCCD_NOTIFY);
+
+    // Truncated to the default ATT payload
+    ble->updateWiFiStatus(status);
+    runNotifications();
+    const LoopbackNotification* notification = lastNotification(CHAR_ID_WIFI_STATUS, 1);
+    TEST_ASSERT_NOT_NULL(notification);
+    TEST_ASSERT_EQUAL(BLE_DEFAULT_MTU - 3, notification->value.length());
+
+    loopback->simulateMtu(1, BLE_PREFERRED_MTU);
+    BLEConnection connection;
+    TEST_ASSERT_TRUE(ble->getConnection(1, connection));
+    TEST_ASSERT_EQUAL(BLE_PREFERRED_MTU, connection.mtu);
+
+    ble->updateWiFiStatus("Connecting");
+    ble->updateWiFiStatus(status);
+    runNotifications();
+    notification = lastNotification(CHAR_ID_WIFI_STATUS, 1);
+    TEST_ASSERT_NOT_NULL(notification);
+    TEST_ASSERT_EQUAL_STRING(status, notification->value.c_str());
+}
+
+void test_indication_round_trip() {
+    loopback->simulateConnect(1);
+    loopback->simulateSubscribe(1, CHAR_ID_LIGHTS, BLE_CCCD_INDICATE);
+
+    ble->updateLEDStatus(LED_STATE_ON);
+    runNotifications();
+    const LoopbackNotification* notification = lastNotification(CHAR_ID_LIGHTS, 1);
+    TEST_ASSERT_NOT_NULL(notification);
+    TEST_ASSERT_TRUE(notification->indicate);
+
+    mockMillis += 2;
+    loopback->simulateIndicationConfirm(1, CHAR_ID_LIGHTS);
+    BLEConnection connection;
+    TEST_ASSERT_TRUE(ble->getConnection(1, connection));
+    TEST_ASSERT_FALSE(connection.indicationPending);
+    TEST_ASSERT_EQUAL(1, connection.rttCount);
+    TEST_ASSERT_EQUAL(2000, connection.rttLast);
+}
+
+void test_write_queues_command() {
+    loopback->simulateConnect(1);
+    loopback->simulateWrite(CHAR_ID_DOOR_STATUS, "1");
+
+    PodCommand command;
+    TEST_ASSERT_TRUE(commandQueue->pop(command));
+    TEST_ASSERT_EQUAL(CMD_SET_POD_OPEN, command.type);
+    TEST_ASSERT_EQUAL(1, command.value);
+    TEST_ASSERT_FALSE(commandQueue->pop(command));
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_begin_advertises);
+    RUN_TEST(test_connect_and_disconnect);
+    RUN_TEST(test_cccd_write_subscribes);
+    RUN_TEST(test_notify_reaches_subscribers_only);
+    RUN_TEST(test_mtu_change_lengthens_notifications);
+    RUN_TEST(test_indication_round_trip);
+    RUN_TEST(test_write_queues_command);
+    return UNITY_END();
+}
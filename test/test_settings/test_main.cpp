@@ -0,0 +1,160 @@
+#include "../ble_fixture.h"
+#include <ctime>
+#include "CommandDispatch.h"
+#include "SystemSettings.h"
+#include "LEDControl.h"
+
+// LED settings bursts are written to NVS once, after they settle. Slider
+// bursts arrive as BLE writes and are applied by the control loop.
+
+#define SLIDER_PERIOD 10           // 100 Hz (ms), one control loop pass per write
+#define EVENT_WRITES 3             // Writes carried by one 30 ms connection event
+
+CommandQueue* mqttQueue;
+
+uint32_t writesBefore;
+uint32_t deferredBefore;
+uint32_t nvsWritesBefore;
+uint32_t appliedBefore;
+std::clock_t cpuTime;              // Spent in the control loop passes of a test
+
+// One pass of the main loop
+void tick(unsigned long ms) {
+    mockMillis += ms;
+    std::clock_t start = std::clock();
+    runCommandQueue();
+    runSettingsPersistence();
+    cpuTime += std::clock() - start;
+}
+
+void writeBrightness(uint8_t brightness) {
+    loopback->simulateWrite(CHAR_ID_LIGHTS_BRIGHTNESS, std::to_string(brightness));
+}
+
+void printCpuTime(const char* burst) {
+    uint32_t applied = getCommandsApplied() - appliedBefore;
+    double micros = 1e6 * cpuTime / CLOCKS_PER_SEC;
+    printf("%s: %u received, %u applied, %u coalesced, %.0f us CPU (%.2f us per applied command)\n",
+           burst, commandQueue->getReceivedCount(), applied, commandQueue->getCoalescedCount(),
+           micros, applied ? micros / applied : 0.0);
+}
+
+void setUp() {
+    flushSettings();
+    setUpBle();
+    mqttQueue = new CommandQueue();
+    loopback->simulateConnect(1);
+    initCommandDispatch(&podOpen, &childLock, ble, commandQueue, mqttQueue);
+
+    writesBefore = getSettingsWriteCount();
+    deferredBefore = getSettingsDeferredCount();
+    nvsWritesBefore = mockNvsWrites;
+    appliedBefore = getCommandsApplied();
+    cpuTime = 0;
+}
+
+void tearDown() {
+    delete mqttQueue;
+    tearDownBle();
+}
+
+void test_slider_burst_is_written_once() {
+    const uint32_t updates = 200;
+    for (uint32_t i = 0; i < updates; i++) {
+        writeBrightness(i % 100 + 1);
+        tick(SLIDER_PERIOD);
+    }
+    printCpuTime("100 Hz burst");
+
+    // One write per pass: every update is applied, none coalesced
+    TEST_ASSERT_EQUAL(updates, commandQueue->getReceivedCount());
+    TEST_ASSERT_EQUAL(updates, getCommandsApplied() - appliedBefore);
+    TEST_ASSERT_EQUAL(0, commandQueue->getCoalescedCount());
+    TEST_ASSERT_EQUAL((updates - 1) % 100 + 1, getLEDBrightness());
+    TEST_ASSERT_EQUAL(nvsWritesBefore, mockNvsWrites);
+    TEST_ASSERT_EQUAL(writesBefore, getSettingsWriteCount());
+
+    // The last update was applied by the last pass; nothing is written until
+    // it settles. Then one commit carries the LED state and brightness.
+    tick(SETTINGS_SETTLE_MS - 1);
+    TEST_ASSERT_EQUAL(nvsWritesBefore, mockNvsWrites);
+    tick(1);
+    TEST_ASSERT_EQUAL(nvsWritesBefore + 2, mockNvsWrites);
+    TEST_ASSERT_EQUAL(writesBefore + 1, getSettingsWriteCount());
+    TEST_ASSERT_EQUAL(deferredBefore + 2 * (updates - 1), getSettingsDeferredCount());
+    TEST_ASSERT_EQUAL((updates - 1) % 100 + 1, getSavedLEDBrightness(0));
+
+    // Nothing is pending any more
+    tick(SETTINGS_SETTLE_MS);
+    TEST_ASSERT_EQUAL(writesBefore + 1, getSettingsWriteCount());
+}
+
+void test_batched_writes_are_coalesced() {
+    // Each connection event delivers EVENT_WRITES slider positions before the
+    // next control loop pass; only the newest is applied
+    const uint32_t events = 60;
+    for (uint32_t event = 0; event < events; event++) {
+        for (uint32_t i = 0; i < EVENT_WRITES; i++) {
+            writeBrightness((event * EVENT_WRITES + i) % 100 + 1);
+        }
+        for (uint32_t i = 0; i < EVENT_WRITES; i++) {
+            tick(SLIDER_PERIOD);
+        }
+    }
+    printCpuTime("Batched burst");
+
+    const uint32_t updates = events * EVENT_WRITES;
+    TEST_ASSERT_EQUAL(updates, commandQueue->getReceivedCount());
+    TEST_ASSERT_EQUAL(events, getCommandsApplied() - appliedBefore);
+    TEST_ASSERT_EQUAL(updates - events, commandQueue->getCoalescedCount());
+    TEST_ASSERT_EQUAL(0, commandQueue->getDropCount());
+    TEST_ASSERT_EQUAL((updates - 1) % 100 + 1, getLEDBrightness());
+
+    // Only applied updates reach the settings
+    tick(SETTINGS_SETTLE_MS);
+    TEST_ASSERT_EQUAL(nvsWritesBefore + 2, mockNvsWrites);
+    TEST_ASSERT_EQUAL(writesBefore + 1, getSettingsWriteCount());
+    TEST_ASSERT_EQUAL(deferredBefore + 2 * (events - 1), getSettingsDeferredCount());
+    TEST_ASSERT_EQUAL((updates - 1) % 100 + 1, getSavedLEDBrightness(0));
+}
+
+void test_separate_bursts_are_written_separately() {
+    setLEDBrightness(20);
+    tick(SETTINGS_SETTLE_MS);
+    setLEDBrightness(40);
+    tick(SETTINGS_SETTLE_MS);
+
+    TEST_ASSERT_EQUAL(writesBefore + 2, getSettingsWriteCount());
+    TEST_ASSERT_EQUAL(deferredBefore, getSettingsDeferredCount());
+    TEST_ASSERT_EQUAL(40, getSavedLEDBrightness(0));
+}
+
+void test_flush_writes_pending_settings_now() {
+    setLEDState(LED_STATE_ON);
+    for (uint8_t i = 0; i < 10; i++) {
+        setLEDColor(i % 2 ? "00FF00" : "FF0000");
+        setLEDBrightness(50 + i);
+        tick(SLIDER_PERIOD);
+    }
+    flushSettings();
+
+    // One commit of the settings namespace, carrying each setting once
+    TEST_ASSERT_EQUAL(writesBefore + 1, getSettingsWriteCount());
+    TEST_ASSERT_EQUAL(nvsWritesBefore + 3, mockNvsWrites);
+    TEST_ASSERT_EQUAL(deferredBefore + 18, getSettingsDeferredCount());
+    TEST_ASSERT_EQUAL_STRING("00FF00", getSavedLEDColor().c_str());
+    TEST_ASSERT_EQUAL(59, getSavedLEDBrightness(0));
+    TEST_ASSERT_EQUAL(LED_STATE_ON, getSavedLEDState());
+
+    tick(SETTINGS_SETTLE_MS);
+    TEST_ASSERT_EQUAL(writesBefore + 1, getSettingsWriteCount());
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_slider_burst_is_written_once);
+    RUN_TEST(test_batched_writes_are_coalesced);
+    RUN_TEST(test_separate_bursts_are_written_separately);
+    RUN_TEST(test_flush_writes_pending_settings_now);
+    return UNITY_END();
+}
@@ -0,0 +1,128 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include "TlsClient.h"
+
+// TlsClient against a real TLS 1.2 server over a host socket. Built in the
+// native_tls environment, which links the host's mbedTLS. The server and
+// certificates come from tools/tls_handshake_bench.py, which sets:
+//   TLS_BENCH_PORT    port of openssl s_server on localhost
+//   TLS_BENCH_DIR     directory holding ca.pem, device.pem and device.key
+//   TLS_BENCH_ROUNDS  full/resumed handshake pairs to time (default 20)
+
+std::string caPem;
+std::string devicePem;
+std::string deviceKey;
+uint16_t port = 0;
+uint32_t rounds = 20;
+
+TlsClient* tls;
+
+std::string readFile(const std::string& path) {
+    std::ifstream file(path);
+    std::stringstream contents;
+    contents << file.rdbuf();
+    return contents.str();
+}
+
+// Milliseconds for one connect, TCP setup included
+double timedConnect() {
+    auto start = std::chrono::steady_clock::now();
+    TEST_ASSERT_EQUAL(1, tls->connect("localhost", port));
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    tls->stop();
+    return elapsed.count();
+}
+
+double median(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    return values[values.size() / 2];
+}
+
+void setUp() {
+    if (port == 0) {
+        TEST_IGNORE_MESSAGE("No server; run tools/tls_handshake_bench.py");
+    }
+    tls = new TlsClient();
+    tls->setCACert(caPem.c_str());
+    tls->setCertificate(devicePem.c_str());
+    tls->setPrivateKey(deviceKey.c_str());
+
+    // The RTC copy of the session outlives the client, as across a reset
+    tls->clearSession();
+}
+
+void tearDown() {
+    delete tls;
+    tls = nullptr;
+}
+
+void test_second_connect_is_resumed() {
+    TEST_ASSERT_EQUAL(1, tls->connect("localhost", port));
+    TEST_ASSERT_TRUE(tls->getStats().sessionCached);
+    tls->stop();
+    TEST_ASSERT_EQUAL(1, tls->connect("localhost", port));
+    tls->stop();
+
+    const TlsStats& stats = tls->getStats();
+    TEST_ASSERT_EQUAL(1, stats.fullHandshakes);
+    TEST_ASSERT_EQUAL(1, stats.resumedHandshakes);
+    TEST_ASSERT_EQUAL(0, stats.failedHandshakes);
+}
+
+void test_cleared_session_is_full_handshake() {
+    TEST_ASSERT_EQUAL(1, tls->connect("localhost", port));
+    tls->stop();
+    tls->clearSession();
+    TEST_ASSERT_EQUAL(1, tls->connect("localhost", port));
+    tls->stop();
+
+    TEST_ASSERT_EQUAL(2, tls->getStats().fullHandshakes);
+    TEST_ASSERT_EQUAL(0, tls->getStats().resumedHandshakes);
+}
+
+void test_handshake_times() {
+    // Warms up the server and the client's parsed credentials
+    timedConnect();
+
+    std::vector<double> full;
+    std::vector<double> resumed;
+    for (uint32_t i = 0; i < rounds; i++) {
+        tls->clearSession();
+        full.push_back(timedConnect());
+        resumed.push_back(timedConnect());
+    }
+
+    const TlsStats& stats = tls->getStats();
+    TEST_ASSERT_EQUAL(1 + rounds, stats.fullHandshakes);
+    TEST_ASSERT_EQUAL(rounds, stats.resumedHandshakes);
+
+    // Parsed by tools/tls_handshake_bench.py
+    printf("TLS_BENCH key=%s rounds=%u full_ms=%.2f resumed_ms=%.2f full_total_ms=%u resumed_total_ms=%u\n",
+           tls->getKeyType(), rounds, median(full), median(resumed), stats.fullTimeTotal, stats.resumedTimeTotal);
+}
+
+int main(int argc, char** argv) {
+    const char* benchPort = getenv("TLS_BENCH_PORT");
+    const char* benchDir = getenv("TLS_BENCH_DIR");
+    const char* benchRounds = getenv("TLS_BENCH_ROUNDS");
+    if (benchPort && benchDir) {
+        port = atoi(benchPort);
+        caPem = readFile(std::string(benchDir) + "/ca.pem");
+        devicePem = readFile(std::string(benchDir) + "/device.pem");
+        deviceKey = readFile(std::string(benchDir) + "/device.key");
+    }
+    if (benchRounds) {
+        rounds = std::max(1, atoi(benchRounds));
+    }
+
+    UNITY_BEGIN();
+    RUN_TEST(test_second_connect_is_resumed);
+    RUN_TEST(test_cleared_session_is_full_handshake);
+    RUN_TEST(test_handshake_times);
+    return UNITY_END();
+}
@@ -0,0 +1,132 @@
+#!/usr/bin/env python3
+"""Full versus resumed TlsClient handshake times against a local broker stand-in.
+
+Starts `openssl s_server` on localhost with a throwaway CA, server and
+device certificate, requiring client authentication as AWS IoT does. Then
+runs test/test_tls_resumption in the native_tls environment, which builds
+the firmware's TlsClient against the host mbedTLS. The test checks that a
+second connect is counted as resumed in TlsStats, then times rounds of one
+full handshake and one that offers the session from it. TLS 1.2 is used,
+like mbedTLS on the device.
+
+    python3 tools/tls_handshake_bench.py [--key rsa|ec|both] [--rounds N]
+
+Needs PlatformIO and the mbedTLS development package. Times are for the
+host CPU over loopback and only show the ratio; the `cloud` console command
+reports the times measured on the pod.
+"""
+
+import argparse
+import os
+import re
+import shutil
+import socket
+import subprocess
+import sys
+import tempfile
+import time
+
+KEY_OPTIONS = {
+    "rsa": ["-newkey", "rsa:2048"],
+    "ec": ["-newkey", "ec", "-pkeyopt", "ec_paramgen_curve:P-256"],
+}
+
+
+def openssl(*args, cwd):
+    subprocess.run([OPENSSL, *args], cwd=cwd, check=True, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+
+
+def make_certificates(directory, key_type):
+    """CA, broker and device certificates, all with the same key type"""
+    key = KEY_OPTIONS[key_type]
+    openssl("req", "-x509", *key, "-nodes", "-days", "1", "-subj", "/CN=Bench CA",
+            "-keyout", "ca.key", "-out", "ca.pem", cwd=directory)
+    for name in ("server", "device"):
+        openssl("req", *key, "-nodes", "-subj", "/CN=" + ("localhost" if name == "server" else "sole-pod"),
+                "-keyout", name + ".key", "-out", name + ".csr", cwd=directory)
+        openssl("x509", "-req", "-in", name + ".csr", "-CA", "ca.pem", "-CAkey", "ca.key",
+                "-CAcreateserial", "-days", "1", "-out", name + ".pem", cwd=directory)
+
+
+def free_port():
+    with socket.socket() as probe:
+        probe.bind(("127.0.0.1", 0))
+        return probe.getsockname()[1]
+
+
+def start_server(directory, port):
+    server = subprocess.Popen(
+        [OPENSSL, "s_server", "-accept", str(port), "-tls1_2", "-cert", "server.pem", "-key", "server.key",
+         "-CAfile", "ca.pem", "-Verify", "1", "-quiet"],
+        cwd=directory, stdin=subprocess.DEVNULL, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+
+    # Wait for the listening socket
+    deadline = time.monotonic() + 10
+    while time.monotonic() < deadline:
+        try:
+            socket.create_connection(("127.0.0.1", port), timeout=0.2).close()
+            return server
+        except OSError:
+            time.sleep(0.05)
+    server.kill()
+    raise RuntimeError("openssl s_server did not start")
+
+
+def run_test(directory, port, rounds):
+    """Runs test_tls_resumption and returns its median (full, resumed) times in ms"""
+    env = dict(os.environ, TLS_BENCH_PORT=str(port), TLS_BENCH_DIR=directory, TLS_BENCH_ROUNDS=str(rounds))
+    result = subprocess.run([PIO, "test", "-e", "native_tls", "-f", "test_tls_resumption", "-v"],
+                            cwd=REPO, env=env, stdout=subprocess.PIPE, stderr=subprocess.STDOUT, text=True)
+    # The test asserts that the second connect was resumed
+    match = re.search(r"TLS_BENCH .*full_ms=([\d.]+) resumed_ms=([\d.]+)", result.stdout)
+    if result.returncode != 0 or not match:
+        sys.stdout.write(result.stdout)
+        raise RuntimeError("test_tls_resumption failed")
+    return float(match.group(1)), float(match.group(2))
+
+
+def measure(key_type, rounds):
+    directory = tempfile.mkdtemp(prefix="tls-bench-")
+    server = None
+    try:
+        make_certificates(directory, key_type)
+        port = free_port()
+        server = start_server(directory, port)
+        return run_test(directory, port, rounds)
+    finally:
+        if server:
+            server.kill()
+            server.wait()
+        shutil.rmtree(directory, ignore_errors=True)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--key", choices=["rsa", "ec", "both"], default="both")
+    parser.add_argument("--rounds", type=int, default=50)
+    parser.add_argument("--openssl", default=shutil.which("openssl"), help="openssl binary for the server")
+    parser.add_argument("--pio", default=shutil.which("pio"), help="PlatformIO binary that runs the test")
+    args = parser.parse_args()
+
+    global OPENSSL, PIO
+    OPENSSL = args.openssl
+    PIO = args.pio
+    if not OPENSSL:
+        sys.exit("openssl not found")
+    if not PIO:
+        sys.exit("pio not found")
+
+    print(f"TlsClient (host mbedTLS), TLS 1.2, client certificate required, {args.rounds} rounds")
+    print(f"{'key':<14}{'full (ms)':>12}{'resumed (ms)':>14}{'ratio':>8}")
+    for key_type in (["rsa", "ec"] if args.key == "both" else [args.key]):
+        full_median, resumed_median = measure(key_type, args.rounds)
+        name = "RSA-2048" if key_type == "rsa" else "ECDSA P-256"
+        print(f"{name:<14}{full_median:>12.2f}{resumed_median:>14.2f}{full_median / resumed_median:>7.1f}x")
+
+
+OPENSSL = None
+PIO = None
+REPO = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+if __name__ == "__main__":
+    main()